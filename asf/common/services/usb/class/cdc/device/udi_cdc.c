@@ -68,8 +68,12 @@
 #  endif
 #else
 #  ifdef USB_DEVICE_HS_SUPPORT
-#    define UDI_CDC_TX_BUFFERS     (UDI_CDC_DATA_EPS_HS_SIZE)
-#    define UDI_CDC_RX_BUFFERS     (UDI_CDC_DATA_EPS_HS_SIZE)
+// Each buffer is sent or received as one multi-packet transfer, so that a bank of N x 512 bytes needs only one interrupt
+#    ifndef UDI_CDC_HS_PACKETS_PER_BUFFER
+#      define UDI_CDC_HS_PACKETS_PER_BUFFER 1
+#    endif
+#    define UDI_CDC_TX_BUFFERS     (UDI_CDC_HS_PACKETS_PER_BUFFER*UDI_CDC_DATA_EPS_HS_SIZE)
+#    define UDI_CDC_RX_BUFFERS     (UDI_CDC_HS_PACKETS_PER_BUFFER*UDI_CDC_DATA_EPS_HS_SIZE)
 #  else
 #    define UDI_CDC_TX_BUFFERS     (5*UDI_CDC_DATA_EPS_FS_SIZE)
 #    define UDI_CDC_RX_BUFFERS     (5*UDI_CDC_DATA_EPS_FS_SIZE)
@@ -80,6 +84,10 @@
 #  define UDI_CDC_TX_EMPTY_NOTIFY(port)
 #endif
 
+#ifndef UDI_CDC_RX_DATA_EXT
+#  define UDI_CDC_RX_DATA_EXT(port,buf,n)
+#endif
+
 /**
  * \ingroup udi_cdc_group
  * \defgroup udi_cdc_group_udc Interface with USB Device Core (UDC)
@@ -268,6 +276,18 @@ static uint16_t udi_cdc_tx_sof_num[UDI_CDC_PORT_NB];
 static volatile bool udi_cdc_tx_trans_ongoing[UDI_CDC_PORT_NB];
 //! Signal that both buffer content data to send
 static volatile bool udi_cdc_tx_both_buf_to_send[UDI_CDC_PORT_NB];
+//! Signal that the last transfer ended on a packet boundary, so a ZLP must follow to terminate it
+static bool udi_cdc_tx_zlp_needed[UDI_CDC_PORT_NB];
+//! Number of SOF notifications for which the current TX buffer has held data
+static uint8_t udi_cdc_tx_frames_held[UDI_CDC_PORT_NB];
+//! Number of SOF notifications to hold a partly-filled TX buffer for
+static uint8_t udi_cdc_tx_flush_frames[UDI_CDC_PORT_NB];
+//! TX statistics
+static udi_cdc_tx_stats_t udi_cdc_tx_stats[UDI_CDC_PORT_NB];
+
+#ifndef UDI_CDC_TX_FLUSH_FRAMES
+# define UDI_CDC_TX_FLUSH_FRAMES 1
+#endif
 
 //@}
 
@@ -346,6 +366,11 @@ bool udi_cdc_data_enable(void)
 	udi_cdc_tx_buf_nb[port][0] = 0;
 	udi_cdc_tx_buf_nb[port][1] = 0;
 	udi_cdc_tx_sof_num[port] = 0;
+	udi_cdc_tx_frames_held[port] = 0;
+	udi_cdc_tx_zlp_needed[port] = false;
+	if (udi_cdc_tx_flush_frames[port] == 0) {
+		udi_cdc_tx_flush_frames[port] = UDI_CDC_TX_FLUSH_FRAMES;
+	}
 	udi_cdc_tx_send(port);
 
 	// Initialize RX management
@@ -452,6 +477,11 @@ void udi_cdc_data_sof_notify(void)
 	static uint8_t port_notify = 0;
 
 	// A call of udi_cdc_data_sof_notify() is done for each port
+	// Age a partly-filled buffer so that udi_cdc_tx_send() knows when to flush it
+	if ((udi_cdc_tx_buf_nb[port_notify][udi_cdc_tx_buf_sel[port_notify]] != 0)
+			&& (udi_cdc_tx_frames_held[port_notify] != 0xFF)) {
+		udi_cdc_tx_frames_held[port_notify]++;
+	}
 	udi_cdc_tx_send(port_notify);
 #if UDI_CDC_PORT_NB != 1 // To optimize code
 	port_notify++;
@@ -668,6 +698,8 @@ static void udi_cdc_data_received(udd_ep_status_t status, iram_size_t n, udd_ep_
 		return;
 	}
 	udi_cdc_rx_buf_nb[port][buf_sel_trans] = n;
+	// Let the application see each packet as soon as it arrives, even if it hasn't yet read the previous ones
+	UDI_CDC_RX_DATA_EXT(port, udi_cdc_rx_buf[port][buf_sel_trans], n);
 	udi_cdc_rx_trans_ongoing[port] = false;
 	udi_cdc_rx_start(port);
 }
@@ -711,7 +743,7 @@ static void udi_cdc_tx_send(uint8_t port)
 	uint8_t buf_sel_trans;
 	bool b_short_packet;
 	udd_ep_id_t ep;
-	static uint16_t sof_zlp_counter = 0;
+	static uint16_t sof_zlp_counter[UDI_CDC_PORT_NB];
 
 #if UDI_CDC_PORT_NB == 1 // To optimize code
 	port = 0;
@@ -732,15 +764,24 @@ static void udi_cdc_tx_send(uint8_t port)
 
 	flags = cpu_irq_save(); // to protect udi_cdc_tx_buf_sel
 	buf_sel_trans = udi_cdc_tx_buf_sel[port];
-	if (udi_cdc_tx_buf_nb[port][buf_sel_trans] == 0) {
-		sof_zlp_counter++;
-		if (((!udd_is_high_speed()) && (sof_zlp_counter < 100))
-				|| (udd_is_high_speed() && (sof_zlp_counter < 800))) {
+	if ((udi_cdc_tx_buf_nb[port][buf_sel_trans] == 0) && (!udi_cdc_tx_zlp_needed[port])) {
+		sof_zlp_counter[port]++;
+		if (((!udd_is_high_speed()) && (sof_zlp_counter[port] < 100))
+				|| (udd_is_high_speed() && (sof_zlp_counter[port] < 800))) {
 			cpu_irq_restore(flags);
 			return;
 		}
 	}
-	sof_zlp_counter = 0;
+	sof_zlp_counter[port] = 0;
+
+	// Hold a partly-filled buffer for a while in case more data arrives, so that we send fewer and larger packets
+	if ((!udi_cdc_tx_both_buf_to_send[port])
+			&& (udi_cdc_tx_buf_nb[port][buf_sel_trans] != 0)
+			&& (udi_cdc_tx_buf_nb[port][buf_sel_trans] < UDI_CDC_TX_BUFFERS)
+			&& (udi_cdc_tx_frames_held[port] < udi_cdc_tx_flush_frames[port])) {
+		cpu_irq_restore(flags);
+		return;
+	}
 
 	if (!udi_cdc_tx_both_buf_to_send[port]) {
 		// Send current Buffer
@@ -755,6 +796,18 @@ static void udi_cdc_tx_send(uint8_t port)
 	cpu_irq_restore(flags);
 
 	b_short_packet = (udi_cdc_tx_buf_nb[port][buf_sel_trans] != UDI_CDC_TX_BUFFERS);
+	udi_cdc_tx_zlp_needed[port] = !b_short_packet;
+
+	udi_cdc_tx_stats[port].nb_packets++;
+	udi_cdc_tx_stats[port].nb_bytes += udi_cdc_tx_buf_nb[port][buf_sel_trans];
+	if (b_short_packet) {
+		udi_cdc_tx_stats[port].nb_short_packets++;
+		udi_cdc_tx_stats[port].nb_frames_held += udi_cdc_tx_frames_held[port];
+		if (udi_cdc_tx_frames_held[port] > udi_cdc_tx_stats[port].max_frames_held) {
+			udi_cdc_tx_stats[port].max_frames_held = udi_cdc_tx_frames_held[port];
+		}
+	}
+	udi_cdc_tx_frames_held[port] = 0;
 	if (b_short_packet) {
 		if (udd_is_high_speed()) {
 			udi_cdc_tx_sof_num[port] = udd_get_micro_frame_number();
@@ -965,7 +1018,7 @@ udi_cdc_read_buf_loop_wait:
 	return 0;
 }
 
-static iram_size_t udi_cdc_multi_read_no_polling(uint8_t port, void* buf, iram_size_t size)
+iram_size_t udi_cdc_multi_read_no_polling(uint8_t port, void* buf, iram_size_t size)
 {
 	uint8_t *ptr_buf = (uint8_t *)buf;
 	iram_size_t nb_avail_data;
@@ -1003,7 +1056,7 @@ static iram_size_t udi_cdc_multi_read_no_polling(uint8_t port, void* buf, iram_s
 		ptr_buf += size;
 		udi_cdc_rx_start(port);
 	}
-	return(nb_avail_data);
+	return size;			// return the number of bytes read, not the number that were available
 }
 
 iram_size_t udi_cdc_read_no_polling(void* buf, iram_size_t size)
@@ -1140,6 +1193,10 @@ udi_cdc_write_buf_loop_wait:
 	}
 	memcpy(&udi_cdc_tx_buf[port][buf_sel][buf_nb], ptr_buf, copy_nb);
 	udi_cdc_tx_buf_nb[port][buf_sel] = buf_nb + copy_nb;
+	if (buf_nb + copy_nb == UDI_CDC_TX_BUFFERS) {
+		// The buffer is full, so send it now instead of waiting for the next SOF
+		udi_cdc_tx_send(port);
+	}
 	cpu_irq_restore(flags);
 
 	// Update buffer pointer
@@ -1158,4 +1215,56 @@ iram_size_t udi_cdc_write_buf(const void* buf, iram_size_t size)
 	return udi_cdc_multi_write_buf(0, buf, size);
 }
 
+bool udi_cdc_multi_write_record(uint8_t port, const void* buf, iram_size_t size)
+{
+	irqflags_t flags;
+	uint8_t buf_sel;
+	iram_size_t room;
+
+#if UDI_CDC_PORT_NB == 1 // To optimize code
+	port = 0;
+#endif
+
+	if (!udi_cdc_data_running) {
+		return false;
+	}
+
+	flags = cpu_irq_save(); // the room must not change between checking it and writing the record
+	buf_sel = udi_cdc_tx_buf_sel[port];
+	room = UDI_CDC_TX_BUFFERS - udi_cdc_tx_buf_nb[port][buf_sel];
+	if ((!udi_cdc_tx_trans_ongoing[port]) && (!udi_cdc_tx_both_buf_to_send[port])) {
+		room += UDI_CDC_TX_BUFFERS; // the other buffer is empty and write_buf will move on to it
+	}
+	if (room < size) {
+		cpu_irq_restore(flags);
+		return false;
+	}
+	(void)udi_cdc_multi_write_buf(port, buf, size);
+	cpu_irq_restore(flags);
+	return true;
+}
+
+void udi_cdc_multi_set_tx_flush_frames(uint8_t port, uint8_t frames)
+{
+#if UDI_CDC_PORT_NB == 1 // To optimize code
+	port = 0;
+#endif
+	udi_cdc_tx_flush_frames[port] = (frames == 0) ? 1 : frames;
+}
+
+void udi_cdc_multi_get_tx_stats(uint8_t port, udi_cdc_tx_stats_t *stats, bool b_clear)
+{
+	irqflags_t flags;
+
+#if UDI_CDC_PORT_NB == 1 // To optimize code
+	port = 0;
+#endif
+	flags = cpu_irq_save();
+	*stats = udi_cdc_tx_stats[port];
+	if (b_clear) {
+		memset(&udi_cdc_tx_stats[port], 0, sizeof(udi_cdc_tx_stats[port]));
+	}
+	cpu_irq_restore(flags);
+}
+
 //@}
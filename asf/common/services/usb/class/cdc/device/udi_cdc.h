@@ -536,6 +536,17 @@ int udi_cdc_multi_getc(uint8_t port);
  */
 iram_size_t udi_cdc_multi_read_buf(uint8_t port, void* buf, iram_size_t size);
 
+/**
+ * \brief Reads whatever data is available on CDC line, without waiting
+ *
+ * \param port      Communication port number to manage
+ * \param buf       Buffer where to store read data
+ * \param size      Maximum number of data to read (size of buffer)
+ *
+ * \return the number of data effectively read
+ */
+iram_size_t udi_cdc_multi_read_no_polling(uint8_t port, void* buf, iram_size_t size);
+
 /**
  * \brief Gets the number of free byte in TX buffer
  *
@@ -576,6 +587,49 @@ int udi_cdc_multi_putc(uint8_t port, int value);
  * \return the number of data remaining
  */
 iram_size_t udi_cdc_multi_write_buf(uint8_t port, const void* buf, iram_size_t size);
+
+/**
+ * \brief Writes a record on CDC line if there is room for all of it
+ *
+ * Unlike udi_cdc_multi_write_buf(), a record is never split by running out
+ * of buffer space, so the host only ever receives whole records.
+ *
+ * \param port       Communication port number to manage
+ * \param buf        Record to write
+ * \param size       Length of the record, at most twice the TX buffer size
+ *
+ * \return \c true if the record was written, \c false if there was no room
+ */
+bool udi_cdc_multi_write_record(uint8_t port, const void* buf, iram_size_t size);
+
+/**
+ * \brief Sets how long a partly-filled TX buffer is held to collect more data
+ *
+ * Full buffers are sent as soon as possible. A partly-filled buffer is sent
+ * after it has been waiting for the given number of SOF notifications.
+ *
+ * \param port       Communication port number to manage
+ * \param frames     Number of SOF notifications, at least 1
+ */
+void udi_cdc_multi_set_tx_flush_frames(uint8_t port, uint8_t frames);
+
+//! Statistics of the data sent on a port
+typedef struct {
+	uint32_t nb_packets;        //!< Number of transfers started, including zero length packets
+	uint32_t nb_bytes;          //!< Number of bytes sent
+	uint32_t nb_short_packets;  //!< Number of transfers smaller than a full buffer
+	uint32_t nb_frames_held;    //!< Total number of SOF notifications that short packets waited for
+	uint16_t max_frames_held;   //!< Longest wait of a short packet
+} udi_cdc_tx_stats_t;
+
+/**
+ * \brief Gets the TX statistics of a port and optionally clears them
+ *
+ * \param port       Communication port number to manage
+ * \param stats      Where to store the statistics
+ * \param b_clear    Clear the statistics after reading them if true
+ */
+void udi_cdc_multi_get_tx_stats(uint8_t port, udi_cdc_tx_stats_t *stats, bool b_clear);
 //@}
 
 //@}
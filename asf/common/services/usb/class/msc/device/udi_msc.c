@@ -1121,4 +1121,19 @@ bool udi_msc_trans_block(bool b_read, uint8_t * block, iram_size_t block_size,
 	return true;
 }
 
+bool udi_msc_start_trans_block(bool b_read, uint8_t * block,
+		iram_size_t block_size)
+{
+	return udi_msc_trans_block(b_read, block, block_size, udi_msc_trans_ack);
+}
+
+bool udi_msc_is_trans_block_done(bool *b_aborted)
+{
+	if (!udi_msc_b_ack_trans) {
+		return false;
+	}
+	*b_aborted = udi_msc_b_abort_trans;
+	return true;
+}
+
 //@}
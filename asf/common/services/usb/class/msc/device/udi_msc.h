@@ -164,6 +164,30 @@ bool udi_msc_process_trans(void);
  */
 bool udi_msc_trans_block(bool b_read, uint8_t * block, iram_size_t block_size,
 		void (*callback) (udd_ep_status_t status, iram_size_t n, udd_ep_id_t ep));
+
+/**
+ * \brief Starts a transfer to/from USB MSC endpoints without waiting for it
+ *
+ * Lets the caller prepare the next block while this one is transferred.
+ * Use udi_msc_is_trans_block_done() to find out when it has finished.
+ *
+ * \param b_read        Memory to USB, if true
+ * \param block         Buffer on Internal RAM to send or fill
+ * \param block_size    Buffer size to send or fill
+ *
+ * \return \c 1 if the transfer was started, otherwise \c 0.
+ */
+bool udi_msc_start_trans_block(bool b_read, uint8_t * block,
+		iram_size_t block_size);
+
+/**
+ * \brief Checks whether a transfer started by udi_msc_start_trans_block() has finished
+ *
+ * \param b_aborted     Set to true if the transfer has finished because it was aborted
+ *
+ * \return \c 1 if no transfer is in progress, otherwise \c 0.
+ */
+bool udi_msc_is_trans_block_done(bool *b_aborted);
 //@}
 
 #ifdef __cplusplus
@@ -109,6 +109,7 @@
 #define Lun_2_usb_write_10                      sd_mmc_usb_write_10_0
 #define Lun_2_mem_2_ram                         sd_mmc_mem_2_ram_0
 #define Lun_2_ram_2_mem                         sd_mmc_ram_2_mem_0
+#define Lun_2_generation                        sd_mmc_generation_0
 #define LUN_2_NAME                              "\"SD/MMC Card Slot 0\""
 //! @}
 
@@ -126,6 +127,7 @@
 #define Lun_3_usb_write_10                      sd_mmc_usb_write_10_1
 #define Lun_3_mem_2_ram                         sd_mmc_mem_2_ram_1
 #define Lun_3_ram_2_mem                         sd_mmc_ram_2_mem_1
+#define Lun_3_generation                        sd_mmc_generation_1
 #define LUN_3_NAME                              "\"SD/MMC Card Slot 1\""
 //! @}
 
@@ -175,5 +177,13 @@
 #define GLOBAL_WR_PROTECT    false   //!< Management of a global write protection.
 //! @}
 
+/*! \name Sector Cache for the MEM <-> RAM Interface
+ */
+//! @{
+#define ACCESS_CACHE_SECTORS     4       //!< Number of sectors cached for single-sector transfers, 0 to disable the cache.
+#define ACCESS_CACHE_READ_AHEAD  4       //!< Number of sectors read at once when single-sector reads are sequential, 0 to disable read-ahead.
+#define ACCESS_CACHE_WRITE_BACK  false   //!< Keep written sectors in the cache until they are evicted or mem_sync() is called.
+//! @}
+
 
 #endif // _CONF_ACCESS_H_
@@ -72,7 +72,7 @@
 #define SD_MMC_HSMCI_MEM_CNT		0			// Number of HSMCI card slots supported
 #define SD_MMC_SPI_MEM_CNT			2			// Number of SPI card slots supported
 
-#define SD_MMC_SPI_MAX_CLOCK		(4000000)	// Max 4MHz clock for SPI cards, to allow a reasonable cable length
+#define SD_MMC_SPI_MAX_CLOCK		(25000000)	// Max 25MHz clock for SPI cards, reduced automatically if CRC errors occur because of the cable length
 
 #define SD_MMC_WP_DETECT_VALUE		false
 
@@ -81,7 +81,7 @@
 #define SD_MMC_HSMCI_MEM_CNT		0			// Number of HSMCI card slots supported
 #define SD_MMC_SPI_MEM_CNT			1			// Number of SPI card slots supported
 
-#define SD_MMC_SPI_MAX_CLOCK		(20000000)	// Max 20MHz clock for onboard SPI cards
+#define SD_MMC_SPI_MAX_CLOCK		(25000000)	// Max 25MHz clock for onboard SPI cards, reduced automatically if CRC errors occur
 
 #define SD_MMC_WP_DETECT_VALUE		false
 
@@ -93,7 +93,7 @@
 #define SD_MMC_HSMCI_SLOT_0_SIZE	4			// HSMCI bus width
 #define SD_MMC_SPI_MEM_CNT			1			// Number of SPI card slots supported
 
-#define SD_MMC_SPI_MAX_CLOCK		(4000000)	// Max 4MHz clock for SPI cards, to allow a reasonable cable length
+#define SD_MMC_SPI_MAX_CLOCK		(25000000)	// Max 25MHz clock for SPI cards, reduced automatically if CRC errors occur because of the cable length
 
 #define SD_MMC_WP_DETECT_VALUE		false
 
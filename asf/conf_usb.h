@@ -10,6 +10,12 @@
 
 #include "compiler.h"
 
+// Define USB_DATA_PORT as 1 in the build to add a second CDC port for binary data (SerialUSB1).
+// The device descriptors are then different, so USB_DATA_PORT_PRODUCT_ID must also be defined, so that hosts don't apply what they remember about the single port device.
+#ifndef USB_DATA_PORT
+# define USB_DATA_PORT					0
+#endif
+
 /**
  * USB Device Configuration
  * @{
@@ -50,6 +56,19 @@
 # define  USB_DEVICE_VENDOR_ID			0x1D50			// pid.codes VID from which PIDs are allocated to open source projects
 # define  USB_DEVICE_PRODUCT_ID			0x60EE			// PID allocated to us for Duet 3
 # define  USB_DEVICE_POWER				200				// Consumption on Vbus line (mA)
+# define  USB_DEVICE_HS_SUPPORT							// USBHS can run at 480Mbit/s
+# define  UDI_CDC_HS_PACKETS_PER_BUFFER	4				// Each CDC buffer holds this many 512-byte high speed packets
+# if USB_DATA_PORT
+#  define  UDD_BULK_NB_BANK(ep)			(((ep) == (UDI_CDC_DATA_EP_OUT_1 & USB_EP_ADDR_MASK)) ? 1 : 2)	// single bank for the data port's OUT endpoint so that both ports fit in the DPRAM
+# endif
+#endif
+
+#if USB_DATA_PORT
+# ifndef USB_DATA_PORT_PRODUCT_ID
+#  error "USB_DATA_PORT_PRODUCT_ID must be defined when USB_DATA_PORT is enabled"
+# endif
+# undef  USB_DEVICE_PRODUCT_ID
+# define  USB_DEVICE_PRODUCT_ID			USB_DATA_PORT_PRODUCT_ID
 #endif
 
 #define  USB_DEVICE_MAJOR_VERSION         1
@@ -93,18 +112,27 @@
  * @{
  */
 
-//! Define two USB communication ports
-#define  UDI_CDC_PORT_NB 1
+//! Port 0 is the console (SerialUSB). If USB_DATA_PORT is enabled, port 1 carries binary data (SerialUSB1).
+#if USB_DATA_PORT
+# define  UDI_CDC_PORT_NB 2
+#else
+# define  UDI_CDC_PORT_NB 1
+#endif
 
 //! Interface callback definition
 #define  UDI_CDC_ENABLE_EXT(port)         core_cdc_enable(port)
 #define  UDI_CDC_DISABLE_EXT(port)        core_cdc_disable(port)
 #define  UDI_CDC_RX_NOTIFY(port)          core_cdc_rx_notify(port)
+#define  UDI_CDC_RX_DATA_EXT(port,buf,n)  core_cdc_rx_data(port,buf,n)
 #define  UDI_CDC_TX_EMPTY_NOTIFY(port)    core_cdc_tx_empty_notify(port)
 #define  UDI_CDC_SET_CODING_EXT(port,cfg) core_cdc_set_coding_ext(port,cfg)
 #define  UDI_CDC_SET_DTR_EXT(port,set)    core_cdc_set_dtr(port,set)
 #define  UDI_CDC_SET_RTS_EXT(port,set)    core_cdc_set_rts(port,set)
 
+//! Number of SOF notifications to hold a partly-filled TX buffer for, so that short writes get combined into fewer packets.
+//! Can be changed at run time using udi_cdc_multi_set_tx_flush_frames().
+#define  UDI_CDC_TX_FLUSH_FRAMES          2
+
 //! Define it when the transfer CDC Device to Host is a low rate (<512000 bauds)
 //! to reduce CDC buffers size
 //#define  UDI_CDC_LOW_RATE
@@ -142,6 +170,9 @@ void core_cdc_disable(uint8_t port);
 // This is called when data has been received
 void core_cdc_rx_notify(uint8_t port);
 
+// This is called with the contents of each packet as it is received, before the application reads it
+void core_cdc_rx_data(uint8_t port, const uint8_t *buf, uint32_t n);
+
 // This is called when the transmit buffer has been emptied
 void core_cdc_tx_empty_notify(uint8_t port);
 
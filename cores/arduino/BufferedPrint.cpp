@@ -0,0 +1,64 @@
+/*
+  BufferedPrint.cpp - Print adapter that collects output and passes it on in blocks
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "BufferedPrint.h"
+
+size_t BufferedPrintBase::write(uint8_t c)
+{
+  if (_count == _capacity)
+  {
+    flush();
+  }
+  _buffer[_count++] = c;
+  return 1;
+}
+
+size_t BufferedPrintBase::write(const uint8_t *buffer, size_t size)
+{
+  if (size > _capacity - _count)
+  {
+    flush();
+    if (size >= _capacity)
+    {
+      // Too big to be worth buffering, so pass it straight on
+      const size_t written = _target.write(buffer, size);
+      if (written != size)
+      {
+        setWriteError();
+      }
+      return written;
+    }
+  }
+  memcpy(_buffer + _count, buffer, size);
+  _count += size;
+  return size;
+}
+
+void BufferedPrintBase::flush()
+{
+  if (_count != 0)
+  {
+    if (_target.write(_buffer, _count) != _count)
+    {
+      setWriteError();
+    }
+    _count = 0;
+  }
+}
+
+// End
@@ -0,0 +1,61 @@
+/*
+  BufferedPrint.h - Print adapter that collects output and passes it on in blocks
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef BufferedPrint_h
+#define BufferedPrint_h
+
+#include "Print.h"
+
+// Collects the output of many small print() calls and passes it to the target in as few write(buffer, size) calls as possible.
+// The buffer is flushed when it is full, when flush() is called and when the object is destroyed.
+// Typical use is to declare a BufferedPrint<N> on the stack around code that builds a long response from many print() calls.
+// The storage is provided by the BufferedPrint<N> template below.
+class BufferedPrintBase : public Print
+{
+public:
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;						// pull in write(str) and write(buf, size) from Print
+
+    void flush();
+    size_t pending() const { return _count; }
+
+protected:
+    BufferedPrintBase(Print& target, uint8_t *buffer, size_t capacity) : _target(target), _buffer(buffer), _capacity(capacity), _count(0) {}
+    ~BufferedPrintBase() { flush(); }
+
+private:
+    Print& _target;
+    uint8_t * const _buffer;
+    const size_t _capacity;
+    size_t _count;
+};
+
+template<size_t N> class BufferedPrint : public BufferedPrintBase
+{
+public:
+    explicit BufferedPrint(Print& target) : BufferedPrintBase(target, _storage, N) {}
+
+    // Flush here because the base class destructor runs after our storage has been destroyed
+    ~BufferedPrint() { flush(); }
+
+private:
+    uint8_t _storage[N];
+};
+
+#endif
@@ -43,6 +43,7 @@ extern "C"{
 
 void yield(void);
 void CoreSysTick(void);
+void UartRxDmaTick(void);			// defined in UARTClass.cpp
 
 typedef uint8_t Pin;
 static const Pin NoPin = 0xFF;
@@ -176,6 +177,7 @@ extern const PinDescription g_APinDescription[];
 
 #include "WCharacter.h"
 #include "HardwareSerial.h"
+#include "BufferedPrint.h"
 #include "WInterrupts.h"
 
 #endif // __cplusplus
@@ -0,0 +1,207 @@
+/*
+  NumberFormat.c - Fast conversion of numbers to text, used by Print and itoa
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "NumberFormat.h"
+#include <string.h>
+
+// Decimal conversion generates two digits at a time by dividing by 100 and looking up the remainder in this table
+static const char DigitPairs[200] =
+{
+  '0','0','0','1','0','2','0','3','0','4','0','5','0','6','0','7','0','8','0','9',
+  '1','0','1','1','1','2','1','3','1','4','1','5','1','6','1','7','1','8','1','9',
+  '2','0','2','1','2','2','2','3','2','4','2','5','2','6','2','7','2','8','2','9',
+  '3','0','3','1','3','2','3','3','3','4','3','5','3','6','3','7','3','8','3','9',
+  '4','0','4','1','4','2','4','3','4','4','4','5','4','6','4','7','4','8','4','9',
+  '5','0','5','1','5','2','5','3','5','4','5','5','5','6','5','7','5','8','5','9',
+  '6','0','6','1','6','2','6','3','6','4','6','5','6','6','6','7','6','8','6','9',
+  '7','0','7','1','7','2','7','3','7','4','7','5','7','6','7','7','7','8','7','9',
+  '8','0','8','1','8','2','8','3','8','4','8','5','8','6','8','7','8','8','8','9',
+  '9','0','9','1','9','2','9','3','9','4','9','5','9','6','9','7','9','8','9','9'
+};
+
+static const uint32_t PowersOf10[10] =
+{
+  1u, 10u, 100u, 1000u, 10000u, 100000u, 1000000u, 10000000u, 100000000u, 1000000000u
+};
+
+static size_t countDigits32( uint32_t value )
+{
+  size_t digits = 1;
+  while (digits < 10 && value >= PowersOf10[digits])
+  {
+    ++digits;
+  }
+  return digits;
+}
+
+// Write exactly 'digits' decimal digits of value, working back from the end. The value must fit.
+static void formatDigits( uint32_t value, size_t digits, char *buf )
+{
+  char *p = buf + digits;
+  while (digits >= 2)
+  {
+    const uint32_t q = divideBy100(value);
+    p -= 2;
+    memcpy(p, &DigitPairs[2 * (value - q * 100)], 2);
+    value = q;
+    digits -= 2;
+  }
+  if (digits != 0)
+  {
+    *--p = (char)('0' + value);
+  }
+}
+
+extern size_t formatUnsigned32( uint32_t value, char *buf )
+{
+  const size_t digits = countDigits32(value);
+  formatDigits(value, digits, buf);
+  return digits;
+}
+
+// Values that don't fit in 32 bits are split into groups of 9 digits, so that only the split needs 64-bit division
+extern size_t formatUnsigned64( uint64_t value, char *buf )
+{
+  if (value <= 0xFFFFFFFFu)
+  {
+    return formatUnsigned32((uint32_t)value, buf);
+  }
+
+  const uint32_t low = (uint32_t)(value % 1000000000u);
+  uint64_t high = value / 1000000000u;
+  size_t len;
+  if (high <= 0xFFFFFFFFu)
+  {
+    len = formatUnsigned32((uint32_t)high, buf);
+  }
+  else
+  {
+    len = formatUnsigned32((uint32_t)(high / 1000000000u), buf);
+    formatDigits((uint32_t)(high % 1000000000u), 9, buf + len);
+    len += 9;
+  }
+  formatDigits(low, 9, buf + len);
+  return len + 9;
+}
+
+extern size_t formatSigned32( int32_t value, char *buf )
+{
+  if (value < 0)
+  {
+    *buf = '-';
+    return 1 + formatUnsigned32(0u - (uint32_t)value, buf + 1);
+  }
+  return formatUnsigned32((uint32_t)value, buf);
+}
+
+extern size_t formatSigned64( int64_t value, char *buf )
+{
+  if (value < 0)
+  {
+    *buf = '-';
+    return 1 + formatUnsigned64(0u - (uint64_t)value, buf + 1);
+  }
+  return formatUnsigned64((uint64_t)value, buf);
+}
+
+// Radix 10 uses the decimal conversion, powers of 2 use shifts, and other bases divide
+extern size_t formatUnsignedRadix( uint64_t value, unsigned int radix, bool upperCase, char *buf )
+{
+  if (radix == 10)
+  {
+    return formatUnsigned64(value, buf);
+  }
+
+  const char letterBase = (upperCase) ? 'A' - 10 : 'a' - 10;
+  char tmp[FORMAT_MAX_RADIX_LENGTH];
+  char *tp = tmp + sizeof(tmp);
+  if ((radix & (radix - 1)) == 0)
+  {
+    const unsigned int shift = (unsigned int)__builtin_ctz(radix);
+    const unsigned int mask = radix - 1;
+    do
+    {
+      const unsigned int digit = (unsigned int)value & mask;
+      *--tp = (char)((digit < 10) ? digit + '0' : digit + letterBase);
+      value >>= shift;
+    } while (value != 0);
+  }
+  else
+  {
+    do
+    {
+      const uint64_t q = value / radix;
+      const unsigned int digit = (unsigned int)(value - q * radix);
+      *--tp = (char)((digit < 10) ? digit + '0' : digit + letterBase);
+      value = q;
+    } while (value != 0);
+  }
+
+  const size_t len = (size_t)(tmp + sizeof(tmp) - tp);
+  memcpy(buf, tp, len);
+  return len;
+}
+
+// This works entirely in single precision, because the Cortex-M4F and M7 FPUs don't do double precision
+extern size_t formatFloat( float value, unsigned int decimals, char *buf )
+{
+  if (value != value)
+  {
+    memcpy(buf, "nan", 3);
+    return 3;
+  }
+  if (value > 4294967040.0f || value < -4294967040.0f)		// the largest floats that fit in 32 bits
+  {
+    const bool isInf = (value - value) != (value - value);
+    memcpy(buf, (isInf) ? "inf" : "ovf", 3);
+    return 3;
+  }
+
+  if (decimals > FORMAT_MAX_FLOAT_DECIMALS)
+  {
+    decimals = FORMAT_MAX_FLOAT_DECIMALS;
+  }
+
+  size_t len = 0;
+  if (value < 0.0f)
+  {
+    buf[len++] = '-';
+    value = -value;
+  }
+
+  // Subtracting the integer part is exact, so the fractional part keeps all the precision that the float has
+  uint32_t intPart = (uint32_t)value;
+  const uint32_t scale = PowersOf10[decimals];
+  uint32_t fracPart = (uint32_t)((value - (float)intPart) * (float)scale + 0.5f);
+  if (fracPart >= scale)
+  {
+    fracPart -= scale;				// the fractional part rounded up to 1
+    ++intPart;
+  }
+
+  len += formatUnsigned32(intPart, buf + len);
+  if (decimals != 0)
+  {
+    buf[len++] = '.';
+    formatDigits(fracPart, decimals, buf + len);
+    len += decimals;
+  }
+  return len;
+}
+
+// End
@@ -0,0 +1,62 @@
+/*
+  NumberFormat.h - Fast conversion of numbers to text, used by Print and itoa
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _NUMBER_FORMAT_
+#define _NUMBER_FORMAT_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif // __cplusplus
+
+// The formatting functions write the characters starting at buf and return the number of characters written.
+// They don't add a null terminator. The caller must provide a buffer of at least the following size.
+#define FORMAT_MAX_UNSIGNED32_LENGTH	10
+#define FORMAT_MAX_UNSIGNED64_LENGTH	20
+#define FORMAT_MAX_RADIX_LENGTH			64		// a 64-bit value in binary
+#define FORMAT_MAX_FLOAT_DECIMALS		9		// a float only has about 7 significant digits, so more would be noise
+#define FORMAT_MAX_FLOAT_LENGTH			(1 + FORMAT_MAX_UNSIGNED32_LENGTH + 1 + FORMAT_MAX_FLOAT_DECIMALS)
+
+// Divide by 10 or 100 using a multiply by the reciprocal. These give the exact quotient for all 32-bit values.
+static inline uint32_t divideBy10(uint32_t n)
+{
+  return (uint32_t)(((uint64_t)n * 0xCCCCCCCDu) >> 35);
+}
+
+static inline uint32_t divideBy100(uint32_t n)
+{
+  return (uint32_t)(((uint64_t)n * 0x51EB851Fu) >> 37);
+}
+
+extern size_t formatUnsigned32( uint32_t value, char *buf ) ;
+extern size_t formatUnsigned64( uint64_t value, char *buf ) ;
+extern size_t formatSigned32( int32_t value, char *buf ) ;
+extern size_t formatSigned64( int64_t value, char *buf ) ;
+extern size_t formatUnsignedRadix( uint64_t value, unsigned int radix, bool upperCase, char *buf ) ;
+
+// Format a float with a fixed number of decimal places, rounding the last one. Numbers too large to fit in 32 bits give "ovf".
+extern size_t formatFloat( float value, unsigned int decimals, char *buf ) ;
+
+#ifdef __cplusplus
+} // extern "C"
+#endif // __cplusplus
+
+#endif // _NUMBER_FORMAT_
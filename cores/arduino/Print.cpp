@@ -26,6 +26,7 @@
 #include "Core.h"
 
 #include "Print.h"
+#include "NumberFormat.h"
 
 // Public Methods //////////////////////////////////////////////////////////////
 
@@ -68,27 +69,39 @@ size_t Print::print(long n, int base)
 {
   if (base == 0) {
     return write(n);
-  } else if (base == 10) {
-    if (n < 0) {
-      int t = print('-');
-      n = -n;
-      return printNumber(n, 10) + t;
-    }
-    return printNumber(n, 10);
+  } else if (base == 10 && n < 0) {
+    return printNumber(0UL - (unsigned long)n, 10, true, false);
   } else {
-    return printNumber(n, base);
+    return printNumber((unsigned long)n, base, false, false);	// don't sign-extend to 64 bits
   }
 }
 
 size_t Print::print(unsigned long n, int base)
 {
   if (base == 0) return write(n);
-  else return printNumber(n, base);
+  else return printNumber(n, base, false, false);
+}
+
+size_t Print::print(long long n, int base)
+{
+  if (base == 0) {
+    return write((uint8_t)n);
+  } else if (base == 10 && n < 0) {
+    return printNumber(0ULL - (unsigned long long)n, 10, true, false);
+  } else {
+    return printNumber(n, base, false, false);
+  }
+}
+
+size_t Print::print(unsigned long long n, int base)
+{
+  if (base == 0) return write((uint8_t)n);
+  else return printNumber(n, base, false, false);
 }
 
 size_t Print::print(double n, int digits)
 {
-  return printFloat(n, digits);
+  return printFloat(n, digits, false);
 }
 
 size_t Print::print(const Printable& x)
@@ -98,9 +111,7 @@ size_t Print::print(const Printable& x)
 
 size_t Print::println(void)
 {
-  size_t n = print('\r');
-  n += print('\n');
-  return n;
+  return write("\r\n", 2);
 }
 
 size_t Print::println(const char c[])
@@ -112,51 +123,74 @@ size_t Print::println(const char c[])
 
 size_t Print::println(char c)
 {
-  size_t n = print(c);
-  n += println();
-  return n;
+  const char buf[3] = { c, '\r', '\n' };
+  return write(buf, 3);
 }
 
 size_t Print::println(unsigned char b, int base)
 {
-  size_t n = print(b, base);
-  n += println();
-  return n;
+  return println((unsigned long) b, base);
 }
 
 size_t Print::println(int num, int base)
 {
-  size_t n = print(num, base);
-  n += println();
-  return n;
+  return println((long) num, base);
 }
 
 size_t Print::println(unsigned int num, int base)
 {
-  size_t n = print(num, base);
-  n += println();
-  return n;
+  return println((unsigned long) num, base);
 }
 
 size_t Print::println(long num, int base)
 {
-  size_t n = print(num, base);
-  n += println();
-  return n;
+  if (base == 0) {
+    size_t n = write(num);
+    n += println();
+    return n;
+  } else if (base == 10 && num < 0) {
+    return printNumber(0UL - (unsigned long)num, 10, true, true);
+  } else {
+    return printNumber((unsigned long)num, base, false, true);	// don't sign-extend to 64 bits
+  }
 }
 
 size_t Print::println(unsigned long num, int base)
 {
-  size_t n = print(num, base);
-  n += println();
-  return n;
+  if (base == 0) {
+    size_t n = write(num);
+    n += println();
+    return n;
+  }
+  return printNumber(num, base, false, true);
+}
+
+size_t Print::println(long long num, int base)
+{
+  if (base == 0) {
+    size_t n = write((uint8_t)num);
+    n += println();
+    return n;
+  } else if (base == 10 && num < 0) {
+    return printNumber(0ULL - (unsigned long long)num, 10, true, true);
+  } else {
+    return printNumber(num, base, false, true);
+  }
+}
+
+size_t Print::println(unsigned long long num, int base)
+{
+  if (base == 0) {
+    size_t n = write((uint8_t)num);
+    n += println();
+    return n;
+  }
+  return printNumber(num, base, false, true);
 }
 
 size_t Print::println(double num, int digits)
 {
-  size_t n = print(num, digits);
-  n += println();
-  return n;
+  return printFloat(num, digits, true);
 }
 
 size_t Print::println(const Printable& x)
@@ -168,68 +202,37 @@ size_t Print::println(const Printable& x)
 
 // Private Methods /////////////////////////////////////////////////////////////
 
-size_t Print::printNumber(unsigned long n, uint8_t base) {
-  char buf[8 * sizeof(long) + 1]; // Assumes 8-bit chars plus zero byte.
-  char *str = &buf[sizeof(buf) - 1];
+// Each of these functions formats its output in a local buffer, including the sign and the line ending if there is one,
+// so that the whole thing is passed on in a single call to write(buffer, size).
+
+size_t Print::printNumber(unsigned long long n, uint8_t base, bool negative, bool newline) {
+  char buf[1 + FORMAT_MAX_RADIX_LENGTH + 2]; // sign, digits, line ending
+  size_t len = 0;
 
-  *str = '\0';
+  if (negative) {
+    buf[len++] = '-';
+  }
 
   // prevent crash if called with base == 1
   if (base < 2) base = 10;
 
-  do {
-    unsigned long m = n;
-    n /= base;
-    char c = m - base * n;
-    *--str = c < 10 ? c + '0' : c + 'A' - 10;
-  } while(n);
+  len += formatUnsignedRadix(n, base, true, buf + len);
 
-  return write(str);
-}
-
-size_t Print::printFloat(double number, uint8_t digits) 
-{ 
-  size_t n = 0;
-  
-  if (std::isnan(number)) return print("nan");
-  if (std::isinf(number)) return print("inf");
-  if (number > (double)4294967040.0) return print ("ovf");  // constant determined empirically
-  if (number <-(double)4294967040.0) return print ("ovf");  // constant determined empirically
-  
-  // Handle negative numbers
-  if (number < (double)0.0)
-  {
-     n += print('-');
-     number = -number;
+  if (newline) {
+    buf[len++] = '\r';
+    buf[len++] = '\n';
   }
+  return write(buf, len);
+}
 
-  // Round correctly so that print(1.999, 2) prints as "2.00"
-  double rounding = 0.5;
-  for (uint8_t i=0; i<digits; ++i)
-  {
-    rounding /= (double)10.0;
-  }
-  
-  number += rounding;
-
-  // Extract the integer part of the number and print it
-  unsigned long int_part = (unsigned long)number;
-  double remainder = number - (double)int_part;
-  n += print(int_part);
+size_t Print::printFloat(double number, uint8_t digits, bool newline)
+{
+  char buf[FORMAT_MAX_FLOAT_LENGTH + 2]; // number, line ending
+  size_t len = formatFloat((float)number, digits, buf);
 
-  // Print the decimal point, but only if there are digits beyond
-  if (digits > 0) {
-    n += print("."); 
+  if (newline) {
+    buf[len++] = '\r';
+    buf[len++] = '\n';
   }
-
-  // Extract digits from the remainder one at a time
-  while (digits-- > 0)
-  {
-    remainder *= (double)10.0;
-    int toPrint = int(remainder);
-    n += print(toPrint);
-    remainder -= toPrint; 
-  } 
-  
-  return n;
+  return write(buf, len);
 }
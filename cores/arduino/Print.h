@@ -35,8 +35,8 @@ class Print
 {
 private:
 	int write_error;
-	size_t printNumber(unsigned long, uint8_t);
-	size_t printFloat(double, uint8_t);
+	size_t printNumber(unsigned long long, uint8_t, bool negative, bool newline);
+	size_t printFloat(double, uint8_t, bool newline);
 
 protected:
 	void setWriteError(int err = 1) { write_error = err; }
@@ -67,6 +67,8 @@ public:
     size_t print(unsigned int, int = DEC);
     size_t print(long, int = DEC);
     size_t print(unsigned long, int = DEC);
+    size_t print(long long, int = DEC);
+    size_t print(unsigned long long, int = DEC);
     size_t print(double, int = 2);
     size_t print(const Printable&);
 
@@ -77,6 +79,8 @@ public:
     size_t println(unsigned int, int = DEC);
     size_t println(long, int = DEC);
     size_t println(unsigned long, int = DEC);
+    size_t println(long long, int = DEC);
+    size_t println(unsigned long long, int = DEC);
     size_t println(double, int = 2);
     size_t println(const Printable&);
     size_t println(void);
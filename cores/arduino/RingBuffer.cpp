@@ -19,37 +19,72 @@
 #include "RingBuffer.h"
 #include <string.h>
 
-RingBuffer::RingBuffer( void )
+RingBufferBase::RingBufferBase(uint8_t *p_buffer, size_t p_size)
+  : _aucBuffer(p_buffer), _mask(p_size - 1), _iHead(0), _iTail(0)
 {
-    memset((void *)_aucBuffer, 0, SERIAL_BUFFER_SIZE) ;
-    _iHead=0 ;
-    _iTail=0 ;
+}
+
+void RingBufferBase::clear()
+{
+  _iTail.store(0, std::memory_order_relaxed);
+  _iHead.store(0, std::memory_order_release);
 }
 
 // Store a block of data. Returns the number of bytes actually stored, which may be less than the number requested.
-size_t RingBuffer::storeBlock(const uint8_t *data, size_t len)
+size_t RingBufferBase::storeBlock(const uint8_t *data, size_t len)
 {
-	const size_t room = roomLeft();
-	if (room < len)
-	{
-		len = room;
-	}
-	if (len != 0)
+	size_t stored = 0;
+	while (stored < len)
 	{
-		const size_t roomToEnd = SERIAL_BUFFER_SIZE - _iHead;
-		if (roomToEnd <= len)
+		size_t room;
+		uint8_t * const p = reserve(room);
+		if (room == 0)
 		{
-			memcpy((void*)(_aucBuffer + _iHead), data, roomToEnd);
-			memcpy((void*)_aucBuffer, data + roomToEnd, len - roomToEnd);
-			_iHead = len - roomToEnd;
+			break;
 		}
-		else
+		if (room > len - stored)
 		{
-			memcpy((void*)(_aucBuffer + _iHead), data, len);
-			_iHead += len;
+			room = len - stored;
 		}
+		memcpy(p, data + stored, room);
+		commit(room);
+		stored += room;
+	}
+	return stored;
+}
+
+// Copy up to len bytes of data without removing them from the buffer. Returns the number of bytes copied.
+// The head is read only once, so data that the producer stores while we copy is neither half-seen nor mistaken for wrapped data.
+size_t RingBufferBase::peekBlock(uint8_t *data, size_t len) const
+{
+	const size_t tail = _iTail.load(std::memory_order_relaxed);
+	size_t avail = _iHead.load(std::memory_order_acquire) - tail;
+	if (avail > len)
+	{
+		avail = len;
 	}
-	return len;
+
+	const size_t start = tail & _mask;
+	const size_t dataToEnd = size() - start;
+	if (avail <= dataToEnd)
+	{
+		memcpy(data, _aucBuffer + start, avail);
+	}
+	else
+	{
+		// The data wraps round to the start of the buffer
+		memcpy(data, _aucBuffer + start, dataToEnd);
+		memcpy(data + dataToEnd, _aucBuffer, avail - dataToEnd);
+	}
+	return avail;
+}
+
+// Copy up to len bytes of data and remove them from the buffer. Returns the number of bytes copied.
+size_t RingBufferBase::readBlock(uint8_t *data, size_t len)
+{
+	const size_t copied = peekBlock(data, len);
+	consume(copied);
+	return copied;
 }
 
 // End
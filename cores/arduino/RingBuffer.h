@@ -21,49 +21,148 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <atomic>
 
 // Define constants and variables for buffering incoming serial data.  We're
 // using a ring buffer, in which head is the index of the location
 // to which to write the next incoming character and tail is the index of the
 // location from which to read.
+// Ports that don't ask for anything else get buffers of this size.
 const size_t SERIAL_BUFFER_SIZE = 512;
 
-class RingBuffer
+// Single-producer single-consumer ring buffer. The producer (e.g. the receive ISR) only ever writes the head index,
+// and the consumer (e.g. the task calling read()) only ever writes the tail index, so no locking is needed.
+// Each side publishes its index with a release store and reads the other side's index with an acquire load,
+// so that the data accesses cannot be reordered across the index updates.
+// The head and tail indices run freely and are only masked when the buffer is accessed, so the whole buffer can be used.
+// The storage is provided by the RingBuffer<N> template below. UARTClass only needs to know about this base class.
+class RingBufferBase
 {
   public:
-    volatile uint8_t _aucBuffer[SERIAL_BUFFER_SIZE];
-    volatile size_t _iHead;
-    volatile size_t _iTail;
-
-  public:
-    RingBuffer();
+    // Functions called by the producer
     void store_char(uint8_t c);
     size_t storeBlock(const uint8_t *data, size_t len);
     size_t roomLeft() const;
+    uint8_t *reserve(size_t& len);
+    void commit(size_t len);
+
+    // Functions called by the consumer
+    size_t available() const;
+    bool isEmpty() const { return available() == 0; }
+    int peek() const;
+    int read();
+    const uint8_t *peekContiguous(size_t& len) const;
+    void consume(size_t len);
+    size_t peekBlock(uint8_t *data, size_t len) const;
+    size_t readBlock(uint8_t *data, size_t len);
+
+    // Discard all data. Only call this when neither the producer nor the consumer is active.
+    void clear();
+
+    size_t size() const { return _mask + 1; }
+    const uint8_t *bufferStart() const { return _aucBuffer; }
+
+    // Free-running positions of the next byte to be written and the next byte to be read
+    size_t producerIndex() const { return _iHead.load(std::memory_order_relaxed); }
+    size_t consumerIndex() const { return _iTail.load(std::memory_order_relaxed); }
+
+  protected:
+    RingBufferBase(uint8_t *p_buffer, size_t p_size);
+
+  private:
+    uint8_t * const _aucBuffer;
+    const size_t _mask;
+    std::atomic<size_t> _iHead;
+    std::atomic<size_t> _iTail;
 };
 
-inline void RingBuffer::store_char(uint8_t c)
+// Ring buffer with storage for N bytes. N must be a power of two.
+template<size_t N> class RingBuffer : public RingBufferBase
+{
+  public:
+    RingBuffer() : RingBufferBase(_storage, N) { }
+
+  private:
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "RingBuffer size must be a power of two");
+
+    uint8_t _storage[N];
+};
+
+inline size_t RingBufferBase::available() const
+{
+  return _iHead.load(std::memory_order_acquire) - _iTail.load(std::memory_order_relaxed);
+}
+
+inline size_t RingBufferBase::roomLeft() const
+{
+  return size() - (_iHead.load(std::memory_order_relaxed) - _iTail.load(std::memory_order_acquire));
+}
+
+inline void RingBufferBase::store_char(uint8_t c)
 {
-  size_t i = (_iHead + 1) % SERIAL_BUFFER_SIZE;
+  const size_t head = _iHead.load(std::memory_order_relaxed);
 
-  // if we should be storing the received character into the location
-  // just before the tail (meaning that the head would advance to the
-  // current location of the tail), we're about to overflow the buffer
-  // and so we don't write the character or advance the head.
-  if (i != _iTail)
+  // if the buffer is full we don't write the character or advance the head
+  if (head - _iTail.load(std::memory_order_acquire) != size())
   {
-    _aucBuffer[_iHead] = c;
-    _iHead = i;
+    _aucBuffer[head & _mask] = c;
+    _iHead.store(head + 1, std::memory_order_release);
   }
   else
   {
-	  _aucBuffer[(_iHead - 1) % SERIAL_BUFFER_SIZE] = 0x7F;		// replace the previous character by DEL to signal an overflow error
+    _aucBuffer[(head - 1) & _mask] = 0x7F;		// replace the previous character by DEL to signal an overflow error
+  }
+}
+
+inline int RingBufferBase::peek() const
+{
+  const size_t tail = _iTail.load(std::memory_order_relaxed);
+  return (_iHead.load(std::memory_order_acquire) == tail) ? -1 : _aucBuffer[tail & _mask];
+}
+
+inline int RingBufferBase::read()
+{
+  const size_t tail = _iTail.load(std::memory_order_relaxed);
+  if (_iHead.load(std::memory_order_acquire) == tail)
+  {
+    return -1;
   }
+
+  const uint8_t uc = _aucBuffer[tail & _mask];
+  _iTail.store(tail + 1, std::memory_order_release);
+  return uc;
+}
+
+// Get a pointer to the longest contiguous block of free space. On return, len is the size of that block.
+// The producer may write up to len bytes there and then call commit() to make them available to the consumer.
+inline uint8_t *RingBufferBase::reserve(size_t& len)
+{
+  const size_t head = _iHead.load(std::memory_order_relaxed);
+  const size_t room = size() - (head - _iTail.load(std::memory_order_acquire));
+  const size_t roomToEnd = size() - (head & _mask);
+  len = (room < roomToEnd) ? room : roomToEnd;
+  return _aucBuffer + (head & _mask);
+}
+
+inline void RingBufferBase::commit(size_t len)
+{
+  _iHead.store(_iHead.load(std::memory_order_relaxed) + len, std::memory_order_release);
+}
+
+// Get a pointer to the longest contiguous block of data. On return, len is the size of that block.
+// The consumer may process up to len bytes there and then call consume() to release the space to the producer.
+inline const uint8_t *RingBufferBase::peekContiguous(size_t& len) const
+{
+  const size_t tail = _iTail.load(std::memory_order_relaxed);
+  const size_t avail = _iHead.load(std::memory_order_acquire) - tail;
+  const size_t dataToEnd = size() - (tail & _mask);
+  len = (avail < dataToEnd) ? avail : dataToEnd;
+  return _aucBuffer + (tail & _mask);
 }
 
-inline size_t RingBuffer::roomLeft() const
+inline void RingBufferBase::consume(size_t len)
 {
-	return (_iTail + (SERIAL_BUFFER_SIZE - 1) - _iHead) % SERIAL_BUFFER_SIZE;
+  _iTail.store(_iTail.load(std::memory_order_relaxed) + len, std::memory_order_release);
 }
 
 #endif /* _RING_BUFFER_ */
@@ -0,0 +1,559 @@
+/*
+  SpanParser.cpp - Non-blocking parsing of numbers and strings in a block of characters
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "SpanParser.h"
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+static inline bool IsDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+// Parse an optional sign and a string of digits, accumulating the magnitude up to the limit
+static ParseResult<uint64_t> ParseMagnitude(const char *text, size_t length, uint64_t limit, bool& negative)
+{
+	ParseResult<uint64_t> result = { 0, 0, ParseError::noDigits };
+	size_t pos = 0;
+	negative = false;
+	if (pos < length && (text[pos] == '-' || text[pos] == '+'))
+	{
+		negative = (text[pos] == '-');
+		++pos;
+	}
+
+	const size_t firstDigit = pos;
+	uint64_t value = 0;
+	bool overflowed = false;
+	if (limit <= UINT32_MAX)
+	{
+		// Accumulate in 32 bits while no overflow is possible, which saves a 64-bit multiply per digit.
+		// Nine digits always fit, so only the tenth digit onwards need the general code.
+		uint32_t value32 = 0;
+		const size_t fastEnd = (length - pos < 9) ? length : pos + 9;
+		while (pos < fastEnd && IsDigit(text[pos]))
+		{
+			value32 = value32 * 10 + (unsigned int)(text[pos] - '0');
+			++pos;
+		}
+		value = value32;
+	}
+
+	// Dividing the limit once here avoids a 64-bit divide, which is a library call on the Cortex-M, for every digit
+	const uint64_t limitDiv10 = limit/10;
+	const unsigned int limitMod10 = (unsigned int)(limit - limitDiv10 * 10);
+	while (pos < length && IsDigit(text[pos]))
+	{
+		const unsigned int digit = (unsigned int)(text[pos] - '0');
+		if (overflowed || value > limitDiv10 || (value == limitDiv10 && digit > limitMod10))
+		{
+			overflowed = true;
+			value = limit;
+		}
+		else
+		{
+			value = value * 10 + digit;
+		}
+		++pos;
+	}
+
+	if (pos == firstDigit)
+	{
+		// A sign on its own at the end of the span may be followed by digits later
+		if (pos == length && pos != 0)
+		{
+			result.error = ParseError::incomplete;
+		}
+		return result;
+	}
+
+	result.value = value;
+	result.consumed = pos;
+	result.error = (overflowed) ? ParseError::overflow : (pos == length) ? ParseError::incomplete : ParseError::ok;
+	return result;
+}
+
+ParseResult<int32_t> ParseInt32(const char *text, size_t length)
+{
+	bool negative;
+	// The magnitude of a negative number can be one larger than that of a positive one
+	const ParseResult<uint64_t> r = ParseMagnitude(text, length, (uint64_t)INT32_MAX + 1, negative);
+	ParseResult<int32_t> result = { 0, r.consumed, r.error };
+	if (negative)
+	{
+		result.value = (int32_t)(0u - (uint32_t)r.value);
+	}
+	else if (r.value > (uint64_t)INT32_MAX)
+	{
+		result.value = INT32_MAX;
+		result.error = ParseError::overflow;
+	}
+	else
+	{
+		result.value = (int32_t)r.value;
+	}
+	return result;
+}
+
+ParseResult<uint32_t> ParseUint32(const char *text, size_t length)
+{
+	bool negative;
+	const ParseResult<uint64_t> r = ParseMagnitude(text, length, UINT32_MAX, negative);
+	ParseResult<uint32_t> result = { (uint32_t)r.value, r.consumed, r.error };
+	if (negative && r.value != 0)
+	{
+		result.value = 0;
+		result.error = ParseError::overflow;
+	}
+	return result;
+}
+
+ParseResult<int64_t> ParseInt64(const char *text, size_t length)
+{
+	bool negative;
+	const ParseResult<uint64_t> r = ParseMagnitude(text, length, (uint64_t)INT64_MAX + 1, negative);
+	ParseResult<int64_t> result = { 0, r.consumed, r.error };
+	if (negative)
+	{
+		result.value = (int64_t)(0u - r.value);
+	}
+	else if (r.value > (uint64_t)INT64_MAX)
+	{
+		result.value = INT64_MAX;
+		result.error = ParseError::overflow;
+	}
+	else
+	{
+		result.value = (int64_t)r.value;
+	}
+	return result;
+}
+
+// Write a number in the form [-]<mantissa>e<exponent> to a buffer, which must hold at least 36 characters.
+// If extraDigit is true then a 1 is appended to the mantissa, which stands for digits that have been dropped.
+static void FormatDecimal(char *buf, bool negative, uint64_t mantissa, bool extraDigit, int exponent)
+{
+	char digits[20];
+	size_t n = 0;
+	do
+	{
+		digits[n++] = (char)('0' + (unsigned int)(mantissa % 10));
+		mantissa /= 10;
+	} while (mantissa != 0);
+
+	if (negative)
+	{
+		*buf++ = '-';
+	}
+	while (n != 0)
+	{
+		*buf++ = digits[--n];
+	}
+	if (extraDigit)
+	{
+		*buf++ = '1';
+		--exponent;
+	}
+	*buf++ = 'e';
+	if (exponent < 0)
+	{
+		*buf++ = '-';
+		exponent = -exponent;
+	}
+	n = 0;
+	do
+	{
+		digits[n++] = (char)('0' + exponent % 10);
+		exponent /= 10;
+	} while (exponent != 0);
+	while (n != 0)
+	{
+		*buf++ = digits[--n];
+	}
+	*buf = 0;
+}
+
+// Powers of 10 that are exactly representable as floats
+static const float ExactPowersOf10[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+// An unsigned integer large enough to compare a decimal number of up to 64 digits exactly with a value halfway between two floats
+class BigUnsigned
+{
+public:
+	explicit BigUnsigned(uint32_t v) : used(1) { limbs[0] = v; }
+
+	void MultiplyAdd(uint32_t multiplier, uint32_t addend)
+	{
+		uint64_t carry = addend;
+		for (size_t i = 0; i < used; ++i)
+		{
+			carry += (uint64_t)limbs[i] * multiplier;
+			limbs[i] = (uint32_t)carry;
+			carry >>= 32;
+		}
+		if (carry != 0 && used < MaxLimbs)
+		{
+			limbs[used++] = (uint32_t)carry;
+		}
+	}
+
+	void MultiplyByPowerOf10(unsigned int n)
+	{
+		for (; n >= 9; n -= 9)
+		{
+			MultiplyAdd(1000000000u, 0);
+		}
+		for (; n != 0; --n)
+		{
+			MultiplyAdd(10, 0);
+		}
+	}
+
+	void MultiplyByPowerOf2(unsigned int n)
+	{
+		for (; n >= 31; n -= 31)
+		{
+			MultiplyAdd(1u << 31, 0);
+		}
+		MultiplyAdd(1u << n, 0);
+	}
+
+	// Return -1, 0 or 1. Neither number has leading zero limbs, because a limb is only added when there is a carry into it.
+	static int Compare(const BigUnsigned& a, const BigUnsigned& b)
+	{
+		if (a.used != b.used)
+		{
+			return (a.used < b.used) ? -1 : 1;
+		}
+		for (size_t i = a.used; i != 0; )
+		{
+			--i;
+			if (a.limbs[i] != b.limbs[i])
+			{
+				return (a.limbs[i] < b.limbs[i]) ? -1 : 1;
+			}
+		}
+		return 0;
+	}
+
+private:
+	static constexpr size_t MaxLimbs = 48;		// enough for 64 decimal digits scaled by the powers of 10 and 2 that a float midpoint needs
+
+	uint32_t limbs[MaxLimbs];
+	size_t used;
+};
+
+// Compare the magnitude of the decimal number in a null-terminated string with mantissa * 2^exponent2, returning -1, 0 or 1
+static int CompareDecimalWithBinary(const char *s, uint32_t mantissa, int exponent2)
+{
+	BigUnsigned decimal(0);
+	int exponent10 = 0;
+	bool sawPoint = false;
+	if (*s == '-' || *s == '+')
+	{
+		++s;
+	}
+	for (;; ++s)
+	{
+		if (IsDigit(*s))
+		{
+			decimal.MultiplyAdd(10, (uint32_t)(*s - '0'));
+			if (sawPoint)
+			{
+				--exponent10;
+			}
+		}
+		else if (*s == '.' && !sawPoint)
+		{
+			sawPoint = true;
+		}
+		else
+		{
+			break;
+		}
+	}
+	if (*s == 'e' || *s == 'E')
+	{
+		bool expNegative;
+		const ParseResult<uint64_t> e = ParseMagnitude(s + 1, strlen(s + 1), 9999, expNegative);
+		exponent10 += (expNegative) ? -(int)e.value : (int)e.value;
+	}
+
+	BigUnsigned binary(mantissa);
+	if (exponent10 >= 0)
+	{
+		decimal.MultiplyByPowerOf10((unsigned int)exponent10);
+	}
+	else
+	{
+		binary.MultiplyByPowerOf10((unsigned int)-exponent10);
+	}
+	if (exponent2 >= 0)
+	{
+		binary.MultiplyByPowerOf2((unsigned int)exponent2);
+	}
+	else
+	{
+		decimal.MultiplyByPowerOf2((unsigned int)-exponent2);
+	}
+	return BigUnsigned::Compare(decimal, binary);
+}
+
+// Convert a null-terminated decimal number to the nearest float. We don't use strtof because in newlib it is (float)strtod, which rounds twice.
+// That gives the wrong answer when the double is exactly halfway between two floats but the decimal number isn't, so in that case we compare them exactly.
+static float DecimalToFloat(const char *s)
+{
+	const double d = strtod(s, nullptr);
+	const double magnitude = std::fabs(d);
+	if (magnitude == 0.0 || magnitude >= 0x1p128)
+	{
+		return (float)d;
+	}
+
+	// Express the magnitude in units of the float spacing at that magnitude. It is a midpoint if the fraction is exactly one half.
+	int binaryExponent;
+	(void)std::frexp(magnitude, &binaryExponent);
+	const int ulpExponent = (binaryExponent - 24 > -149) ? binaryExponent - 24 : -149;
+	const double units = std::ldexp(magnitude, -ulpExponent);
+	const double below = std::floor(units);
+	if (units - below != 0.5)
+	{
+		return (float)d;
+	}
+
+	// Round to nearest, ties to even
+	const int comparison = CompareDecimalWithBinary(s, (uint32_t)(units * 2.0), ulpExponent - 1);
+	const double rounded = (comparison > 0 || (comparison == 0 && std::fmod(below, 2.0) != 0.0)) ? below + 1.0 : below;
+	return (float)std::copysign(std::ldexp(rounded, ulpExponent), d);
+}
+
+ParseResult<float> ParseFloat(const char *text, size_t length)
+{
+	ParseResult<float> result = { 0.0f, 0, ParseError::noDigits };
+	size_t pos = 0;
+	bool negative = false;
+	if (pos < length && (text[pos] == '-' || text[pos] == '+'))
+	{
+		negative = (text[pos] == '-');
+		++pos;
+	}
+
+	// Collect up to 19 significant digits, which always fit in 64 bits, and keep track of the decimal exponent
+	uint64_t mantissa = 0;
+	int exponent = 0;
+	unsigned int significantDigits = 0;
+	bool sawDigit = false, truncated = false, sawPoint = false;
+	while (pos < length)
+	{
+		const char c = text[pos];
+		if (IsDigit(c))
+		{
+			sawDigit = true;
+			if (significantDigits < 19)
+			{
+				mantissa = mantissa * 10 + (unsigned int)(c - '0');
+				if (mantissa != 0)
+				{
+					++significantDigits;
+				}
+				if (sawPoint)
+				{
+					--exponent;
+				}
+			}
+			else
+			{
+				truncated |= (c != '0');
+				if (!sawPoint)
+				{
+					++exponent;
+				}
+			}
+		}
+		else if (c == '.' && !sawPoint)
+		{
+			sawPoint = true;
+		}
+		else
+		{
+			break;
+		}
+		++pos;
+	}
+
+	if (!sawDigit)
+	{
+		if (pos == length && pos != 0)
+		{
+			result.error = ParseError::incomplete;
+		}
+		return result;
+	}
+
+	// Optional exponent. If 'e' isn't followed by digits then it isn't part of the number.
+	bool atEnd = (pos == length);
+	if (pos < length && (text[pos] == 'e' || text[pos] == 'E'))
+	{
+		bool expNegative;
+		const ParseResult<uint64_t> e = ParseMagnitude(text + pos + 1, length - pos - 1, 9999, expNegative);
+		if (e.consumed != 0)
+		{
+			exponent += (expNegative) ? -(int)e.value : (int)e.value;
+			pos += 1 + e.consumed;
+			atEnd = (e.error == ParseError::incomplete);
+		}
+		else
+		{
+			atEnd = (e.error == ParseError::incomplete || pos + 1 == length);		// the exponent digits may not have arrived yet
+		}
+	}
+	result.consumed = pos;
+
+	// If the mantissa and the power of 10 are both exact then a single float operation gives the correctly rounded result
+	float value;
+	bool lengthError = false;
+	if (!truncated && mantissa <= (1u << 24) && exponent >= -10 && exponent <= 10)
+	{
+		value = (exponent < 0) ? (float)mantissa / ExactPowersOf10[-exponent] : (float)mantissa * ExactPowersOf10[exponent];
+		if (negative)
+		{
+			value = -value;
+		}
+	}
+	else
+	{
+		// Convert the hard cases, which are rare in practice, from a null-terminated copy of the number
+		char buf[64];
+		if (pos < sizeof(buf))
+		{
+			memcpy(buf, text, pos);
+			buf[pos] = 0;
+		}
+		else
+		{
+			// The span is too long to copy. If there were no more than 19 significant digits then the mantissa and exponent represent it exactly,
+			// else we append a nonzero digit to stand for the ones we dropped so that the result is at least faithfully rounded.
+			FormatDecimal(buf, negative, mantissa, truncated, exponent);
+			lengthError = truncated;
+		}
+		value = DecimalToFloat(buf);
+	}
+
+	result.value = value;
+	result.error = (std::isinf(value)) ? ParseError::overflow
+					: (lengthError) ? ParseError::tooLong
+						: (atEnd) ? ParseError::incomplete
+							: ParseError::ok;
+	return result;
+}
+
+SpanSearcher::SpanSearcher(const char *p_pattern, size_t p_patternLength)
+	: pattern(p_pattern), patternLength(p_patternLength)
+{
+	// The skip for each character is the distance from its last occurrence in the pattern (excluding the final character) to the end.
+	// Skips are limited to 255 so that they fit in the table. A shorter skip is always safe, it just makes long patterns slower.
+	memset(skip, (int)((patternLength == 0) ? 1 : (patternLength > 255) ? 255 : patternLength), sizeof(skip));
+	for (size_t i = 0; i + 1 < patternLength; ++i)
+	{
+		const size_t distance = patternLength - 1 - i;
+		skip[(uint8_t)pattern[i]] = (uint8_t)((distance > 255) ? 255 : distance);
+	}
+}
+
+size_t SpanSearcher::Find(const char *text, size_t length) const
+{
+	if (patternLength == 0)
+	{
+		return 0;
+	}
+
+	const char lastChar = pattern[patternLength - 1];
+	size_t pos = 0;
+	while (pos + patternLength <= length)
+	{
+		const char c = text[pos + patternLength - 1];
+		if (c == lastChar && memcmp(text + pos, pattern, patternLength - 1) == 0)
+		{
+			return pos;
+		}
+		pos += skip[(uint8_t)c];
+	}
+	return NotFound;
+}
+
+StreamMatcher::StreamMatcher(const char *p_pattern, size_t p_patternLength)
+	: pattern(p_pattern), patternLength(p_patternLength), matched(0)
+{
+	// failure[i] is the length of the longest proper prefix of pattern[0..i] that is also a suffix of it
+	if (patternLength != 0)
+	{
+		failure[0] = 0;
+		uint8_t k = 0;
+		for (size_t i = 1; i < patternLength && i < MaxPatternLength; ++i)
+		{
+			while (k != 0 && pattern[i] != pattern[k])
+			{
+				k = failure[k - 1];
+			}
+			if (pattern[i] == pattern[k])
+			{
+				++k;
+			}
+			failure[i] = k;
+		}
+	}
+}
+
+// Return failure[i], calculating it directly if it is beyond the end of the table
+size_t StreamMatcher::Failure(size_t i) const
+{
+	if (i < MaxPatternLength)
+	{
+		return failure[i];
+	}
+	for (size_t len = i; len != 0; --len)
+	{
+		if (memcmp(pattern, pattern + i + 1 - len, len) == 0)
+		{
+			return len;
+		}
+	}
+	return 0;
+}
+
+// Feed a character that continues or starts a match
+bool StreamMatcher::Advance(char c)
+{
+	while (matched != 0 && c != pattern[matched])
+	{
+		matched = Failure(matched - 1);
+	}
+	if (c == pattern[matched])
+	{
+		++matched;
+		if (matched == patternLength)
+		{
+			matched = Failure(matched - 1);		// allow overlapping matches if we are fed more characters
+			return true;
+		}
+	}
+	return false;
+}
+
+// End
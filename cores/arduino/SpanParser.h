@@ -0,0 +1,97 @@
+/*
+  SpanParser.h - Non-blocking parsing of numbers and strings in a block of characters
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef SpanParser_h
+#define SpanParser_h
+
+#include <cstdint>
+#include <cstddef>
+
+enum class ParseError : uint8_t
+{
+	ok,
+	noDigits,				// the span doesn't start with a number
+	overflow,				// the number is too large for the result type, the value is clamped
+	incomplete,				// the number runs to the end of the span, so more characters may follow. The value so far is returned.
+	tooLong					// the float has too many significant digits to be converted exactly, the value may be 1 ulp out
+};
+
+template<class T> struct ParseResult
+{
+	T value;
+	size_t consumed;		// the number of characters that make up the number
+	ParseError error;
+};
+
+// Parse a number at the start of a span. Leading spaces are not skipped.
+// Integers are an optional sign followed by decimal digits.
+// Floats may also have a decimal point and an exponent. The result is correctly rounded unless the error is tooLong.
+ParseResult<int32_t> ParseInt32(const char *text, size_t length);
+ParseResult<uint32_t> ParseUint32(const char *text, size_t length);
+ParseResult<int64_t> ParseInt64(const char *text, size_t length);
+ParseResult<float> ParseFloat(const char *text, size_t length);
+
+// Return true if c can start a number that the above functions parse. Used to skip leading junk.
+inline bool CanStartNumber(char c, bool allowPoint)
+{
+	return (c >= '0' && c <= '9') || c == '-' || c == '+' || (allowPoint && c == '.');
+}
+
+// Search for a fixed string using the Boyer-Moore-Horspool algorithm. The skip table is built once, so reuse the object for repeated searches.
+class SpanSearcher
+{
+public:
+	static constexpr size_t NotFound = (size_t)-1;
+
+	SpanSearcher(const char *pattern, size_t patternLength);
+
+	size_t Find(const char *text, size_t length) const;		// returns the index of the first match, or NotFound
+
+private:
+	const char *pattern;
+	size_t patternLength;
+	uint8_t skip[256];
+};
+
+// Match a fixed string in a stream of characters fed one at a time, using the Knuth-Morris-Pratt algorithm.
+// Unlike a simple matcher this never needs to look at a character twice, so it handles partial matches correctly.
+// The failure table covers the first MaxPatternLength characters. Longer patterns work, but partial matches beyond that are slower.
+class StreamMatcher
+{
+public:
+	static constexpr size_t MaxPatternLength = 64;
+
+	StreamMatcher(const char *pattern, size_t patternLength);
+
+	// Returns true when the last character of the pattern has been matched.
+	// Most characters neither continue a partial match nor start a new one, so those are dealt with inline.
+	bool Feed(char c) { return (matched == 0 && (patternLength == 0 || c != pattern[0])) ? false : Advance(c); }
+	bool IsEmpty() const { return patternLength == 0; }
+	void Reset() { matched = 0; }
+
+private:
+	bool Advance(char c);
+	size_t Failure(size_t i) const;
+
+	const char *pattern;
+	size_t patternLength;
+	size_t matched;
+	uint8_t failure[MaxPatternLength];
+};
+
+#endif
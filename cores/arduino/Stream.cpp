@@ -94,34 +94,64 @@ bool  Stream::findUntil(char *target, char *terminator)
 // reads data from the stream until the target string of the given length is found
 // search terminated if the terminator string is found
 // returns true if target string is found, false if terminated or timed out
+// characters are examined in blocks and only the characters up to the end of the match are consumed
 bool Stream::findUntil(char *target, size_t targetLen, char *terminator, size_t termLen)
 {
-  size_t index = 0;  // maximum target string length is 64k bytes!
-  size_t termIndex = 0;
-  int c;
-  
-  if( *target == 0)
+  if (targetLen == 0 || *target == 0)
     return true;   // return true if target is a null string
-  while( (c = timedRead()) > 0){
-    
-    if(c != target[index])
-      index = 0; // reset index if any char does not match
-    
-    if( c == target[index]){
-      //////Serial.print("found "); Serial.write(c); Serial.print("index now"); Serial.println(index+1);
-      if(++index >= targetLen){ // return true if all chars in the target match
+  if (termLen == 0 && canPeekAhead() && targetLen <= FindBufferSize/2)
+    return findWithSearcher(target, targetLen);
+
+  StreamMatcher targetMatcher(target, targetLen);
+  StreamMatcher termMatcher(terminator, termLen);
+  uint8_t buf[ParseBufferSize];
+  while (true) {
+    const size_t n = peekAvailable(buf, sizeof(buf));
+    if (n == 0) {
+      if (timedPeek() < 0) return false;   // timed out
+      continue;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      if (targetMatcher.Feed((char)buf[i])) {
+        readAvailable(buf, i + 1);
         return true;
       }
-    }
-    
-    if(termLen > 0 && c == terminator[termIndex]){
-      if(++termIndex >= termLen)
+      if (termMatcher.Feed((char)buf[i])) {
+        readAvailable(buf, i + 1);
         return false;       // return false if terminate string found before target string
+      }
+    }
+    readAvailable(buf, n);
+  }
+}
+
+// find for streams that can peek ahead. Search each block of received characters with the skip table, then discard all but the last
+// targetLen - 1 characters, which may be the start of a match that ends in characters that haven't arrived yet.
+bool Stream::findWithSearcher(const char *target, size_t targetLen)
+{
+  const SpanSearcher searcher(target, targetLen);
+  char buf[FindBufferSize];
+  while (true) {
+    const size_t n = peekAvailable((uint8_t *)buf, sizeof(buf));
+    const size_t found = searcher.Find(buf, n);
+    if (found != SpanSearcher::NotFound) {
+      readAvailable((uint8_t *)buf, found + targetLen);
+      return true;
+    }
+    if (n >= targetLen) {
+      readAvailable((uint8_t *)buf, n - (targetLen - 1));
+      continue;
+    }
+
+    // Wait for more characters than the ones we kept
+    _startMillis = millis();
+    while (peekAvailable((uint8_t *)buf, sizeof(buf)) <= n) {
+      if (millis() - _startMillis >= _timeout) {
+        readAvailable((uint8_t *)buf, n);
+        return false;   // timed out
+      }
     }
-    else
-      termIndex = 0;
   }
-  return false;
 }
 
 
@@ -137,8 +167,8 @@ long Stream::parseInt()
 // this allows format characters (typically commas) in values to be ignored
 long Stream::parseInt(char skipChar)
 {
-  boolean isNegative = false;
-  long value = 0;
+  char buf[ParseBufferSize];
+  size_t len = 0;
 
   int c = peekNextDigit();
   // ignore non numeric leading characters
@@ -149,28 +179,16 @@ long Stream::parseInt(char skipChar)
 
   do
   {
-    if (c == skipChar)
-    {
-      // ignore this charactor
-    }
-    else if (c == '-')
-    {
-      isNegative = true;
-    }
-    else if (c >= '0' && c <= '9')        // is c a digit?
+    if (c != skipChar && len < sizeof(buf))
     {
-      value = value * 10 + c - '0';
+      buf[len++] = (char)c;
     }
     read();  // consume the character we got with peek
     c = timedPeek();
   }
   while( (c >= '0' && c <= '9') || c == skipChar );
 
-  if (isNegative)
-  {
-    value = -value;
-  }
-  return value;
+  return ParseInt32(buf, len).value;
 }
 
 
@@ -182,12 +200,11 @@ float Stream::parseFloat()
 
 // as above but the given skipChar is ignored
 // this allows format characters (typically commas) in values to be ignored
+// the characters are collected and then converted in one go, so the result is correctly rounded
 float Stream::parseFloat(char skipChar)
 {
-  boolean isNegative = false;
-  boolean isFraction = false;
-  long value = 0;
-  float fraction = 1.0;
+  char buf[ParseBufferSize];
+  size_t len = 0;
 
   int c = peekNextDigit();
     // ignore non numeric leading characters
@@ -198,43 +215,103 @@ float Stream::parseFloat(char skipChar)
 
   do
   {
-    if (c == skipChar)
-    {
-      // ignore
-    }
-    else if (c == '-')
-    {
-      isNegative = true;
-    }
-    else if (c == '.')
-    {
-      isFraction = true;
-    }
-    else if (c >= '0' && c <= '9')      // is c a digit?
+    if (c != skipChar && len < sizeof(buf))
     {
-      value = value * 10 + c - '0';
-      if (isFraction)
-      {
-         fraction *= 0.1;
-      }
+      buf[len++] = (char)c;
     }
     read();  // consume the character we got with peek
     c = timedPeek();
   }
   while( (c >= '0' && c <= '9') || c == '.' || c == skipChar );
 
-  if (isNegative)
-  {
-    value = -value;
+  return ParseFloat(buf, len).value;
+}
+
+ParseResult<int32_t> Stream::parseIntAvailable()
+{
+  return parseAvailable(ParseInt32, false);
+}
+
+ParseResult<float> Stream::parseFloatAvailable()
+{
+  return parseAvailable(ParseFloat, true);
+}
+
+template<class T> ParseResult<T> Stream::parseAvailable(ParseResult<T> (*parser)(const char *, size_t), bool allowPoint)
+{
+  char buf[ParseBufferSize];
+  while (true) {
+    const size_t n = peekAvailable((uint8_t *)buf, sizeof(buf));
+    if (n == 0) {
+      return ParseResult<T>{ 0, 0, ParseError::incomplete };
+    }
+
+    // Skip anything that can't start a number
+    size_t start = 0;
+    while (start < n && !CanStartNumber(buf[start], allowPoint)) {
+      ++start;
+    }
+    if (start == n) {
+      readAvailable((uint8_t *)buf, n);
+      continue;
+    }
+
+    ParseResult<T> result = parser(buf + start, n - start);
+    if (result.error == ParseError::noDigits) {
+      readAvailable((uint8_t *)buf, start + 1);   // a sign or point that isn't followed by a digit
+      continue;
+    }
+    if (result.error == ParseError::incomplete) {
+      if (n < sizeof(buf)) {
+        readAvailable((uint8_t *)buf, start);
+        if (!canPeekAhead()) {
+          // peekAvailable only saw the next character, so we can't tell whether the rest of the number has arrived
+          result = parseOneAtATime(parser);
+          if (result.error == ParseError::noDigits) {
+            continue;
+          }
+          return result;
+        }
+        result.consumed = 0;
+        return result;
+      }
+      if (start != 0) {
+        readAvailable((uint8_t *)buf, start);
+        continue;     // look again so that the number can use the whole buffer
+      }
+      result.error = ParseError::ok;       // the number fills the buffer, so don't wait for more
+    }
+    readAvailable((uint8_t *)buf, start + result.consumed);
+    return result;
   }
-  if (isFraction)
-  {
-    return value * fraction;
+}
+
+// Parse a number by reading it one character at a time, for streams that can't peek further ahead than the next character.
+// We can't put characters back, so the number ends at the last character received, and a sign or exponent marker
+// that turns out not to be followed by digits is discarded.
+template<class T> ParseResult<T> Stream::parseOneAtATime(ParseResult<T> (*parser)(const char *, size_t))
+{
+  char buf[ParseBufferSize];
+  size_t len = 0;
+  while (len < sizeof(buf)) {
+    const int c = peek();
+    if (c < 0) {
+      break;
+    }
+    buf[len] = (char)c;
+    const ParseResult<T> result = parser(buf, len + 1);
+    if (result.error != ParseError::incomplete) {
+      return result;        // c isn't part of the number, so leave it in the stream
+    }
+    read();
+    ++len;
   }
-  else
-  {
-    return value;
+
+  ParseResult<T> result = parser(buf, len);
+  if (result.error == ParseError::incomplete) {
+    result.error = ParseError::ok;
   }
+  return result;
 }
 
 // read characters from stream into buffer
@@ -273,3 +350,27 @@ size_t Stream::readBytesUntil(char terminator, char *buffer, size_t length)
   return index; // return number of characters, not including null terminator
 }
 
+// read up to length characters that have already been received, without waiting
+// returns the number of characters placed in the buffer
+size_t Stream::readAvailable(uint8_t *buffer, size_t length)
+{
+  size_t count = 0;
+  while (count < length)
+  {
+    const int c = read();
+    if (c < 0) break;
+    buffer[count++] = (uint8_t)c;
+  }
+  return count;
+}
+
+// as readAvailable but the characters are left in the stream
+// the default implementation can only look at the next character
+size_t Stream::peekAvailable(uint8_t *buffer, size_t length)
+{
+  if (length == 0) return 0;
+  const int c = peek();
+  if (c < 0) return 0;
+  *buffer = (uint8_t)c;
+  return 1;
+}
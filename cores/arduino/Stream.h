@@ -24,6 +24,7 @@
 
 #include <inttypes.h>
 #include "Print.h"
+#include "SpanParser.h"
 
 // compatability macros for testing
 /*
@@ -64,6 +65,7 @@ public:
 	bool find(char *target, size_t length);   // reads data from the stream until the target string of given length is found
 	bool find(uint8_t *target, size_t length) { return find ((char *)target, length); }
 	// returns true if target string is found, false if timed out
+	// on streams that can peek ahead, targets of up to 32 characters are searched for with a skip table instead of one character at a time
 
 	bool findUntil(char *target, char *terminator);   // as find but search ends if the terminator string is found
 	bool findUntil(uint8_t *target, char *terminator) { return findUntil((char *)target, terminator); }
@@ -82,17 +84,38 @@ public:
 	// terminates if length characters have been read or timeout (see setTimeout)
 	// returns the number of characters placed in the buffer (0 means no valid data found)
 
-	size_t readBytesUntil( char terminator, char *buffer, size_t length); // as readBytes with terminator character
+	virtual size_t readBytesUntil( char terminator, char *buffer, size_t length); // as readBytes with terminator character
 	size_t readBytesUntil( char terminator, uint8_t *buffer, size_t length) { return readBytesUntil(terminator, (char *)buffer, length); }
 	// terminates if length characters have been read, timeout, or if the terminator character  detected
 	// returns the number of characters placed in the buffer (0 means no valid data found)
 
+	// Bulk read functions that don't wait. The defaults work one character at a time; streams that buffer received data override them.
+	virtual size_t readAvailable(uint8_t *buffer, size_t length);	// read up to length characters that have already been received
+	virtual size_t peekAvailable(uint8_t *buffer, size_t length);	// as readAvailable but leave the characters in the stream
+	virtual bool canPeekAhead() const { return false; }				// true if peekAvailable can see more than the next character
+
+	// Non-blocking parsing of characters that have already been received, using peekAvailable so that streams with receive buffers can look ahead.
+	// Characters before the number that can't start one are discarded. If the number may continue in characters that haven't arrived yet,
+	// the error is ParseError::incomplete and the number is left in the stream, so call again later.
+	// Streams that can't peek ahead are read one character at a time, so there the number ends at the last character received.
+	ParseResult<int32_t> parseIntAvailable();
+	ParseResult<float> parseFloatAvailable();
+
 protected:
 	long parseInt(char skipChar); // as above but the given skipChar is ignored
 	// as above but the given skipChar is ignored
 	// this allows format characters (typically commas) in values to be ignored
 
 	float parseFloat(char skipChar);  // as above but the given skipChar is ignored
+
+private:
+	static constexpr size_t ParseBufferSize = 32;	// the longest number that the parsing functions handle
+	static constexpr size_t FindBufferSize = 64;	// find searches blocks of this many characters at a time on streams that can peek ahead
+
+	bool findWithSearcher(const char *target, size_t targetLen);
+
+	template<class T> ParseResult<T> parseAvailable(ParseResult<T> (*parser)(const char *, size_t), bool allowPoint);
+	template<class T> ParseResult<T> parseOneAtATime(ParseResult<T> (*parser)(const char *, size_t));
 };
 
 #endif
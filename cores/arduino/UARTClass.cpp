@@ -22,12 +22,29 @@
 #include "asf.h"
 #include "UARTClass.h"
 #include "WMath.h"
+#include "wiring.h"
+
+#if SAME70
+extern "C" void CacheFlushBeforeDMASend(const volatile void *start, size_t length);
+extern "C" void CacheFlushBeforeDMAReceive(const volatile void *start, size_t length);
+#else
+#include "sam/drivers/pdc/pdc.h"
+#endif
+
+UARTClass *UARTClass::rxDmaTickPolledList = nullptr;
 
 // Constructors ////////////////////////////////////////////////////////////////
 
-UARTClass::UARTClass(Uart *pUart, IRQn_Type dwIrq, uint32_t dwId, RingBuffer *pRx_buffer, RingBuffer *pTx_buffer)
-	: _rx_buffer(pRx_buffer), _tx_buffer(pTx_buffer), _pUart(pUart), _dwIrq(dwIrq), _dwId(dwId),
-	  numInterruptBytesMatched(0), interruptCallback(nullptr)
+UARTClass::UARTClass(Uart *pUart, IRQn_Type dwIrq, uint32_t dwId, RingBufferBase *pRx_buffer, RingBufferBase *pTx_buffer)
+	: _rx_buffer(pRx_buffer), _tx_buffer(pTx_buffer), _pUart(pUart), _dwIrq(dwIrq), _dwId(dwId), requestedBaudRate(0), actualBaudRate(0),
+	  numInterruptBytesMatched(0), interruptCallback(nullptr),
+	  txInterrupts(UART_IER_TXRDY), txDmaCount(0), txDmaEnabled(false),
+	  rxTimeoutInterrupt(0), rxDmaStored(0), rxDmaCurrentBuffer(0), rxDmaEnabled(false), rxDmaTickPolled(false), nextRxDmaTickPolled(nullptr),
+	  rxHighWater(0), rxLowWater(0), rxFlowStopped(false),
+#if !SAME70
+	  rxDmaBuffersHeld(0),
+#endif
+	  lineQueueHead(0), lineQueueTail(0), lineStart(0), linesDropped(0), lineFraming(false), lineVerifyChecksums(false)
 {
 }
 
@@ -49,10 +66,24 @@ void UARTClass::init(const uint32_t dwBaudRate, const uint32_t modeReg)
   // Configure PMC
   pmc_enable_periph_clk( _dwId );
 
-#if !SAME70
+#if SAME70
+  if (txDmaEnabled || rxDmaEnabled)
+  {
+    pmc_enable_periph_clk(ID_XDMAC);
+  }
+  if (txDmaEnabled)
+  {
+    xdmac_channel_disable(XDMAC, txDmaChannel);
+  }
+  if (rxDmaEnabled)
+  {
+    xdmac_channel_disable(XDMAC, rxDmaChannel);
+  }
+#else
   // Disable PDC channel
   _pUart->UART_PTCR = UART_PTCR_RXTDIS | UART_PTCR_TXTDIS;
 #endif
+  txDmaCount = 0;
 
   // Reset and disable receiver and transmitter
   _pUart->UART_CR = UART_CR_RSTRX | UART_CR_RSTTX | UART_CR_RXDIS | UART_CR_TXDIS;
@@ -60,29 +91,116 @@ void UARTClass::init(const uint32_t dwBaudRate, const uint32_t modeReg)
   // Configure mode
   _pUart->UART_MR = modeReg;
 
-  // Configure baudrate (asynchronous, no oversampling)
-  const uint32_t br16 = dwBaudRate * 16;
-  _pUart->UART_BRGR = (SystemPeripheralClock() + (br16/2) - 1) / br16;
+  // Configure baudrate
+  ConfigureBaudRate(dwBaudRate);
 
   // Make sure both ring buffers are initialized back to empty.
-  _rx_buffer->_iHead = _rx_buffer->_iTail = 0;
-  _tx_buffer->_iHead = _tx_buffer->_iTail = 0;
+  _rx_buffer->clear();
+  _tx_buffer->clear();
+  ResetLineFraming();
+  rxFlowStopped = false;
+#if !SAME70
+  rxDmaBuffersHeld = 0;
+#endif
 
   // Configure interrupts
   _pUart->UART_IDR = 0xFFFFFFFF;
-  _pUart->UART_IER = UART_IER_RXRDY | UART_IER_OVRE | UART_IER_FRAME;
+  if (rxDmaEnabled)
+  {
+    StartRxDma();
+    if (rxTimeoutInterrupt != 0)
+    {
+      // Flush a partly-filled DMA buffer when nothing has been received for 2 characters
+      reinterpret_cast<Usart*>(_pUart)->US_RTOR = 20;
+    }
+    else
+    {
+      // A UART has no receiver timeout, so have the tick flush a partly-filled DMA buffer instead
+      const irqflags_t flags = cpu_irq_save();
+      UARTClass *p = rxDmaTickPolledList;
+      while (p != nullptr && p != this)
+      {
+        p = p->nextRxDmaTickPolled;
+      }
+      if (p == nullptr)
+      {
+        nextRxDmaTickPolled = rxDmaTickPolledList;
+        rxDmaTickPolledList = this;
+      }
+      rxDmaTickPolled = true;
+      cpu_irq_restore(flags);
+    }
+#if SAME70
+    _pUart->UART_IER = rxTimeoutInterrupt | UART_IER_OVRE | UART_IER_FRAME;
+#else
+    _pUart->UART_IER = UART_IER_ENDRX | rxTimeoutInterrupt | UART_IER_OVRE | UART_IER_FRAME;
+#endif
+  }
+  else
+  {
+    _pUart->UART_IER = UART_IER_RXRDY | UART_IER_OVRE | UART_IER_FRAME;
+  }
 
   // Enable UART interrupt in NVIC
   NVIC_EnableIRQ(_dwIrq);
 
   // Enable receiver and transmitter
   _pUart->UART_CR = UART_CR_RXEN | UART_CR_TXEN;
+  if (rxTimeoutInterrupt != 0 && rxDmaEnabled)
+  {
+    reinterpret_cast<Usart*>(_pUart)->US_CR = US_CR_STTTO;		// the timeout starts counting when the next character is received
+  }
+#if SAME70
+  if (rxHighWater != 0)
+  {
+    reinterpret_cast<Usart*>(_pUart)->US_CR = US_CR_RTSEN;		// in case we stopped the sender before the USART was reinitialised
+  }
+#endif
+
+#if !SAME70
+  // Enable the PDC channels that we use. The transmitter stays idle until we give it something to send.
+  _pUart->UART_PTCR = ((txDmaEnabled) ? UART_PTCR_TXTEN : 0) | ((rxDmaEnabled) ? UART_PTCR_RXTEN : 0);
+#endif
+}
+
+// Set up the baud rate generator. The UART only has an integer divisor with 16x oversampling,
+// so we choose whichever of the two divisors either side of the ideal value gives the smaller error.
+void UARTClass::ConfigureBaudRate(uint32_t baudRate)
+{
+  const uint32_t clock = SystemPeripheralClock();
+  const uint32_t br16 = baudRate * 16;
+  uint32_t cd = clock / br16;
+  if (cd == 0)
+  {
+    cd = 1;
+  }
+  else if (cd < 65535)
+  {
+    // Compare the error of cd with that of cd + 1
+    const uint32_t rateLow = clock / (16 * (cd + 1));
+    const uint32_t rateHigh = clock / (16 * cd);
+    if (baudRate - rateLow < rateHigh - baudRate)
+    {
+      ++cd;
+    }
+  }
+  _pUart->UART_BRGR = cd;
+  requestedBaudRate = baudRate;
+  actualBaudRate = clock / (16 * cd);
+}
+
+int32_t UARTClass::GetBaudRateError() const
+{
+  return (requestedBaudRate == 0) ? 0
+		  : (int32_t)(((int64_t)actualBaudRate - (int64_t)requestedBaudRate) * 1000000 / (int64_t)requestedBaudRate);
 }
 
 void UARTClass::end( void )
 {
+  rxDmaTickPolled = false;					// the DMA registers can't be read once the peripheral clock is off
+
   // Clear any received data
-  _rx_buffer->_iHead = _rx_buffer->_iTail;
+  _rx_buffer->consume(_rx_buffer->available());
 
   // Wait for any outstanding data to be sent
   flush();
@@ -103,48 +221,179 @@ uint32_t UARTClass::getInterruptPriority()
   return NVIC_GetPriority(_dwIrq);
 }
 
-int UARTClass::available( void )
+#if SAME70
+
+// Get the XDMAC hardware interface number used to transmit on the specified UART or USART, or -1 if it isn't supported.
+// The receive interface number is always one more than the transmit interface number.
+static int GetXdmacTxPeripheralId(uint32_t peripheralId)
 {
-  return (SERIAL_BUFFER_SIZE + _rx_buffer->_iHead - _rx_buffer->_iTail) % SERIAL_BUFFER_SIZE;
+  switch (peripheralId)
+  {
+  case ID_UART0:	return XDMAC_CHANNEL_HWID_UART0_TX;
+  case ID_UART1:	return XDMAC_CHANNEL_HWID_UART1_TX;
+  case ID_UART2:	return XDMAC_CHANNEL_HWID_UART2_TX;
+  case ID_UART3:	return XDMAC_CHANNEL_HWID_UART3_TX;
+  case ID_UART4:	return XDMAC_CHANNEL_HWID_UART4_TX;
+  case ID_USART0:	return XDMAC_CHANNEL_HWID_USART0_TX;
+  case ID_USART1:	return XDMAC_CHANNEL_HWID_USART1_TX;
+  case ID_USART2:	return XDMAC_CHANNEL_HWID_USART2_TX;
+  default:			return -1;
+  }
 }
 
-int UARTClass::availableForWrite(void)
+bool UARTClass::EnableTxDma(uint8_t xdmacChannel)
 {
-  size_t head = _tx_buffer->_iHead;
-  size_t tail = _tx_buffer->_iTail;
-  if (head >= tail)
+  const int peripheralId = GetXdmacTxPeripheralId(_dwId);
+  if (peripheralId < 0)
   {
-	  return SERIAL_BUFFER_SIZE - 1 - head + tail;
+    return false;
   }
-  return tail - head - 1;
+
+  txDmaPeripheralId = (uint8_t)peripheralId;
+  txDmaChannel = xdmacChannel;
+  txDmaEnabled = true;
+  // The XDMAC doesn't tell the UART when it has finished, so we wait for the transmitter to become empty.
+  // This leaves a gap of one character between DMA transfers, but we only get one per contiguous block of data.
+  txInterrupts = UART_IER_TXEMPTY;
+  return true;
 }
 
-int UARTClass::peek( void )
+bool UARTClass::EnableRxDma(uint8_t xdmacChannel)
 {
-  if ( _rx_buffer->_iHead == _rx_buffer->_iTail )
+  const int peripheralId = GetXdmacTxPeripheralId(_dwId);
+  if (peripheralId < 0)
   {
-    return -1;
+    return false;
   }
 
-  return _rx_buffer->_aucBuffer[_rx_buffer->_iTail];
+  rxDmaPeripheralId = (uint8_t)(peripheralId + 1);
+  rxDmaChannel = xdmacChannel;
+  rxDmaEnabled = true;
+  return true;
+}
+
+// ProcessRxDma is also called from the UART interrupt, which may have a different priority, so we disable interrupts while it runs
+void UARTClass::RxDmaInterrupt()
+{
+  (void)xdmac_channel_get_interrupt_status(XDMAC, rxDmaChannel);		// clear the interrupt
+  const irqflags_t flags = cpu_irq_save();
+  ProcessRxDma();
+  cpu_irq_restore(flags);
+}
+
+#else
+
+bool UARTClass::EnableTxDma()
+{
+  txDmaEnabled = true;
+  txInterrupts = UART_IER_ENDTX;		// ENDTX is set when the transmit counter is zero
+  return true;
+}
+
+bool UARTClass::EnableRxDma()
+{
+  rxDmaEnabled = true;
+  return true;
+}
+
+#endif
+
+int UARTClass::available( void )
+{
+  PollRxDma();
+  return _rx_buffer->available();
+}
+
+int UARTClass::availableForWrite(void)
+{
+  return _tx_buffer->roomLeft();
+}
+
+int UARTClass::peek( void )
+{
+  PollRxDma();
+  return _rx_buffer->peek();
 }
 
 int UARTClass::read( void )
 {
-  // if the head isn't ahead of the tail, we don't have any characters
-  if ( _rx_buffer->_iHead == _rx_buffer->_iTail )
+  PollRxDma();
+  return _rx_buffer->read();
+}
+
+// Read into a buffer, waiting for more characters until the timeout expires
+size_t UARTClass::readBytes(char *buffer, size_t length)
+{
+  size_t count = 0;
+  _startMillis = millis();
+  while (count < length)
   {
-    return -1;
+    const size_t n = readAvailable(reinterpret_cast<uint8_t*>(buffer) + count, length - count);
+    if (n != 0)
+    {
+      count += n;
+      _startMillis = millis();
+    }
+    else if (millis() - _startMillis >= _timeout)
+    {
+      break;
+    }
   }
+  return count;
+}
 
-  uint8_t uc = _rx_buffer->_aucBuffer[_rx_buffer->_iTail];
-  _rx_buffer->_iTail = (_rx_buffer->_iTail + 1) % SERIAL_BUFFER_SIZE;
-  return uc;
+// As readBytes but stop when the terminator is found. The terminator is consumed but not stored.
+size_t UARTClass::readBytesUntil(char terminator, char *buffer, size_t length)
+{
+  size_t count = 0;
+  _startMillis = millis();
+  while (count < length)
+  {
+    PollRxDma();
+    size_t avail;
+    const uint8_t * const data = _rx_buffer->peekContiguous(avail);
+    if (avail != 0)
+    {
+      if (avail > length - count)
+      {
+        avail = length - count;
+      }
+      const uint8_t * const term = static_cast<const uint8_t*>(memchr(data, terminator, avail));
+      if (term != nullptr)
+      {
+        const size_t n = term - data;
+        memcpy(buffer + count, data, n);
+        _rx_buffer->consume(n + 1);
+        return count + n;
+      }
+      memcpy(buffer + count, data, avail);
+      _rx_buffer->consume(avail);
+      count += avail;
+      _startMillis = millis();
+    }
+    else if (millis() - _startMillis >= _timeout)
+    {
+      break;
+    }
+  }
+  return count;
+}
+
+size_t UARTClass::readAvailable(uint8_t *buffer, size_t length)
+{
+  PollRxDma();
+  return _rx_buffer->readBlock(buffer, length);
+}
+
+size_t UARTClass::peekAvailable(uint8_t *buffer, size_t length)
+{
+  PollRxDma();
+  return _rx_buffer->peekBlock(buffer, length);
 }
 
 void UARTClass::flush( void )
 {
-  while (_tx_buffer->_iHead != _tx_buffer->_iTail); //wait for transmit data to be sent
+  while (!_tx_buffer->isEmpty()) { } //wait for transmit data to be sent
   // Wait for transmission to complete
   while ((_pUart->UART_SR & UART_SR_TXRDY) != UART_SR_TXRDY)
    ;
@@ -152,18 +401,16 @@ void UARTClass::flush( void )
 
 size_t UARTClass::write( const uint8_t uc_data )
 {
-  // Is the hardware currently busy?
-  if ((_pUart->UART_SR & UART_SR_TXRDY) != UART_SR_TXRDY || _tx_buffer->_iTail != _tx_buffer->_iHead)
+  // Is the hardware currently busy? If we are using DMA then we always buffer the data.
+  if (txDmaEnabled || (_pUart->UART_SR & UART_SR_TXRDY) != UART_SR_TXRDY || !_tx_buffer->isEmpty())
   {
     // If busy we buffer
-    const size_t hn = (_tx_buffer->_iHead + 1) % SERIAL_BUFFER_SIZE;
-    while (_tx_buffer->_iTail == hn)
+    while (_tx_buffer->roomLeft() == 0)
       ; // Spin locks if we're about to overwrite the buffer. This continues once the data is sent
 
-    _tx_buffer->_aucBuffer[_tx_buffer->_iHead] = uc_data;
-    _tx_buffer->_iHead = hn;
+    _tx_buffer->store_char(uc_data);
     // Make sure TX interrupt is enabled
-    _pUart->UART_IER = UART_IER_TXRDY;
+    _pUart->UART_IER = txInterrupts;
   }
   else 
   {
@@ -181,7 +428,7 @@ size_t UARTClass::write(const uint8_t *buffer, size_t size)
 		size_t written = _tx_buffer->storeBlock(buffer, size);
 		buffer += written;
 		size -= written;
-	    _pUart->UART_IER = UART_IER_TXRDY;
+	    _pUart->UART_IER = txInterrupts;
 	}
 	return ret;
 }
@@ -196,10 +443,129 @@ void UARTClass::IrqHandler()
   const uint32_t status = _pUart->UART_SR;
 
   // Did we receive data?
-  if ((status & UART_SR_RXRDY) != 0)
+  if (rxDmaEnabled)
+  {
+#if SAME70
+	  if ((status & rxTimeoutInterrupt) != 0)
+#else
+	  if ((status & (UART_SR_ENDRX | rxTimeoutInterrupt)) != 0)
+#endif
+	  {
+		  const irqflags_t flags = cpu_irq_save();		// the tick and, on the SAME70, the XDMAC interrupt also call ProcessRxDma
+		  ProcessRxDma();
+		  cpu_irq_restore(flags);
+		  if ((status & rxTimeoutInterrupt) != 0)
+		  {
+			  reinterpret_cast<Usart*>(_pUart)->US_CR = US_CR_STTTO;
+		  }
+	  }
+  }
+  else if ((status & UART_SR_RXRDY) != 0)
   {
 	  const uint8_t c = _pUart->UART_RHR;
-	  if (c == interruptSeq[numInterruptBytesMatched])
+	  StoreReceivedData(&c, 1);
+  }
+
+  // Do we need to keep sending data?
+  if (txDmaEnabled)
+  {
+    if ((status & txInterrupts) != 0)
+    {
+      StartTxDma();
+    }
+  }
+  else if ((status & UART_SR_TXRDY) != 0)
+  {
+    const int c = _tx_buffer->read();
+    if (c >= 0)
+    {
+      _pUart->UART_THR = (uint8_t)c;
+    }
+    else
+    {
+      // Mask off transmit interrupt so we don't get it anymore
+      _pUart->UART_IDR = UART_IDR_TXRDY;
+    }
+  }
+
+  // Acknowledge errors
+  if ((status & (UART_SR_OVRE | UART_SR_FRAME)) != 0)
+  {
+    _pUart->UART_CR = UART_CR_RSTSTA;
+    StoreErrorMarker();
+  }
+}
+
+// Store a DEL character so that the receiving process knows there has been an error, and mark the line it is in as bad
+void UARTClass::StoreErrorMarker()
+{
+  static const uint8_t del = 0x7F;
+  const irqflags_t flags = cpu_irq_save();		// the tick and, on the SAME70, the XDMAC interrupt also store received data
+  if (rxDmaEnabled)
+  {
+    ProcessRxDma();								// so that the marker follows the characters received before the error
+  }
+  lineOverflowed = true;
+  StoreReceivedData(&del, 1);
+  cpu_irq_restore(flags);
+}
+
+// This is called from the ISR when the DMA transmitter may be idle.
+// Release the data that the previous transfer sent, then start sending the next contiguous block of data in the transmit buffer.
+void UARTClass::StartTxDma()
+{
+#if SAME70
+  if ((XDMAC->XDMAC_GS & (XDMAC_GS_ST0 << txDmaChannel)) != 0)
+  {
+    return;						// the previous transfer hasn't finished yet
+  }
+#endif
+
+  _tx_buffer->consume(txDmaCount);
+  size_t len;
+  const uint8_t * const data = _tx_buffer->peekContiguous(len);
+  txDmaCount = len;
+  if (len == 0)
+  {
+    // Mask off transmit interrupt so we don't get it anymore
+    _pUart->UART_IDR = txInterrupts;
+    return;
+  }
+
+#if SAME70
+  CacheFlushBeforeDMASend(data, len);
+
+  xdmac_channel_config_t p_cfg = {0, 0, 0, 0, 0, 0, 0, 0};
+  p_cfg.mbr_ubc = len;
+  p_cfg.mbr_sa = reinterpret_cast<uint32_t>(data);
+  p_cfg.mbr_da = reinterpret_cast<uint32_t>(&_pUart->UART_THR);
+  p_cfg.mbr_cfg = XDMAC_CC_TYPE_PER_TRAN
+				| XDMAC_CC_MBSIZE_SINGLE
+				| XDMAC_CC_DSYNC_MEM2PER
+				| XDMAC_CC_CSIZE_CHK_1
+				| XDMAC_CC_DWIDTH_BYTE
+				| XDMAC_CC_SIF_AHB_IF0
+				| XDMAC_CC_DIF_AHB_IF1
+				| XDMAC_CC_SAM_INCREMENTED_AM
+				| XDMAC_CC_DAM_FIXED_AM
+				| XDMAC_CC_PERID(txDmaPeripheralId);
+  xdmac_configure_transfer(XDMAC, txDmaChannel, &p_cfg);
+  xdmac_channel_enable(XDMAC, txDmaChannel);
+#else
+  pdc_packet_t packet;
+  packet.ul_addr = reinterpret_cast<uint32_t>(data);
+  packet.ul_size = len;
+  pdc_tx_init(GetPdc(), &packet, nullptr);
+#endif
+}
+
+// Pass received data to the receive ring buffer, looking for the interrupt sequence as we go
+void UARTClass::StoreReceivedData(const uint8_t *data, size_t len)
+{
+  const size_t firstIndex = _rx_buffer->producerIndex();
+  for (size_t i = 0; i < len; ++i)
+  {
+	  if (data[i] == interruptSeq[numInterruptBytesMatched])
 	  {
 		  ++numInterruptBytesMatched;
 		  if (numInterruptBytesMatched == ARRAY_SIZE(interruptSeq))
@@ -215,30 +581,351 @@ void UARTClass::IrqHandler()
 	  {
 		  numInterruptBytesMatched = 0;
 	  }
-	  _rx_buffer->store_char(c);
   }
 
-  // Do we need to keep sending data?
-  if ((status & UART_SR_TXRDY) != 0)
+  const size_t stored = _rx_buffer->storeBlock(data, len);
+  if (stored != len)
+  {
+	  _rx_buffer->store_char(0x7F);			// the buffer is full, so this replaces the last character by DEL to signal an overflow error
+  }
+
+#if SAME70
+  // In hardware handshaking mode the USART only drives RTS high when the receiver is disabled, so we control it directly
+  if (rxHighWater != 0 && !rxFlowStopped && _rx_buffer->available() >= rxHighWater)
   {
-    if (_tx_buffer->_iTail != _tx_buffer->_iHead)
+	  reinterpret_cast<Usart*>(_pUart)->US_CR = US_CR_RTSDIS;
+	  rxFlowStopped = true;
+  }
+#endif
+
+  if (lineFraming)
+  {
+	  if (stored != len && stored != 0)
+	  {
+		  // Frame what the buffer now holds, which is DEL in place of the last character we stored
+		  static const uint8_t del = 0x7F;
+		  FrameLines(data, stored - 1, firstIndex);
+		  FrameLines(&del, 1, firstIndex + stored - 1);
+	  }
+	  else
+	  {
+		  FrameLines(data, stored, firstIndex);
+	  }
+	  if (stored != len)
+	  {
+		  // The terminator of the current line may have been among the bytes we dropped, and if the partial line fills the buffer
+		  // we will never see one. So end the partial line here and mark it bad. The rest of the line up to the next terminator
+		  // will also be marked bad.
+		  lineOverflowed = true;
+		  const size_t lineEnd = _rx_buffer->producerIndex();
+		  if (lineEnd != lineStart && QueueLine(lineEnd, LineChecksum::bad))
+		  {
+			  lineStart = lineEnd;
+			  lineCalculatedChecksum = 0;
+			  lineInChecksum = false;
+		  }
+	  }
+  }
+}
+
+// Add a line descriptor for the characters from lineStart up to lineEnd to the line queue. Return false if the queue is full.
+bool UARTClass::QueueLine(size_t lineEnd, LineChecksum checksum)
+{
+  const size_t head = lineQueueHead.load(std::memory_order_relaxed);
+  if (head - lineQueueTail.load(std::memory_order_acquire) == LineQueueSize)
+  {
+	  ++linesDropped;
+	  return false;
+  }
+
+  LineDescriptor& ld = lineQueue[head & (LineQueueSize - 1)];
+  ld.start = lineStart;
+  ld.length = lineEnd - lineStart;
+  ld.checksum = checksum;
+  lineQueueHead.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+// Look for line terminators in data that has just been stored in the receive buffer starting at ring buffer index firstIndex
+void UARTClass::FrameLines(const uint8_t *data, size_t len, size_t firstIndex)
+{
+  for (size_t i = 0; i < len; ++i)
+  {
+	  const uint8_t c = data[i];
+	  if (c == '\n' || c == '\r')
+	  {
+		  const size_t lineEnd = firstIndex + i + 1;
+		  if (lineEnd - lineStart > 1)				// ignore empty lines, e.g. the second half of CRLF
+		  {
+			  QueueLine(lineEnd, (lineOverflowed || (lineInChecksum && lineReceivedChecksum != lineCalculatedChecksum)) ? LineChecksum::bad
+								: (lineInChecksum) ? LineChecksum::ok
+									: LineChecksum::none);
+		  }
+		  lineStart = lineEnd;
+		  lineCalculatedChecksum = 0;
+		  lineInChecksum = lineOverflowed = false;
+	  }
+	  else if (lineVerifyChecksums)
+	  {
+		  if (lineInChecksum)
+		  {
+			  if (c >= '0' && c <= '9' && lineReceivedChecksum <= 255)
+			  {
+				  lineReceivedChecksum = (lineReceivedChecksum * 10) + (c - '0');
+			  }
+		  }
+		  else if (c == '*')
+		  {
+			  lineInChecksum = true;
+			  lineReceivedChecksum = 0;
+		  }
+		  else
+		  {
+			  lineCalculatedChecksum ^= c;
+		  }
+	  }
+  }
+}
+
+void UARTClass::ResetLineFraming()
+{
+  lineQueueHead.store(0, std::memory_order_relaxed);
+  lineQueueTail.store(0, std::memory_order_relaxed);
+  lineStart = _rx_buffer->producerIndex();
+  lineCalculatedChecksum = 0;
+  lineInChecksum = lineOverflowed = false;
+}
+
+void UARTClass::SetLineFraming(bool enable, bool verifyChecksums)
+{
+  const irqflags_t flags = cpu_irq_save();
+  ResetLineFraming();
+  lineVerifyChecksums = verifyChecksums;
+  lineFraming = enable;
+  cpu_irq_restore(flags);
+}
+
+bool UARTClass::GetLine(LineSpan& line)
+{
+  PollRxDma();
+  const size_t tail = lineQueueTail.load(std::memory_order_relaxed);
+  if (lineQueueHead.load(std::memory_order_acquire) == tail)
+  {
+	  return false;
+  }
+
+  // Skip anything before the start of the line, such as empty lines
+  const LineDescriptor& ld = lineQueue[tail & (LineQueueSize - 1)];
+  const ptrdiff_t skip = (ptrdiff_t)(ld.start - _rx_buffer->consumerIndex());
+  if (skip > 0)
+  {
+	  _rx_buffer->consume(skip);
+  }
+
+  size_t len;
+  line.data[0] = _rx_buffer->peekContiguous(len);
+  if (len >= ld.length)
+  {
+	  line.length[0] = ld.length;
+	  line.data[1] = nullptr;
+	  line.length[1] = 0;
+  }
+  else
+  {
+	  line.length[0] = len;
+	  line.data[1] = _rx_buffer->bufferStart();
+	  line.length[1] = ld.length - len;
+  }
+  line.checksum = ld.checksum;
+  return true;
+}
+
+void UARTClass::ReleaseLine()
+{
+  const size_t tail = lineQueueTail.load(std::memory_order_relaxed);
+  if (lineQueueHead.load(std::memory_order_acquire) != tail)
+  {
+	  const LineDescriptor& ld = lineQueue[tail & (LineQueueSize - 1)];
+	  const ptrdiff_t used = (ptrdiff_t)(ld.start + ld.length - _rx_buffer->consumerIndex());
+	  if (used > 0)
+	  {
+		  _rx_buffer->consume(used);
+	  }
+	  lineQueueTail.store(tail + 1, std::memory_order_release);
+  }
+}
+
+// Start the DMA receiving into the pair of DMA buffers
+void UARTClass::StartRxDma()
+{
+  rxDmaCurrentBuffer = 0;
+  rxDmaStored = 0;
+
+#if SAME70
+  // Use a circular linked list of two descriptors, one per buffer
+  for (size_t i = 0; i < 2; ++i)
+  {
+    rxDmaDescriptors[i].mbr_nda = reinterpret_cast<uint32_t>(&rxDmaDescriptors[i ^ 1]);
+    rxDmaDescriptors[i].mbr_ubc = XDMAC_UBC_NVIEW_NDV0 | XDMAC_UBC_NDE_FETCH_EN | XDMAC_UBC_NDEN_UPDATED | RxDmaBufferSize;
+    rxDmaDescriptors[i].mbr_da = reinterpret_cast<uint32_t>(rxDmaBuffers[i]);
+  }
+  CacheFlushBeforeDMASend(rxDmaDescriptors, sizeof(rxDmaDescriptors));
+  CacheFlushBeforeDMAReceive(rxDmaBuffers, sizeof(rxDmaBuffers));
+
+  xdmac_channel_config_t p_cfg = {0, 0, 0, 0, 0, 0, 0, 0};
+  p_cfg.mbr_sa = reinterpret_cast<uint32_t>(&_pUart->UART_RHR);
+  p_cfg.mbr_cfg = XDMAC_CC_TYPE_PER_TRAN
+				| XDMAC_CC_MBSIZE_SINGLE
+				| XDMAC_CC_DSYNC_PER2MEM
+				| XDMAC_CC_CSIZE_CHK_1
+				| XDMAC_CC_DWIDTH_BYTE
+				| XDMAC_CC_SIF_AHB_IF1
+				| XDMAC_CC_DIF_AHB_IF0
+				| XDMAC_CC_SAM_FIXED_AM
+				| XDMAC_CC_DAM_INCREMENTED_AM
+				| XDMAC_CC_PERID(rxDmaPeripheralId);
+  xdmac_configure_transfer(XDMAC, rxDmaChannel, &p_cfg);
+  xdmac_channel_set_descriptor_addr(XDMAC, rxDmaChannel, reinterpret_cast<uint32_t>(&rxDmaDescriptors[0]), 0);
+  xdmac_channel_set_descriptor_control(XDMAC, rxDmaChannel,
+		  XDMAC_CNDC_NDVIEW_NDV0 | XDMAC_CNDC_NDE_DSCR_FETCH_EN | XDMAC_CNDC_NDSUP_SRC_PARAMS_UNCHANGED | XDMAC_CNDC_NDDUP_DST_PARAMS_UPDATED);
+  xdmac_channel_enable_interrupt(XDMAC, rxDmaChannel, XDMAC_CIE_BIE);
+  xdmac_enable_interrupt(XDMAC, rxDmaChannel);
+  xdmac_channel_enable(XDMAC, rxDmaChannel);
+#else
+  pdc_packet_t packet, nextPacket;
+  packet.ul_addr = reinterpret_cast<uint32_t>(rxDmaBuffers[0]);
+  packet.ul_size = RxDmaBufferSize;
+  nextPacket.ul_addr = reinterpret_cast<uint32_t>(rxDmaBuffers[1]);
+  nextPacket.ul_size = RxDmaBufferSize;
+  pdc_rx_init(GetPdc(), &packet, &nextPacket);
+#endif
+}
+
+// Pass any data that the DMA has received to the receive ring buffer. Must be called with interrupts disabled.
+void UARTClass::ProcessRxDma()
+{
+  // Find out where the DMA will write the next byte
+#if SAME70
+  const uint32_t dmaAddr = XDMAC->XDMAC_CHID[rxDmaChannel].XDMAC_CDA;
+#else
+  const uint32_t dmaAddr = _pUart->UART_RPR;
+#endif
+
+  // If it isn't writing to the current buffer any more then that buffer is full, so store the rest of it and switch buffers
+#if !SAME70
+  if (rxDmaBuffersHeld == 2)
+  {
+    return;					// both buffers are full and held back, so the PDC has stopped
+  }
+#endif
+
+  const uint8_t *buf = rxDmaBuffers[rxDmaCurrentBuffer];
+  size_t received = dmaAddr - reinterpret_cast<uint32_t>(buf);
+  if (received >= RxDmaBufferSize)
+  {
+#if SAME70
+    CacheFlushBeforeDMAReceive(buf, RxDmaBufferSize);		// invalidate the cache so that we see the data written by the DMA
+#endif
+    StoreReceivedData(buf + rxDmaStored, RxDmaBufferSize - rxDmaStored);
+#if !SAME70
+    if (rxHighWater != 0 && (rxFlowStopped || _rx_buffer->available() >= rxHighWater))
     {
-      _pUart->UART_THR = _tx_buffer->_aucBuffer[_tx_buffer->_iTail];
-      _tx_buffer->_iTail = (_tx_buffer->_iTail + 1) % SERIAL_BUFFER_SIZE;
+      // Hold this buffer back. When the PDC has filled the other one too it sets RXBUFF, which drives RTS high in hardware handshaking mode.
+      // ENDRX stays set until we give the PDC another buffer, so disable its interrupt meanwhile.
+      _pUart->UART_IDR = UART_IDR_ENDRX;
+      ++rxDmaBuffersHeld;
+      rxFlowStopped = true;
     }
     else
     {
-      // Mask off transmit interrupt so we don't get it anymore
-      _pUart->UART_IDR = UART_IDR_TXRDY;
+      // The PDC has moved on to the other buffer, so this one becomes the next buffer. This also clears ENDRX.
+      Pdc * const pdc = GetPdc();
+      pdc->PERIPH_RNPR = reinterpret_cast<uint32_t>(buf);
+      pdc->PERIPH_RNCR = RxDmaBufferSize;
+    }
+#endif
+    rxDmaCurrentBuffer ^= 1;
+    rxDmaStored = 0;
+    buf = rxDmaBuffers[rxDmaCurrentBuffer];
+    received = dmaAddr - reinterpret_cast<uint32_t>(buf);
+    if (received > RxDmaBufferSize)
+    {
+      received = 0;			// the DMA moved on after we read its address, so pick up the data next time
     }
   }
 
-  // Acknowledge errors
-  if ((status & (UART_SR_OVRE | UART_SR_FRAME)) != 0)
+  // Store any data in the current buffer that we haven't already stored
+  if (received > rxDmaStored)
   {
-    _pUart->UART_CR = UART_CR_RSTSTA;
-    _rx_buffer->store_char(0x7F);				// store a DEL character so that the receiving process knows there has been an error
+#if SAME70
+    CacheFlushBeforeDMAReceive(buf, RxDmaBufferSize);
+#endif
+    StoreReceivedData(buf + rxDmaStored, received - rxDmaStored);
+    rxDmaStored = received;
+  }
+}
+
+// Called by the consumer to pick up any data that the DMA has received but we haven't yet stored in the ring buffer
+void UARTClass::PollRxDma()
+{
+  if (rxDmaEnabled)
+  {
+    const irqflags_t flags = cpu_irq_save();
+    ProcessRxDma();
+    cpu_irq_restore(flags);
   }
+  if (rxFlowStopped && _rx_buffer->available() <= rxLowWater)
+  {
+    ResumeRx();
+  }
+}
+
+// Called from CoreSysTick. Pass on whatever the UARTs receiving by DMA have received, so that it doesn't wait in a partly-filled DMA buffer
+// until the consumer next polls, and so that the interrupt sequence is seen within a tick.
+void UartRxDmaTick()
+{
+  for (UARTClass *p = UARTClass::rxDmaTickPolledList; p != nullptr; p = p->nextRxDmaTickPolled)
+  {
+    if (p->rxDmaTickPolled)
+    {
+      const irqflags_t flags = cpu_irq_save();
+      p->ProcessRxDma();
+      cpu_irq_restore(flags);
+    }
+  }
+}
+
+// Let the sender resume after we stopped it because the receive buffer was nearly full
+void UARTClass::ResumeRx()
+{
+  const irqflags_t flags = cpu_irq_save();
+#if SAME70
+  reinterpret_cast<Usart*>(_pUart)->US_CR = US_CR_RTSEN;
+#else
+  ProcessRxDma();							// in case the PDC has filled the current buffer since we last looked
+
+  // Give the held buffers back to the PDC. This clears RXBUFF, which lets RTS go low again.
+  Pdc * const pdc = GetPdc();
+  if (rxDmaBuffersHeld == 2)
+  {
+    // The PDC has stopped, and the next data goes in the current buffer
+    pdc->PERIPH_RPR = reinterpret_cast<uint32_t>(rxDmaBuffers[rxDmaCurrentBuffer]);
+    pdc->PERIPH_RCR = RxDmaBufferSize;
+    pdc->PERIPH_RNPR = reinterpret_cast<uint32_t>(rxDmaBuffers[rxDmaCurrentBuffer ^ 1]);
+    pdc->PERIPH_RNCR = RxDmaBufferSize;
+    rxDmaStored = 0;
+  }
+  else if (rxDmaBuffersHeld == 1)
+  {
+    // The PDC is still filling the current buffer
+    pdc->PERIPH_RNPR = reinterpret_cast<uint32_t>(rxDmaBuffers[rxDmaCurrentBuffer ^ 1]);
+    pdc->PERIPH_RNCR = RxDmaBufferSize;
+  }
+  rxDmaBuffersHeld = 0;
+  _pUart->UART_IER = UART_IER_ENDRX;
+#endif
+  rxFlowStopped = false;
+  cpu_irq_restore(flags);
 }
 
 UARTClass::InterruptCallbackFn UARTClass::SetInterruptCallback(InterruptCallbackFn f)
@@ -28,6 +28,10 @@
 #include "component/component_usart.h"
 #endif
 
+#if SAME70
+#include "sam/drivers/xdmac/xdmac.h"		// for lld_view0
+#endif
+
 #define SERIAL_8N1 UARTClass::Mode_8N1
 #define SERIAL_8E1 UARTClass::Mode_8E1
 #define SERIAL_8O1 UARTClass::Mode_8O1
@@ -40,6 +44,16 @@ class UARTClass : public HardwareSerial
   public:
 	typedef void (*InterruptCallbackFn)(UARTClass*);
 
+	enum class LineChecksum : uint8_t { none, ok, bad };
+
+	// A received line, which may be split in two parts because the receive ring buffer wraps round
+	struct LineSpan
+	{
+		const uint8_t *data[2];
+		size_t length[2];
+		LineChecksum checksum;
+	};
+
     enum UARTModes {
       Mode_8N1 = US_MR_CHRL_8_BIT | US_MR_NBSTOP_1_BIT | UART_MR_PAR_NO,
       Mode_8E1 = US_MR_CHRL_8_BIT | US_MR_NBSTOP_1_BIT | UART_MR_PAR_EVEN,
@@ -47,7 +61,7 @@ class UARTClass : public HardwareSerial
       Mode_8M1 = US_MR_CHRL_8_BIT | US_MR_NBSTOP_1_BIT | UART_MR_PAR_MARK,
       Mode_8S1 = US_MR_CHRL_8_BIT | US_MR_NBSTOP_1_BIT | UART_MR_PAR_SPACE,
     };
-    UARTClass(Uart* pUart, IRQn_Type dwIrq, uint32_t dwId, RingBuffer* pRx_buffer, RingBuffer* pTx_buffer);
+    UARTClass(Uart* pUart, IRQn_Type dwIrq, uint32_t dwId, RingBufferBase* pRx_buffer, RingBufferBase* pTx_buffer);
 
     void begin(const uint32_t dwBaudRate);
     void begin(const uint32_t dwBaudRate, const UARTModes config);
@@ -56,6 +70,11 @@ class UARTClass : public HardwareSerial
     int availableForWrite(void);
     int peek(void);
     int read(void);
+    size_t readBytes(char *buffer, size_t length) override;
+    size_t readBytesUntil(char terminator, char *buffer, size_t length) override;
+    size_t readAvailable(uint8_t *buffer, size_t length) override;
+    size_t peekAvailable(uint8_t *buffer, size_t length) override;
+    bool canPeekAhead() const override { return true; }
     void flush(void);
     size_t write(const uint8_t c) override;
     size_t write(const uint8_t *buffer, size_t size) override;
@@ -66,6 +85,36 @@ class UARTClass : public HardwareSerial
     void setInterruptPriority(uint32_t priority);
     uint32_t getInterruptPriority();
 
+    // Get the baud rate that we actually achieved, and its error from the requested baud rate in parts per million
+    uint32_t GetActualBaudRate() const { return actualBaudRate; }
+    int32_t GetBaudRateError() const;
+
+    // Send using DMA instead of taking one interrupt per character. Call this before calling begin().
+#if SAME70
+    bool EnableTxDma(uint8_t xdmacChannel);		// use the specified XDMAC channel
+#else
+    bool EnableTxDma();							// use the PDC channel of the UART
+#endif
+
+    // Receive using DMA into a pair of small buffers instead of taking one interrupt per character. Call this before calling begin().
+    // Received data is passed to the receive ring buffer when a DMA buffer is full, when the receiver times out (USART only),
+    // on every CoreSysTick call (UART only, which has no receiver timeout), and whenever available(), peek() or read() is called.
+#if SAME70
+    bool EnableRxDma(uint8_t xdmacChannel);		// use the specified XDMAC channel
+    void RxDmaInterrupt();						// the application's XDMAC interrupt handler must call this when the receive channel interrupts
+#else
+    bool EnableRxDma();							// use the PDC channel of the UART
+#endif
+
+    // Line framing. When enabled, the receive path records where each line ends so that the caller can fetch whole lines
+    // from the receive buffer instead of reading one character at a time. Don't mix GetLine() with read() calls.
+    // If checksums are enabled, the XOR of the characters before '*' is compared with the decimal number that follows it.
+    // If the receive buffer overflows, the partial line is returned without a terminator and with checksum set to LineChecksum::bad.
+    void SetLineFraming(bool enable, bool verifyChecksums);
+    bool GetLine(LineSpan& line);				// get the oldest complete line including its terminator, returning false if there isn't one
+    void ReleaseLine();							// release the line returned by GetLine
+    uint32_t GetLinesDropped() const { return linesDropped; }
+
     void IrqHandler(void);
 
     operator bool() { return true; }; // UART always active
@@ -74,16 +123,86 @@ class UARTClass : public HardwareSerial
 
   protected:
     void init(const uint32_t dwBaudRate, const uint32_t config);
-
-    RingBuffer * const _rx_buffer;
-    RingBuffer * const _tx_buffer;
+    virtual void ConfigureBaudRate(uint32_t baudRate);
+    void StartTxDma();
+#if !SAME70
+    // The PDC registers start at the peripheral's RPR register. The Pdc struct members are already volatile, so it is safe to cast the qualifier away here.
+    Pdc *GetPdc() const { return reinterpret_cast<Pdc*>(const_cast<uint32_t*>(&_pUart->UART_RPR)); }
+#endif
+    void StartRxDma();
+    void ProcessRxDma();
+    void PollRxDma();
+    void ResumeRx();
+    void StoreReceivedData(const uint8_t *data, size_t len);
+    void StoreErrorMarker();
+    void FrameLines(const uint8_t *data, size_t len, size_t firstIndex);
+    bool QueueLine(size_t lineEnd, LineChecksum checksum);
+    void ResetLineFraming();
+
+    RingBufferBase * const _rx_buffer;
+    RingBufferBase * const _tx_buffer;
 
     Uart* const _pUart;
     const IRQn_Type _dwIrq;
     const uint32_t _dwId;
+    uint32_t requestedBaudRate;
+    uint32_t actualBaudRate;
     size_t numInterruptBytesMatched;
     InterruptCallbackFn interruptCallback;
 
+    uint32_t txInterrupts;						// the interrupt(s) we enable when there is data waiting to be sent
+    size_t txDmaCount;							// the number of bytes in the DMA transfer in progress
+    bool txDmaEnabled;
+#if SAME70
+    uint8_t txDmaChannel;
+    uint8_t txDmaPeripheralId;
+#endif
+
+    static constexpr size_t RxDmaBufferSize = 32;	// a multiple of the cache line size, so that we can invalidate the buffers safely
+
+    uint32_t rxTimeoutInterrupt;				// the receiver timeout interrupt, or zero if this is a UART and doesn't have one
+    size_t rxDmaStored;							// the number of bytes in the current DMA buffer that we have already passed to the ring buffer
+    uint8_t rxDmaCurrentBuffer;					// which DMA buffer the DMA is writing to
+    bool rxDmaEnabled;
+    volatile bool rxDmaTickPolled;				// true if this is a UART receiving by DMA, so UartRxDmaTick must pass on what it receives
+    UARTClass *nextRxDmaTickPolled;				// next in the list of UARTs that UartRxDmaTick looks at
+    static UARTClass *rxDmaTickPolledList;
+    friend void UartRxDmaTick();
+#if SAME70
+    uint8_t rxDmaChannel;
+    uint8_t rxDmaPeripheralId;
+    alignas(32) lld_view0 rxDmaDescriptors[2];
+#endif
+    alignas(32) uint8_t rxDmaBuffers[2][RxDmaBufferSize];
+
+    size_t rxHighWater;							// when the receive buffer holds this many characters we ask the sender to stop, or zero if flow control is not in use
+    size_t rxLowWater;							// when the receive buffer holds no more than this many characters we let the sender resume
+    volatile bool rxFlowStopped;				// true if we have asked the sender to stop
+#if !SAME70
+    uint8_t rxDmaBuffersHeld;					// the number of DMA receive buffers we are holding back so that the PDC sets RXBUFF
+#endif
+
+    struct LineDescriptor
+    {
+      size_t start;								// ring buffer index of the first character
+      size_t length;							// length including the terminator
+      LineChecksum checksum;
+    };
+
+    static constexpr size_t LineQueueSize = 16;	// must be a power of two
+
+    LineDescriptor lineQueue[LineQueueSize];
+    std::atomic<size_t> lineQueueHead;
+    std::atomic<size_t> lineQueueTail;
+    size_t lineStart;							// ring buffer index of the start of the line being received
+    uint32_t linesDropped;
+    uint16_t lineReceivedChecksum;
+    uint8_t lineCalculatedChecksum;
+    bool lineFraming;
+    bool lineVerifyChecksums;
+    bool lineInChecksum;
+    bool lineOverflowed;
+
     static constexpr uint8_t interruptSeq[2] = { 0xF0, 0x0F };
 };
 
@@ -22,13 +22,24 @@
 #include "asf.h"
 #include "USARTClass.h"
 
+#if SAME70
+extern "C" void CacheFlushBeforeDMASend(const volatile void *start, size_t length);
+extern "C" void CacheFlushBeforeDMAReceive(const volatile void *start, size_t length);
+#else
+#include "sam/drivers/pdc/pdc.h"
+#endif
+
 // Constructors ////////////////////////////////////////////////////////////////
 
-USARTClass::USARTClass( Usart* pUsart, IRQn_Type dwIrq, uint32_t dwId, RingBuffer* pRx_buffer, RingBuffer* pTx_buffer )
-  : UARTClass((Uart*)pUsart, dwIrq, dwId, pRx_buffer, pTx_buffer)
+USARTClass::USARTClass( Usart* pUsart, IRQn_Type dwIrq, uint32_t dwId, RingBufferBase* pRx_buffer, RingBufferBase* pTx_buffer )
+  : UARTClass((Uart*)pUsart, dwIrq, dwId, pRx_buffer, pTx_buffer),
+    halfDuplex(false), hdCurrent(nullptr), hdQueueHead(nullptr), hdQueueTail(nullptr), hdPollList(nullptr), hdPollCount(0), hdPollNext(0),
+    hdRxLength(0), hdErrors(0)
 {
   // In case anyone needs USART specific functionality in the future
   _pUsart=pUsart;
+  rxTimeoutInterrupt = US_IER_TIMEOUT;
+  usartMode = US_MR_USART_MODE_NORMAL;
 }
 
 // Public Methods //////////////////////////////////////////////////////////////
@@ -41,15 +52,392 @@ void USARTClass::begin(const uint32_t dwBaudRate)
 void USARTClass::begin(const uint32_t dwBaudRate, const UARTModes config)
 {
   uint32_t modeReg = static_cast<uint32_t>(config);
-  modeReg |= US_MR_USART_MODE_NORMAL | US_MR_USCLKS_MCK | US_MR_CHMODE_NORMAL;
+  modeReg |= usartMode | US_MR_USCLKS_MCK | US_MR_CHMODE_NORMAL;
   init(dwBaudRate, modeReg);
 }
 
 void USARTClass::begin(const uint32_t dwBaudRate, const USARTModes config)
 {
   uint32_t modeReg = static_cast<uint32_t>(config);
-  modeReg |= US_MR_USART_MODE_NORMAL | US_MR_USCLKS_MCK | US_MR_CHMODE_NORMAL;
+  modeReg |= usartMode | US_MR_USCLKS_MCK | US_MR_CHMODE_NORMAL;
   init(dwBaudRate, modeReg);
 }
 
+void USARTClass::SetFlowControl(FlowControl fc, size_t highWater, size_t lowWater)
+{
+  switch (fc)
+  {
+  case FlowControl::rtsCts:
+    {
+      usartMode = US_MR_USART_MODE_HW_HANDSHAKING;
+      const size_t bufferSize = _rx_buffer->size();
+      if (highWater == 0 || highWater >= bufferSize)
+      {
+        highWater = (bufferSize * 3)/4;
+      }
+#if !SAME70
+      // The sender may keep sending until both DMA buffers are full, so leave room for them plus a few characters
+      if (highWater + 2 * RxDmaBufferSize + 8 > bufferSize && bufferSize > 2 * RxDmaBufferSize + 8)
+      {
+        highWater = bufferSize - (2 * RxDmaBufferSize + 8);
+      }
+#endif
+      if (lowWater == 0 || lowWater >= highWater)
+      {
+        lowWater = highWater/3;
+      }
+      rxHighWater = highWater;
+      rxLowWater = lowWater;
+#if !SAME70
+      // In hardware handshaking mode the USART drives RTS from the PDC RXBUFF flag, so the receiver must use DMA
+      EnableRxDma();
+#endif
+    }
+    break;
+
+  case FlowControl::rs485:
+    usartMode = US_MR_USART_MODE_RS485;
+    rxHighWater = 0;
+    break;
+
+  case FlowControl::none:
+  default:
+    usartMode = US_MR_USART_MODE_NORMAL;
+    rxHighWater = 0;
+    break;
+  }
+}
+
+void USARTClass::IrqHandler()
+{
+  if (halfDuplex)
+  {
+    const uint32_t status = _pUsart->US_CSR & _pUsart->US_IMR;
+    if (status != 0 && hdCurrent != nullptr)
+    {
+      FinishHalfDuplexTransaction();
+    }
+  }
+  else
+  {
+    UARTClass::IrqHandler();
+  }
+}
+
+// Half-duplex transaction engine
+
+// Compute the CRC used by TMC22xx drivers, which is CRC8 with polynomial x^8 + x^2 + x + 1 applied to the bits of each byte in LSB-first order
+/*static*/ uint8_t USARTClass::TmcCrc8(const uint8_t *data, size_t len)
+{
+  uint8_t crc = 0;
+  while (len != 0)
+  {
+    uint8_t currentByte = *data++;
+    for (unsigned int i = 0; i < 8; ++i)
+    {
+      crc = (((crc >> 7) ^ currentByte) & 0x01) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+      currentByte >>= 1;
+    }
+    --len;
+  }
+  return crc;
+}
+
+void USARTClass::HalfDuplexTransaction::SetTmcRead(uint8_t driverAddress, uint8_t regNum)
+{
+  request[0] = 0x05;						// sync byte
+  request[1] = driverAddress;
+  request[2] = regNum & 0x7F;
+  requestLength = 4;						// the engine fills in the CRC
+  responseLength = 8;
+}
+
+void USARTClass::HalfDuplexTransaction::SetTmcWrite(uint8_t driverAddress, uint8_t regNum, uint32_t regVal)
+{
+  request[0] = 0x05;						// sync byte
+  request[1] = driverAddress;
+  request[2] = regNum | 0x80;
+  request[3] = (uint8_t)(regVal >> 24);
+  request[4] = (uint8_t)(regVal >> 16);
+  request[5] = (uint8_t)(regVal >> 8);
+  request[6] = (uint8_t)regVal;
+  requestLength = 8;
+  responseLength = 0;
+}
+
+uint32_t USARTClass::HalfDuplexTransaction::GetTmcRegisterValue() const
+{
+  return ((uint32_t)response[3] << 24) | ((uint32_t)response[4] << 16) | ((uint32_t)response[5] << 8) | (uint32_t)response[6];
+}
+
+// Start the engine. The transmit and receive pins must be connected together, so we receive an echo of everything we send.
+#if SAME70
+bool USARTClass::BeginHalfDuplex(uint32_t baudRate, uint8_t txXdmacChannel, uint8_t rxXdmacChannel)
+{
+  if (!EnableTxDma(txXdmacChannel) || !EnableRxDma(rxXdmacChannel))
+  {
+    return false;
+  }
+#else
+bool USARTClass::BeginHalfDuplex(uint32_t baudRate)
+{
+  (void)EnableTxDma();
+  (void)EnableRxDma();
+#endif
+
+  // We drive the DMA channels ourselves one transaction at a time, so initialise the USART as if it didn't use DMA
+  txDmaEnabled = rxDmaEnabled = false;
+  halfDuplex = true;
+  hdCurrent = hdQueueHead = hdQueueTail = nullptr;
+
+  // init() enables the character interrupts, which we don't use. Keep interrupts off until they are disabled again, else the echo of
+  // the first transaction or noise on the line could interrupt us before the ISR knows what to do with it.
+  const irqflags_t flags = cpu_irq_save();
+  init(baudRate, Mode_8N1 | US_MR_USART_MODE_NORMAL | US_MR_USCLKS_MCK | US_MR_CHMODE_NORMAL);
+  _pUsart->US_IDR = 0xFFFFFFFF;
+  NVIC_ClearPendingIRQ(_dwIrq);
+  _pUsart->US_RTOR = HalfDuplexTimeoutBits;
+
+#if SAME70
+  pmc_enable_periph_clk(ID_XDMAC);
+  xdmac_channel_disable(XDMAC, txDmaChannel);
+  xdmac_channel_disable(XDMAC, rxDmaChannel);
+#endif
+
+  StartHalfDuplexTransaction();				// in case a poll list has already been set up
+  cpu_irq_restore(flags);
+  return true;
+}
+
+void USARTClass::QueueTransaction(HalfDuplexTransaction *t)
+{
+  t->next = nullptr;
+  const irqflags_t flags = cpu_irq_save();
+  if (hdQueueTail == nullptr)
+  {
+    hdQueueHead = t;
+  }
+  else
+  {
+    hdQueueTail->next = t;
+  }
+  hdQueueTail = t;
+  if (halfDuplex && hdCurrent == nullptr)
+  {
+    StartHalfDuplexTransaction();
+  }
+  cpu_irq_restore(flags);
+}
+
+void USARTClass::SetPollList(HalfDuplexTransaction * const *list, size_t count)
+{
+  const irqflags_t flags = cpu_irq_save();
+  hdPollList = list;
+  hdPollCount = (list == nullptr) ? 0 : count;
+  hdPollNext = 0;
+  if (halfDuplex && hdCurrent == nullptr)
+  {
+    StartHalfDuplexTransaction();
+  }
+  cpu_irq_restore(flags);
+}
+
+#if SAME70
+
+void USARTClass::RxDmaInterrupt()
+{
+  if (halfDuplex)
+  {
+    (void)xdmac_channel_get_interrupt_status(XDMAC, rxDmaChannel);		// clear the interrupt
+    if (hdCurrent != nullptr)
+    {
+      FinishHalfDuplexTransaction();
+    }
+  }
+  else
+  {
+    UARTClass::RxDmaInterrupt();
+  }
+}
+
+#endif
+
+// Start the next queued transaction, or if there are none then the next one in the poll list.
+// Must be called with interrupts disabled or from the ISR.
+void USARTClass::StartHalfDuplexTransaction()
+{
+  HalfDuplexTransaction *t = hdQueueHead;
+  if (t != nullptr)
+  {
+    hdQueueHead = t->next;
+    if (hdQueueHead == nullptr)
+    {
+      hdQueueTail = nullptr;
+    }
+  }
+  else if (hdPollCount != 0)
+  {
+    t = hdPollList[hdPollNext];
+    hdPollNext = (hdPollNext + 1 == hdPollCount) ? 0 : hdPollNext + 1;
+  }
+  hdCurrent = t;
+  if (t == nullptr)
+  {
+    return;
+  }
+
+  t->request[t->requestLength - 1] = TmcCrc8(t->request, t->requestLength - 1);
+  hdRxLength = t->requestLength + t->responseLength;
+
+  // Discard anything left over from the previous transaction
+  (void)_pUsart->US_RHR;
+  _pUsart->US_CR = US_CR_RSTSTA;
+
+  // Receive the echo and the response into the first DMA receive buffer
+  uint8_t * const rxBuffer = rxDmaBuffers[0];
+#if SAME70
+  CacheFlushBeforeDMAReceive(rxBuffer, RxDmaBufferSize);
+  CacheFlushBeforeDMASend(t->request, t->requestLength);
+
+  xdmac_channel_config_t p_cfg = {0, 0, 0, 0, 0, 0, 0, 0};
+  p_cfg.mbr_ubc = hdRxLength;
+  p_cfg.mbr_sa = reinterpret_cast<uint32_t>(&_pUsart->US_RHR);
+  p_cfg.mbr_da = reinterpret_cast<uint32_t>(rxBuffer);
+  p_cfg.mbr_cfg = XDMAC_CC_TYPE_PER_TRAN
+				| XDMAC_CC_MBSIZE_SINGLE
+				| XDMAC_CC_DSYNC_PER2MEM
+				| XDMAC_CC_CSIZE_CHK_1
+				| XDMAC_CC_DWIDTH_BYTE
+				| XDMAC_CC_SIF_AHB_IF1
+				| XDMAC_CC_DIF_AHB_IF0
+				| XDMAC_CC_SAM_FIXED_AM
+				| XDMAC_CC_DAM_INCREMENTED_AM
+				| XDMAC_CC_PERID(rxDmaPeripheralId);
+  xdmac_configure_transfer(XDMAC, rxDmaChannel, &p_cfg);
+  xdmac_channel_enable_interrupt(XDMAC, rxDmaChannel, XDMAC_CIE_BIE);
+  xdmac_enable_interrupt(XDMAC, rxDmaChannel);
+  xdmac_channel_enable(XDMAC, rxDmaChannel);
+
+  p_cfg.mbr_ubc = t->requestLength;
+  p_cfg.mbr_sa = reinterpret_cast<uint32_t>(t->request);
+  p_cfg.mbr_da = reinterpret_cast<uint32_t>(&_pUsart->US_THR);
+  p_cfg.mbr_cfg = XDMAC_CC_TYPE_PER_TRAN
+				| XDMAC_CC_MBSIZE_SINGLE
+				| XDMAC_CC_DSYNC_MEM2PER
+				| XDMAC_CC_CSIZE_CHK_1
+				| XDMAC_CC_DWIDTH_BYTE
+				| XDMAC_CC_SIF_AHB_IF0
+				| XDMAC_CC_DIF_AHB_IF1
+				| XDMAC_CC_SAM_INCREMENTED_AM
+				| XDMAC_CC_DAM_FIXED_AM
+				| XDMAC_CC_PERID(txDmaPeripheralId);
+  xdmac_configure_transfer(XDMAC, txDmaChannel, &p_cfg);
+  xdmac_channel_enable(XDMAC, txDmaChannel);
+
+  _pUsart->US_CR = US_CR_STTTO;				// clear TIMEOUT from the previous transaction, otherwise the interrupt fires at once
+  _pUsart->US_CR = US_CR_RETTO;				// start the timeout now in case we don't even get the echo back
+  _pUsart->US_IER = US_IER_TIMEOUT;
+#else
+  Pdc * const pdc = GetPdc();
+  pdc_packet_t packet;
+  packet.ul_addr = reinterpret_cast<uint32_t>(rxBuffer);
+  packet.ul_size = hdRxLength;
+  pdc_rx_init(pdc, &packet, nullptr);
+  packet.ul_addr = reinterpret_cast<uint32_t>(t->request);
+  packet.ul_size = t->requestLength;
+  pdc_tx_init(pdc, &packet, nullptr);
+
+  _pUsart->US_CR = US_CR_STTTO;				// clear TIMEOUT from the previous transaction, otherwise the interrupt fires at once
+  _pUsart->US_CR = US_CR_RETTO;				// start the timeout now in case we don't even get the echo back
+  _pUsart->US_PTCR = US_PTCR_RXTEN | US_PTCR_TXTEN;
+  _pUsart->US_IER = US_IER_ENDRX | US_IER_TIMEOUT;
+#endif
+}
+
+// Finish the current transaction because either we have received everything or the receiver timed out. Then start the next one.
+// Must be called with interrupts disabled or from the ISR.
+void USARTClass::FinishHalfDuplexTransaction()
+{
+  _pUsart->US_IDR = 0xFFFFFFFF;
+
+  // Find out how many bytes we received
+  const uint8_t * const rxBuffer = rxDmaBuffers[0];
+#if SAME70
+  xdmac_channel_disable(XDMAC, txDmaChannel);
+  xdmac_channel_disable(XDMAC, rxDmaChannel);
+  const size_t received = hdRxLength - (XDMAC->XDMAC_CHID[rxDmaChannel].XDMAC_CUBC & XDMAC_CUBC_UBLEN_Msk);
+  CacheFlushBeforeDMAReceive(rxBuffer, RxDmaBufferSize);
+#else
+  _pUsart->US_PTCR = US_PTCR_RXTDIS | US_PTCR_TXTDIS;
+  const size_t received = hdRxLength - _pUsart->US_RCR;
+#endif
+
+  // The echo must match what we sent, otherwise there was a collision on the bus. The response must have a valid CRC.
+  HalfDuplexTransaction * const t = hdCurrent;
+  bool ok = received == hdRxLength && memcmp(rxBuffer, t->request, t->requestLength) == 0;
+  if (ok && t->responseLength != 0)
+  {
+    const uint8_t * const response = rxBuffer + t->requestLength;
+    ok = TmcCrc8(response, t->responseLength - 1) == response[t->responseLength - 1];
+    if (ok)
+    {
+      memcpy(t->response, response, t->responseLength);
+    }
+  }
+  if (!ok)
+  {
+    ++hdErrors;
+  }
+
+  if (t->callback != nullptr)
+  {
+    t->callback(t, ok);						// hdCurrent is still set, so if the callback queues another transaction it won't be started yet
+  }
+  StartHalfDuplexTransaction();
+}
+
+// Protected Methods ///////////////////////////////////////////////////////////
+
+// Set up the baud rate generator using the fractional divisor, which gives the divisor in units of 1/8.
+// We use 16x oversampling unless 8x oversampling gives a more accurate baud rate, which only happens at high baud rates.
+void USARTClass::ConfigureBaudRate(uint32_t baudRate)
+{
+  const uint64_t clock8 = (uint64_t)SystemPeripheralClock() * 8;
+  uint32_t bestDivisor = 0, bestOversampling = 0, bestRate = 0, bestError = 0xFFFFFFFF;
+  for (uint32_t oversampling = 16; oversampling >= 8; oversampling /= 2)
+  {
+    const uint64_t denominator = (uint64_t)baudRate * oversampling;
+    uint32_t divisor = (uint32_t)((clock8 + denominator/2) / denominator);
+    if (divisor < 8)
+    {
+      divisor = 8;								// CD must be at least 1
+    }
+    else if (divisor > 0x7FFFF)
+    {
+      divisor = 0x7FFFF;						// CD is only 16 bits
+    }
+    const uint32_t rate = (uint32_t)(clock8 / ((uint64_t)divisor * oversampling));
+    const uint32_t error = (rate > baudRate) ? rate - baudRate : baudRate - rate;
+    if (error < bestError)
+    {
+      bestDivisor = divisor;
+      bestOversampling = oversampling;
+      bestRate = rate;
+      bestError = error;
+    }
+  }
+
+  if (bestOversampling == 8)
+  {
+    _pUsart->US_MR |= US_MR_OVER;
+  }
+  else
+  {
+    _pUsart->US_MR &= ~US_MR_OVER;
+  }
+  _pUsart->US_BRGR = US_BRGR_CD(bestDivisor >> 3) | US_BRGR_FP(bestDivisor & 7);
+  requestedBaudRate = baudRate;
+  actualBaudRate = bestRate;
+}
+
 // End
@@ -102,14 +102,77 @@ class USARTClass : public UARTClass
       Mode_8S2 = US_MR_CHRL_8_BIT | US_MR_PAR_SPACE | US_MR_NBSTOP_2_BIT,
     };
 
-    USARTClass(Usart* pUsart, IRQn_Type dwIrq, uint32_t dwId, RingBuffer* pRx_buffer, RingBuffer* pTx_buffer);
+    enum class FlowControl : uint8_t
+    {
+      none,				// plain asynchronous mode
+      rtsCts,			// hardware handshaking: RTS is deasserted when the receive buffer is nearly full, and we only transmit when CTS is asserted
+      rs485				// RTS drives the transceiver direction pin, high while we are transmitting
+    };
+
+    // A write request and optional read response on a single-wire half-duplex bus, such as the UART interface of TMC22xx stepper drivers.
+    // The engine fills in the CRC in the last byte of the request, discards the echo of the request and checks the CRC of the response.
+    struct HalfDuplexTransaction
+    {
+      typedef void (*CompletionFn)(HalfDuplexTransaction *t, bool ok);
+
+      static constexpr size_t MaxDatagramLength = 8;
+
+      uint8_t request[MaxDatagramLength];
+      uint8_t response[MaxDatagramLength];
+      uint8_t requestLength;
+      uint8_t responseLength;				// zero if the request is a write that gets no response
+      CompletionFn callback;				// called from the ISR when the transaction has completed or failed, may be nullptr
+      void *param;							// for use by the callback
+      HalfDuplexTransaction *next;			// used by the transaction queue
+
+      void SetTmcRead(uint8_t driverAddress, uint8_t regNum);
+      void SetTmcWrite(uint8_t driverAddress, uint8_t regNum, uint32_t regVal);
+      uint32_t GetTmcRegisterValue() const;
+    };
+
+    USARTClass(Usart* pUsart, IRQn_Type dwIrq, uint32_t dwId, RingBufferBase* pRx_buffer, RingBufferBase* pTx_buffer);
+
+    // Select the flow control mode. Call this before begin(). The water marks are receive buffer occupancy levels; zero means use the default.
+    void SetFlowControl(FlowControl fc, size_t highWater = 0, size_t lowWater = 0);
 
     void begin(const uint32_t dwBaudRate);
     void begin(const uint32_t dwBaudRate, const USARTModes config);
     void begin(const uint32_t dwBaudRate, const UARTModes config);
 
+    // Half-duplex transaction engine. Once this has been started the ring buffers are not used, so don't call read() or write().
+#if SAME70
+    bool BeginHalfDuplex(uint32_t baudRate, uint8_t txXdmacChannel, uint8_t rxXdmacChannel);
+    void RxDmaInterrupt();						// the application's XDMAC interrupt handler must call this when the receive channel interrupts
+#else
+    bool BeginHalfDuplex(uint32_t baudRate);
+#endif
+    void QueueTransaction(HalfDuplexTransaction *t);
+    void SetPollList(HalfDuplexTransaction * const *list, size_t count);		// transactions to cycle through when the queue is empty
+    uint32_t GetHalfDuplexErrors() const { return hdErrors; }
+
+    void IrqHandler();
+
+    static uint8_t TmcCrc8(const uint8_t *data, size_t len);
+
   protected:
+    void ConfigureBaudRate(uint32_t baudRate) override;
+    void StartHalfDuplexTransaction();
+    void FinishHalfDuplexTransaction();
+
+    static constexpr uint32_t HalfDuplexTimeoutBits = 160;	// longer than the maximum TMC22xx reply delay of 15 * 8 bit times
+
     Usart* _pUsart;
+    uint32_t usartMode;
+
+    bool halfDuplex;
+    HalfDuplexTransaction *hdCurrent;			// the transaction in progress, or nullptr if the bus is idle
+    HalfDuplexTransaction *hdQueueHead;
+    HalfDuplexTransaction *hdQueueTail;
+    HalfDuplexTransaction * const *hdPollList;
+    size_t hdPollCount;
+    size_t hdPollNext;
+    size_t hdRxLength;							// the number of bytes we expect to receive, including the echo
+    uint32_t hdErrors;
 };
 
 #endif // _USART_CLASS_
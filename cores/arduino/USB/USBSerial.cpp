@@ -15,8 +15,11 @@ void core_vbus_off(CallbackParameter);
 
 // SerialCDC members
 
-SerialCDC::SerialCDC() : /* _cdc_tx_buffer(), */ txBufsize(1), isConnected(false), vBusPin(NoPin)
+SerialCDC::SerialCDC(uint8_t p_port) : /* _cdc_tx_buffer(), */ txBufsize(1), droppedRecords(0), port(p_port), isConnected(false), rxDiscardPending(false), rxDraining(false), vBusPin(NoPin), rxDiscardEnd(0),
+	interruptCallback(nullptr), interruptMatcher(nullptr, 0)
 {
+	static const uint8_t defaultInterruptSeq[] = { 0xF0, 0x0F };
+	(void)SetInterruptSequence(defaultInterruptSeq, ARRAY_SIZE(defaultInterruptSeq));
 }
 
 void SerialCDC::Start(Pin p_vBusPin)
@@ -39,34 +42,111 @@ void SerialCDC::end()
 
 int SerialCDC::available()
 {
-	return (isConnected) ? udi_cdc_get_nb_received_data() : 0;
+	PollRx();
+	return rxBuffer.available();
 }
 
 int SerialCDC::peek()
 {
-	return -1;				// not supported
+	PollRx();
+	return rxBuffer.peek();
 }
 
 int SerialCDC::read()
 {
-	return (udi_cdc_is_rx_ready()) ? udi_cdc_getc() : -1;
+	PollRx();
+	return rxBuffer.read();
 }
 
+// Read whatever has already been received, up to length bytes. We don't wait for more data to arrive.
 size_t SerialCDC::readBytes(char *buffer, size_t length)
 {
-	return (udi_cdc_is_rx_ready()) ? udi_cdc_read_buf(buffer, length) : 0;
+	return readAvailable(reinterpret_cast<uint8_t*>(buffer), length);
+}
+
+// Read whatever has already been received, up to length bytes
+size_t SerialCDC::readAvailable(uint8_t *buffer, size_t length)
+{
+	PollRx();
+	const size_t count = rxBuffer.readBlock(buffer, length);
+	PollRx();					// we have made room, so take any data that the CDC layer is still holding
+	return count;
+}
+
+size_t SerialCDC::peekAvailable(uint8_t *buffer, size_t length)
+{
+	PollRx();
+	return rxBuffer.peekBlock(buffer, length);
+}
+
+// Copy as much received data as will fit from the CDC receive buffers into our ring buffer.
+// Each call to udi_cdc_read_no_polling only reads from one of the two CDC buffers and gives it back to the USB endpoint when it is empty,
+// so we keep going until either there is no more data or our buffer is full.
+// Called from the USB ISR, or with interrupts disabled.
+void SerialCDC::DrainRx()
+{
+	// When udi_cdc_read_no_polling gives a buffer back to the endpoint and the other buffer already holds data, it notifies us again.
+	// We haven't committed the data we just copied yet, so a nested call would overwrite it. The loop below fetches the other buffer anyway.
+	if (rxDraining)
+	{
+		return;
+	}
+	rxDraining = true;
+	while (true)
+	{
+		size_t room;
+		uint8_t * const dst = rxBuffer.reserve(room);
+		if (room == 0)
+		{
+			break;				// our buffer is full, so the CDC layer keeps the rest and the host waits
+		}
+		const size_t n = udi_cdc_multi_read_no_polling(port, dst, room);
+		if (n == 0)
+		{
+			break;
+		}
+		rxBuffer.commit(n);
+	}
+	rxDraining = false;
+}
+
+// Discard any data left over from a previous connection. If the CDC layer is holding data because our buffer was full when it arrived, fetch it now.
+void SerialCDC::PollRx()
+{
+	if (rxDiscardPending)
+	{
+		// Only the consumer may move the ring buffer tail, so we do this here rather than in the ISR that reported the connection
+		const irqflags_t flags = cpu_irq_save();
+		const ptrdiff_t skip = (ptrdiff_t)(rxDiscardEnd - rxBuffer.consumerIndex());
+		if (skip > 0)
+		{
+			rxBuffer.consume(skip);
+		}
+		rxDiscardPending = false;
+		cpu_irq_restore(flags);
+	}
+
+	if (isConnected && udi_cdc_multi_is_rx_ready(port))
+	{
+		const irqflags_t flags = cpu_irq_save();
+		DrainRx();
+		cpu_irq_restore(flags);
+	}
 }
 
 void SerialCDC::flush(void)
 {
-	while (isConnected && udi_cdc_get_free_tx_buffer() < txBufsize) {}
+	while (isConnected && udi_cdc_multi_get_free_tx_buffer(port) < txBufsize) {}
 }
 
+// Non-blocking write of a single character. Like udi_cdc_write_buf this adds to the current packet, unlike udi_cdc_putc it doesn't wait for space.
+// Returns 0 if there was no room for it. If we are not connected, pretend that it has been written.
 size_t SerialCDC::write(uint8_t c)
 {
 	if (isConnected)
 	{
-		udi_cdc_putc(c);
+		const size_t remaining = udi_cdc_multi_write_buf(port, &c, 1);
+		return 1 - remaining;
 	}
 	return 1;
 }
@@ -76,7 +156,7 @@ size_t SerialCDC::write(const uint8_t *buffer, size_t size)
 {
 	if (isConnected && size != 0)
 	{
-		const size_t remaining = udi_cdc_write_buf(buffer, size);
+		const size_t remaining = udi_cdc_multi_write_buf(port, buffer, size);
 		return size - remaining;
 	}
 	return size;
@@ -84,7 +164,7 @@ size_t SerialCDC::write(const uint8_t *buffer, size_t size)
 
 size_t SerialCDC::canWrite() const
 {
-	return (isConnected) ? udi_cdc_get_free_tx_buffer() : 0;
+	return (isConnected) ? udi_cdc_multi_get_free_tx_buffer(port) : 0;
 }
 
 bool SerialCDC::IsConnected() const
@@ -92,14 +172,108 @@ bool SerialCDC::IsConnected() const
 	return isConnected;
 }
 
+void SerialCDC::SetTxFlushFrames(uint8_t frames)
+{
+	udi_cdc_multi_set_tx_flush_frames(port, frames);
+}
+
+void SerialCDC::GetTxStats(TxStats& stats, bool clear)
+{
+	udi_cdc_tx_stats_t cdcStats;
+	udi_cdc_multi_get_tx_stats(port, &cdcStats, clear);
+	stats.packets = cdcStats.nb_packets;
+	stats.bytes = cdcStats.nb_bytes;
+	stats.shortPackets = cdcStats.nb_short_packets;
+	stats.framesHeld = cdcStats.nb_frames_held;
+	stats.maxFramesHeld = cdcStats.max_frames_held;
+}
+
+// Write one record of binary data if there is room for all of it
+bool SerialCDC::WriteRecord(const void *record, size_t length)
+{
+	if (isConnected && udi_cdc_multi_write_record(port, record, length))
+	{
+		return true;
+	}
+	++droppedRecords;
+	return false;
+}
+
+// Write as many whole records as there is room for. The ones that don't fit are counted as dropped.
+size_t SerialCDC::WriteRecords(const void *records, size_t recordLength, size_t count)
+{
+	const uint8_t *p = static_cast<const uint8_t*>(records);
+	size_t written = 0;
+	if (isConnected)
+	{
+		while (written < count && udi_cdc_multi_write_record(port, p, recordLength))
+		{
+			p += recordLength;
+			++written;
+		}
+	}
+	droppedRecords += count - written;
+	return written;
+}
+
+uint32_t SerialCDC::GetDroppedRecords(bool clear)
+{
+	const uint32_t ret = droppedRecords;
+	if (clear)
+	{
+		droppedRecords = 0;
+	}
+	return ret;
+}
+
+SerialCDC::InterruptCallbackFn SerialCDC::SetInterruptCallback(InterruptCallbackFn f)
+{
+	const irqflags_t flags = cpu_irq_save();
+	const InterruptCallbackFn ret = interruptCallback;
+	interruptCallback = f;
+	cpu_irq_restore(flags);
+	return ret;
+}
+
+bool SerialCDC::SetInterruptSequence(const uint8_t *seq, size_t length)
+{
+	if (length == 0 || length > MaxInterruptSeqLength)
+	{
+		return false;
+	}
+	const irqflags_t flags = cpu_irq_save();		// the USB ISR uses the matcher
+	memcpy(interruptSeq, seq, length);
+	interruptMatcher = StreamMatcher(reinterpret_cast<const char*>(interruptSeq), length);
+	cpu_irq_restore(flags);
+	return true;
+}
+
 void SerialCDC::cdcSetConnected(bool b)
 {
+	if (b && !isConnected)
+	{
+		rxDiscardEnd = rxBuffer.producerIndex();		// discard anything left over from a previous connection next time the consumer polls
+		rxDiscardPending = true;
+		interruptMatcher.Reset();
+	}
 	isConnected = b;
 }
 
 void SerialCDC::cdcRxNotify()
 {
-	// nothing here until we use a Rx buffer
+	DrainRx();
+}
+
+// Scan a received packet for the interrupt sequence. The matcher keeps its state between packets, so a sequence split across two packets is found too.
+void SerialCDC::cdcRxData(const uint8_t *buf, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		if (interruptMatcher.Feed((char)buf[i]) && interruptCallback != nullptr)
+		{
+			interruptCallback(this);
+		}
+	}
 }
 
 void SerialCDC::cdcTxEmptyNotify()
@@ -107,44 +281,65 @@ void SerialCDC::cdcTxEmptyNotify()
 	// If we haven't yet found out how large the transmit buffer is, find out now
 	if (txBufsize == 1)
 	{
-		txBufsize = udi_cdc_get_free_tx_buffer();
+		txBufsize = udi_cdc_multi_get_free_tx_buffer(port);
 	}
 }
 
-// Declare the Serial USB device
-SerialCDC SerialUSB;
+// Declare the Serial USB devices
+SerialCDC SerialUSB(0);
+#if USB_DATA_PORT
+SerialCDC SerialUSB1(1);
+#endif
+
+static SerialCDC * const cdcPorts[] =
+{
+	&SerialUSB,
+#if USB_DATA_PORT
+	&SerialUSB1,
+#endif
+};
+static_assert(ARRAY_SIZE(cdcPorts) == UDI_CDC_PORT_NB, "Number of SerialCDC devices doesn't match UDI_CDC_PORT_NB");
 
 // Callback glue functions, all called from the USB ISR
 
 // This is called when we are plugged in and connect to a host
 extern "C" bool core_cdc_enable(uint8_t port)
 {
-	SerialUSB.cdcSetConnected(true);
+	cdcPorts[port]->cdcSetConnected(true);
 	return true;
 }
 
 // This is called when we get disconnected from the host
 extern "C" void core_cdc_disable(uint8_t port)
 {
-	SerialUSB.cdcSetConnected(false);
+	cdcPorts[port]->cdcSetConnected(false);
 }
 
 // This is called when data has been received
 extern "C" void core_cdc_rx_notify(uint8_t port)
 {
-	SerialUSB.cdcRxNotify();
+	cdcPorts[port]->cdcRxNotify();
+}
+
+// This is called with each received packet as soon as it arrives
+extern "C" void core_cdc_rx_data(uint8_t port, const uint8_t *buf, uint32_t n)
+{
+	cdcPorts[port]->cdcRxData(buf, n);
 }
 
 // This is called when the transmit buffer has been emptied
 extern "C" void core_cdc_tx_empty_notify(uint8_t port)
 {
-	SerialUSB.cdcTxEmptyNotify();
+	cdcPorts[port]->cdcTxEmptyNotify();
 }
 
 // On the SAM4E and SAM4S we use a GPIO pin available to monitor the VBUS state
 void core_vbus_off(CallbackParameter)
 {
-	SerialUSB.cdcSetConnected(false);
+	for (SerialCDC *p : cdcPorts)
+	{
+		p->cdcSetConnected(false);
+	}
 }
 
 // End
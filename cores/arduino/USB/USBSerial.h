@@ -10,26 +10,49 @@
 
 #include "Core.h"
 #include "Stream.h"
+#include "RingBuffer.h"
+#include "SpanParser.h"
 
 // Serial over CDC
 
 class SerialCDC : public Stream
 {
+public:
+	typedef void (*InterruptCallbackFn)(SerialCDC*);
+
 private:
+	static constexpr size_t RxBufferSize = 512;		// must be a power of two
+	static constexpr size_t MaxInterruptSeqLength = 8;
+
+	void DrainRx();
+	void PollRx();
+
 	size_t txBufsize;
+	uint32_t droppedRecords;
+	uint8_t port;								// the CDC port number
 	bool isConnected;
+	volatile bool rxDiscardPending;				// set by the USB ISR on connection, the consumer then discards data up to rxDiscardEnd
+	bool rxDraining;							// true while DrainRx is running, so that it isn't re-entered from the CDC layer
 	Pin vBusPin;
+	size_t rxDiscardEnd;						// ring buffer index of the end of the data left over from the previous connection
+	RingBuffer<RxBufferSize> rxBuffer;			// filled from the CDC receive buffers by the USB ISR so that the OUT endpoint can be re-armed immediately
+	InterruptCallbackFn interruptCallback;
+	uint8_t interruptSeq[MaxInterruptSeqLength];
+	StreamMatcher interruptMatcher;				// matches interruptSeq across packet boundaries
 
 public:
-	SerialCDC();
+	SerialCDC(uint8_t p_port);
 
-	void Start(Pin p_vBusPin);
+	void Start(Pin p_vBusPin);					// starts the USB device for all ports, so call this on SerialUSB only
 	void end(void);
 
 	int available() override;
 	int peek() override;
 	int read() override;
 	size_t readBytes(char *buffer, size_t length) override;
+	size_t readAvailable(uint8_t *buffer, size_t length) override;
+	size_t peekAvailable(uint8_t *buffer, size_t length) override;
+	bool canPeekAhead() const override { return true; }
 	void flush() override;
 	size_t write(uint8_t) override;
 	size_t write(const uint8_t *buffer, size_t size) override;
@@ -40,12 +63,40 @@ public:
 	size_t canWrite() const override;	// Function added by DC42 so that we can tell how many characters we can write without blocking (for Duet)
 	bool IsConnected() const;
 
+	// Transmit packet coalescing. Full packets are sent immediately, partly-filled ones after the given number of USB frames.
+	struct TxStats
+	{
+		uint32_t packets;				// the number of USB transfers, including zero length packets
+		uint32_t bytes;
+		uint32_t shortPackets;			// transfers smaller than a full packet
+		uint32_t framesHeld;			// the total number of frames that short packets waited for
+		uint16_t maxFramesHeld;
+	};
+
+	void SetTxFlushFrames(uint8_t frames);
+	void GetTxStats(TxStats& stats, bool clear);
+
+	// Binary record output for a data channel. A record is sent whole or not at all, so the host never receives part of one.
+	// Records are dropped rather than waited for when the host isn't reading fast enough.
+	bool WriteRecord(const void *record, size_t length);
+	size_t WriteRecords(const void *records, size_t recordLength, size_t count);	// returns the number of records written
+	uint32_t GetDroppedRecords(bool clear);
+
+	// Emergency stop detection. Each received packet is scanned in the USB ISR and the callback is called from there when the sequence is seen.
+	// The sequence is still passed on to the receive buffer. The default sequence is the same as for UARTClass.
+	InterruptCallbackFn SetInterruptCallback(InterruptCallbackFn f);
+	bool SetInterruptSequence(const uint8_t *seq, size_t length);		// returns false if the sequence is empty or too long
+
 	// Callback functions called from the cdc layer - not for general use
 	void cdcSetConnected(bool b);
 	void cdcRxNotify();
+	void cdcRxData(const uint8_t *buf, size_t n);
 	void cdcTxEmptyNotify();
 };
 
-extern SerialCDC SerialUSB;
+extern SerialCDC SerialUSB;				// the console
+#if USB_DATA_PORT
+extern SerialCDC SerialUSB1;				// the binary data channel, if enabled in conf_usb.h
+#endif
 
 #endif /* USBSERIAL_H_ */
@@ -17,6 +17,7 @@
 */
 
 #include "itoa.h"
+#include "NumberFormat.h"
 #include <string.h>
 
 #ifdef __cplusplus
@@ -73,12 +74,7 @@ extern char* itoa( int value, char *string, int radix )
 
 extern char* ltoa( long value, char *string, int radix )
 {
-  char tmp[33];
-  char *tp = tmp;
-  long i;
-  unsigned long v;
-  int sign;
-  char *sp;
+  size_t len;
 
   if ( string == NULL )
   {
@@ -90,33 +86,15 @@ extern char* ltoa( long value, char *string, int radix )
     return 0 ;
   }
 
-  sign = (radix == 10 && value < 0);
-  if (sign)
+  if (radix == 10)
   {
-    v = -value;
+    len = formatSigned64( value, string ) ;
   }
   else
   {
-    v = (unsigned long)value;
+    len = formatUnsignedRadix( (unsigned long)value, radix, false, string ) ;
   }
-
-  while (v || tp == tmp)
-  {
-    i = v % radix;
-    v = v / radix;
-    if (i < 10)
-      *tp++ = i+'0';
-    else
-      *tp++ = i + 'a' - 10;
-  }
-
-  sp = string;
-
-  if (sign)
-    *sp++ = '-';
-  while (tp > tmp)
-    *sp++ = *--tp;
-  *sp = 0;
+  string[len] = 0;
 
   return string;
 }
@@ -128,12 +106,6 @@ extern char* utoa( unsigned int value, char *string, int radix )
 
 extern char* ultoa( unsigned long value, char *string, int radix )
 {
-  char tmp[33];
-  char *tp = tmp;
-  long i;
-  unsigned long v = value;
-  char *sp;
-
   if ( string == NULL )
   {
     return 0;
@@ -143,23 +115,8 @@ extern char* ultoa( unsigned long value, char *string, int radix )
   {
     return 0;
   }
- 
-  while (v || tp == tmp)
-  {
-    i = v % radix;
-    v = v / radix;
-    if (i < 10)
-      *tp++ = i+'0';
-    else
-      *tp++ = i + 'a' - 10;
-  }
-
-  sp = string;
 
- 
-  while (tp > tmp)
-    *sp++ = *--tp;
-  *sp = 0;
+  string[formatUnsignedRadix( value, radix, false, string )] = 0;
 
   return string;
 }
@@ -29,6 +29,7 @@ void CoreSysTick( void )
 	const irqflags_t flags = cpu_irq_save();	// save and disable interrupts, because under RTOS the systick interrupt is low priority
 	g_ms_ticks++;
 	cpu_irq_restore(flags);
+	UartRxDmaTick();
 }
 
 uint32_t millis( void )
@@ -7,176 +7,39 @@
  *
  * This module provides access to the SPI bus used to access peripheral devices in RepRapFirmware, in particular thermocouple and RTD readers.
  * Depending on the board, we may use either the main SPI channel or one of the USARTs in SPI mode.
+ * The functions here operate on the default bus. Further buses can be created using the SharedSpiBus class.
  *
  */
 
 #include "Core.h"
-#include "SharedSpi.h"
+#include "SharedSpiBus.h"
 #include "variant.h"
 
-#if SAM4E
+#if SAM4E || SAM4S || (SAME70 && !defined(SAME70XPLD))
 
-#define USART_SPI		1
-
-# include "usart/usart.h"		// On Duet NG the general SPI channel is on USART 0
-
-#  define USART_SSPI	USART0
-#  define ID_SSPI		ID_USART0
-
-#elif SAM4S
-
-#define USART_SPI		1
-
-# include "usart/usart.h"		// On Duet Maestro the general SPI channel is on USART 0
-
-#  define USART_SSPI	USART0
-#  define ID_SSPI		ID_USART0
-
-#elif SAME70 && !defined(SAME70XPLD)
-
-#define USART_SPI		1
-
-# include "usart/usart.h"		// On Duet 3 the general SPI channel is on USART 0
-
-#  define USART_SSPI	USART0
-#  define ID_SSPI		ID_USART0
+// On Duet NG, Duet Maestro and Duet 3 the general SPI channel is on USART 0
+SharedSpiBus SharedSpi(USART0, ID_USART0, APIN_USART_SSPI_SCK, APIN_USART_SSPI_MOSI, APIN_USART_SSPI_MISO);
 
 #else
 
-#define USART_SPI		0
-
-// We have to tell the processor which NPCS output we are using, even though we use other pins for CS
-#if SAME70
-// We choose NPCS2 because on the SAME70, it is not physically connected
-# define PERIPHERAL_CHANNEL_ID		2
-# define PERIPHERAL_CHANNEL_CS_PIN	APIN_SPI_SS2
-#elif SAM3XA
-// We choose NPCS3 because on the SAM3X, it is not physically connected
-# define PERIPHERAL_CHANNEL_ID		3
-# define PERIPHERAL_CHANNEL_CS_PIN	APIN_SPI_SS3
-#endif
-
-/** Time-out value (number of attempts). */
-#define SPI_TIMEOUT       15000
+SharedSpiBus SharedSpi(SHARED_SPI, SHARED_SPI_INTERFACE_ID, APIN_SHARED_SPI_SCK, APIN_SHARED_SPI_MOSI, APIN_SHARED_SPI_MISO);
 
 #endif
 
-// Wait for transmitter ready returning true if timed out
-static inline bool waitForTxReady()
-{
-	uint32_t timeout = SPI_TIMEOUT;
-#if USART_SPI
-	while (!usart_is_tx_ready(USART_SSPI))
-#else
-	while (!spi_is_tx_ready(SHARED_SPI))
-#endif
-	{
-		if (--timeout == 0)
-		{
-			return true;
-		}
-	}
-	return false;
-}
+#if SSPI_PDC
 
-// Wait for transmitter empty returning true if timed out
-static inline bool waitForTxEmpty()
+// The completion interrupt for queued transactions on the default bus
+extern "C" void USART0_Handler(void)
 {
-	uint32_t timeout = SPI_TIMEOUT;
-#if USART_SPI
-	while (!usart_is_tx_empty(USART_SSPI))
-#else
-		while (!spi_is_tx_empty(SHARED_SPI))
-#endif
-	{
-		if (!timeout--)
-		{
-			return true;
-		}
-	}
-	return false;
+	SharedSpi.Interrupt();
 }
 
-// Wait for receive data available returning true if timed out
-static inline bool waitForRxReady()
-{
-	uint32_t timeout = SPI_TIMEOUT;
-#if USART_SPI
-	while (!usart_is_rx_ready(USART_SSPI))
-#else
-	while (!spi_is_rx_ready(SHARED_SPI))
 #endif
-	{
-		if (--timeout == 0)
-		{
-			return true;
-		}
-	}
-	return false;
-}
 
 // Set up the Shared SPI subsystem
 void sspi_master_init(struct sspi_device *device, uint32_t bits)
 {
-	static bool commsInitDone = false;
-
-	pinMode(device->csPin, (device->csPolarity) ? OUTPUT_LOW : OUTPUT_HIGH);
-
-	if (!commsInitDone)
-	{
-#if USART_SPI
-		ConfigurePin(APIN_USART_SSPI_SCK);
-		ConfigurePin(APIN_USART_SSPI_MOSI);
-		ConfigurePin(APIN_USART_SSPI_MISO);
-		pmc_enable_periph_clk(ID_SSPI);
-
-		// Set USART0 in SPI master mode
-		USART_SSPI->US_IDR = ~0u;
-		USART_SSPI->US_CR = US_CR_RSTRX | US_CR_RSTTX | US_CR_RXDIS | US_CR_TXDIS;
-		USART_SSPI->US_MR = US_MR_USART_MODE_SPI_MASTER
-						| US_MR_USCLKS_MCK
-						| US_MR_CHRL_8_BIT
-						| US_MR_CHMODE_NORMAL;
-		USART_SSPI->US_BRGR = SystemPeripheralClock()/1000000;			// 1MHz SPI clock for now
-		USART_SSPI->US_CR = US_CR_RSTRX | US_CR_RSTTX | US_CR_RXDIS | US_CR_TXDIS | US_CR_RSTSTA;
-#else
-		ConfigurePin(g_APinDescription[APIN_SHARED_SPI_SCK]);
-		ConfigurePin(g_APinDescription[APIN_SHARED_SPI_MOSI]);
-		ConfigurePin(g_APinDescription[APIN_SHARED_SPI_MISO]);
-
-		pmc_enable_periph_clk(SHARED_SPI_INTERFACE_ID);
-
-		SHARED_SPI->SPI_CR = SPI_CR_SPIDIS;
-		SHARED_SPI->SPI_CR = SPI_CR_SWRST;
-		SHARED_SPI->SPI_MR = SPI_MR_MSTR | SPI_MR_MODFDIS;
-
-# if defined(USE_SAM3X_DMAC)
-		pmc_enable_periph_clk(ID_DMAC);
-		dmac_disable(DMAC);
-		dmac_set_priority_mode(DMAC, DMAC_GCFG_ARB_CFG_FIXED);
-		dmac_enable(DMAC);
-# endif
-
-#endif
-		commsInitDone = true;
-	}
-
-#if USART_SPI
-	// On USARTs we only support 8-bit transfers. 5, 6, 7 and 9 are also available.
-	device->bitsPerTransferControl = US_MR_CHRL_8_BIT;
-#else
-	// On SPI we only support 8 and 16 bit modes. 11-15 bit modes are also available.
-	switch (bits)
-	{
-	case 8:
-	default:
-		device->bitsPerTransferControl = SPI_CSR_BITS_8_BIT;
-		break;
-	case 16:
-		device->bitsPerTransferControl = SPI_CSR_BITS_16_BIT;
-		break;
-	}
-#endif
+	SharedSpi.InitDevice(device, bits);
 }
 
 /**
@@ -189,45 +52,7 @@ void sspi_master_init(struct sspi_device *device, uint32_t bits)
  */
 void sspi_master_setup_device(const struct sspi_device *device)
 {
-#if USART_SPI
-	USART_SSPI->US_CR = US_CR_RXDIS | US_CR_TXDIS;			// disable transmitter and receiver
-	USART_SSPI->US_BRGR = SystemPeripheralClock()/device->clockFrequency;
-	uint32_t mr = US_MR_USART_MODE_SPI_MASTER
-					| US_MR_USCLKS_MCK
-					| US_MR_CHRL_8_BIT
-					| US_MR_CHMODE_NORMAL
-					| US_MR_CLKO;
-	if (device->spiMode & 2)
-	{
-		mr |= US_MR_CPOL;
-	}
-	if ((device->spiMode & 1) == 0)							// the bit is called CPHA but is actually NPCHA
-	{
-		mr |= US_MR_CPHA;
-	}
-	USART_SSPI->US_MR = mr;
-	USART_SSPI->US_CR = US_CR_RSTRX | US_CR_RSTTX;			// reset transmitter and receiver (required - see datasheet)
-	USART_SSPI->US_CR = US_CR_RXEN | US_CR_TXEN;			// enable transmitter and receiver
-#else
-	spi_reset(SHARED_SPI);
-	SHARED_SPI->SPI_MR = SPI_MR_MSTR | SPI_MR_MODFDIS;
-
-	// Set SPI mode, clock frequency, CS not active after transfer, delay between transfers
-	uint16_t baud_div = (uint16_t)spi_calc_baudrate_div(device->clockFrequency, SystemPeripheralClock());
-	uint32_t csr = SPI_CSR_SCBR(baud_div)				// Baud rate
-					| device->bitsPerTransferControl	// Transfer bit width
-					| SPI_CSR_DLYBCT(0);      			// Transfer delay
-	if ((device->spiMode & 0x01) == 0)
-	{
-		csr |= SPI_CSR_NCPHA;
-	}
-	if (device->spiMode & 0x02)
-	{
-		csr |= SPI_CSR_CPOL;
-	}
-	SHARED_SPI->SPI_CSR[PERIPHERAL_CHANNEL_ID] = csr;
-	spi_enable(SHARED_SPI);
-#endif
+	SharedSpi.SetupDevice(device);
 }
 
 /**
@@ -240,12 +65,7 @@ void sspi_master_setup_device(const struct sspi_device *device)
  */
 void sspi_select_device(const struct sspi_device *device)
 {
-#if SAM3XA
-	spi_set_peripheral_chip_select_value(SHARED_SPI, spi_get_pcs(PERIPHERAL_CHANNEL_ID));
-#endif
-
-	// Enable the CS line
-	digitalWrite(device->csPin, device->csPolarity);
+	SharedSpi.Select(device);
 }
 
 /**
@@ -259,15 +79,14 @@ void sspi_select_device(const struct sspi_device *device)
  */
 void sspi_deselect_device(const struct sspi_device *device)
 {
-	waitForTxEmpty();
-
-	// Disable the CS line
-	digitalWrite(device->csPin, !device->csPolarity);
+	SharedSpi.Deselect(device);
 }
 
 /**
  * \brief Send and receive a sequence of bytes from an SPI device.
  *
+ * Transfers of at least the DMA threshold length use DMA if it has been enabled, others are polled.
+ *
  * \param tx_data   Data buffer to send.
  * \param rx_data   Data buffer to read.
  * \param len       Length of data to be read.
@@ -276,61 +95,74 @@ void sspi_deselect_device(const struct sspi_device *device)
  */
 spi_status_t sspi_transceive_packet(const uint8_t *tx_data, uint8_t *rx_data, size_t len)
 {
-	for (uint32_t i = 0; i < len; ++i)
-	{
-		uint32_t dOut = (tx_data == nullptr) ? 0x000000FF : (uint32_t)*tx_data++;
-		if (waitForTxReady())
-		{
-			return SPI_ERROR_TIMEOUT;
-		}
-
-		// Write to transmit register
-#if USART_SPI
-		USART_SSPI->US_THR = dOut;
-#else
-		if (i + 1 == len)
-		{
-			dOut |= SPI_TDR_LASTXFER;
-		}
-		SHARED_SPI->SPI_TDR = dOut;
-#endif
+	return SharedSpi.TransceivePacket(tx_data, rx_data, len);
+}
+
+spi_status_t sspi_start_transceive_packet(const uint8_t *tx_data, uint8_t *rx_data, size_t len)
+{
+	return SharedSpi.StartTransceivePacket(tx_data, rx_data, len);
+}
+
+bool sspi_is_transceive_complete(void)
+{
+	return SharedSpi.IsTransceiveComplete();
+}
+
+spi_status_t sspi_wait_transceive_complete(void)
+{
+	return SharedSpi.WaitTransceiveComplete();
+}
+
+uint32_t sspi_get_actual_frequency(const struct sspi_device *device)
+{
+	return SharedSpi.GetActualFrequency(device);
+}
+
+#if SSPI_XDMAC
+
+bool sspi_enable_dma(uint8_t txChannel, uint8_t rxChannel)
+{
+	return SharedSpi.EnableDma(txChannel, rxChannel);
+}
+
+void sspi_rx_dma_interrupt(void)
+{
+	SharedSpi.Interrupt();
+}
+
+#elif SSPI_PDC
+
+bool sspi_enable_dma(void)
+{
+	return SharedSpi.EnableDma();
+}
 
-		// Some devices are transmit-only e.g. 12864 display, so don't wait for received data if we don't need to
-		if (rx_data != nullptr)
-		{
-			// Wait for receive register
-			if (waitForRxReady())
-			{
-				return SPI_ERROR_TIMEOUT;
-			}
-
-			// Get data from receive register
-			const uint8_t dIn =
-#if USART_SPI
-					(uint8_t)USART_SSPI->US_RHR;
-#else
-					(uint8_t)SHARED_SPI->SPI_RDR;
 #endif
-			*rx_data++ = dIn;
-		}
-	}
 
-	// If we didn't wait to receive, then we need to wait for transmit to finish and clear the receive buffer and
-	if (rx_data == nullptr)
-	{
-		waitForTxEmpty();
-#if USART_SPI
-		(void)USART_SSPI->US_RHR;
-#else
-		(void)SHARED_SPI->SPI_RDR;
+#if SSPI_XDMAC || SSPI_PDC
+
+void sspi_set_dma_threshold(size_t bytes)
+{
+	SharedSpi.SetDmaThreshold(bytes);
+}
+
 #endif
 
-	}
+bool sspi_queue_transaction(struct sspi_transaction *t)
+{
+	return SharedSpi.QueueTransaction(t);
+}
 
-	return SPI_OK;
+void sspi_poll_queue(void)
+{
+	SharedSpi.PollQueue();
+}
+
+void sspi_get_queue_stats(struct sspi_queue_stats *stats, bool clear)
+{
+	SharedSpi.GetQueueStats(stats, clear);
 }
 
-#if SAM3XA
 /**
  * \brief Send and receive a sequence of 16-bit words from an SPI device.
  *
@@ -342,39 +174,13 @@ spi_status_t sspi_transceive_packet(const uint8_t *tx_data, uint8_t *rx_data, si
  */
 spi_status_t sspi_transceive_packet16(const uint16_t *tx_data, uint16_t *rx_data, size_t len)
 {
-	for (uint32_t i = 0; i < len; ++i)
-	{
-		// Wait for transmit register empty
-		if (waitForTxReady())
-		{
-			return SPI_ERROR_TIMEOUT;
-		}
-
-		// Write to transmit register
-		uint32_t dOut = (tx_data == nullptr) ? 0x000000FF : (uint32_t)tx_data[i];
-		if (i + 1 == len)
-		{
-			dOut |= SPI_TDR_LASTXFER;
-		}
-		SHARED_SPI->SPI_TDR = dOut;
-
-		// Wait for receive register
-		if (waitForRxReady())
-		{
-			return SPI_ERROR_TIMEOUT;
-		}
-
-		// Get data from receive register
-		uint16_t dIn = (uint16_t)SHARED_SPI->SPI_RDR;
-		if (rx_data != nullptr)
-		{
-			rx_data[i] = dIn;
-		}
-	}
+	return SharedSpi.TransceivePacket16(tx_data, rx_data, len);
+}
 
-	return SPI_OK;
+spi_status_t sspi_transceive_packet32(const uint32_t *tx_data, uint32_t *rx_data, size_t len)
+{
+	return SharedSpi.TransceivePacket32(tx_data, rx_data, len);
 }
-#endif
 
 #if defined(USE_SAM3X_DMAC)
 
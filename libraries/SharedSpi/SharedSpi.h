@@ -12,6 +12,7 @@
  *
  * This module provides access to the SPI bus used to access peripheral devices in RepRapFirmware, in particular thermocouple and RTD readers.
  * Depending on the board, we may use either the main SPI channel or one of the USARTs in SPI mode.
+ * These functions operate on the default bus. See SharedSpiBus.h for additional buses.
  *
  */
 
@@ -114,6 +115,102 @@ extern void sspi_deselect_device(const struct sspi_device *device);
  */
 spi_status_t sspi_transceive_packet(const uint8_t *tx_data, uint8_t *rx_data, size_t len);
 
+/**
+ * \brief Start sending and receiving a sequence of bytes without waiting for it to finish.
+ *
+ * If the transfer doesn't use DMA then it is completed before this returns.
+ * The buffers must remain valid until sspi_wait_transceive_complete() has been called.
+ *
+ * \pre SPI device must be selected with spi_select_device() first.
+ */
+spi_status_t sspi_start_transceive_packet(const uint8_t *tx_data, uint8_t *rx_data, size_t len);
+
+//! \brief Return true if the transfer started by sspi_start_transceive_packet() has finished.
+bool sspi_is_transceive_complete(void);
+
+//! \brief Wait for the transfer started by sspi_start_transceive_packet() to finish and return its status.
+spi_status_t sspi_wait_transceive_complete(void);
+
+//! \brief Return the SPI clock frequency that the device runs at, which may be lower than the one requested because the clock is a whole divisor of the peripheral clock.
+uint32_t sspi_get_actual_frequency(const struct sspi_device *device);
+
+//! Transfers shorter than this are polled even when DMA is enabled, because setting up the DMA takes longer
+#define SSPI_DEFAULT_DMA_THRESHOLD	16
+
+#if SAME70
+/**
+ * \brief Use DMA for transfers of at least the DMA threshold length.
+ *
+ * \param txChannel   XDMAC channel to use for transmitting.
+ * \param rxChannel   XDMAC channel to use for receiving.
+ */
+bool sspi_enable_dma(uint8_t txChannel, uint8_t rxChannel);
+#elif SAM4E || SAM4S
+//! \brief Use the PDC channel of the USART for transfers of at least the DMA threshold length. This also enables the USART interrupt that runs the transaction queue.
+bool sspi_enable_dma(void);
+#endif
+
+#if SAME70 || SAM4E || SAM4S
+//! \brief Set the minimum length of transfers that use DMA.
+void sspi_set_dma_threshold(size_t bytes);
+#endif
+
+struct sspi_transaction;
+
+//! Completion function for a queued transaction. It is called from the completion interrupt, or from whichever caller ran the queue if the transfer didn't use DMA.
+//! It may queue further transactions but must not use the bus directly.
+typedef void (*sspi_callback_fn)(struct sspi_transaction *t, spi_status_t status);
+
+/**
+ * \brief A transfer to be performed by the transaction queue.
+ *
+ * The queue selects the device, sets it up, transfers the data and deselects it. The structure and buffers must remain valid until the callback has been called.
+ */
+struct sspi_transaction {
+	const struct sspi_device *device;	//!< device to talk to, which must have been initialised with sspi_master_init()
+	const uint8_t *tx_data;				//!< data to send, or NULL to send 0xFF
+	uint8_t *rx_data;					//!< buffer for the received data, or NULL to discard it
+	size_t len;
+	sspi_callback_fn callback;			//!< may be NULL
+	void *param;						//!< for use by the callback
+	uint8_t priority;					//!< higher priority transactions run first, equal priorities run in the order they were queued
+	uint32_t queuedTime;				//!< set by the queue
+	struct sspi_transaction *next;		//!< used by the queue
+};
+
+//! \brief Statistics for the transaction queue.
+struct sspi_queue_stats {
+	uint32_t completed;					//!< number of transactions completed, including failed ones
+	uint32_t errors;					//!< number of transactions that failed
+	uint32_t bytes;						//!< number of bytes transferred
+	uint32_t busyMicroseconds;			//!< time spent clocking data, calculated from the transfer lengths and clock frequencies
+	uint32_t elapsedMilliseconds;		//!< time since the statistics were cleared
+	uint32_t maxQueueLength;
+	uint32_t maxLatencyMilliseconds;	//!< longest time from queueing a transaction to completing it
+};
+
+/**
+ * \brief Queue a transaction to run as soon as the bus is free.
+ *
+ * When DMA is enabled, queued transactions run back to back from the completion interrupt. Otherwise they are polled when the bus becomes free.
+ * Callers that use the bus directly claim it in sspi_master_setup_device() or sspi_select_device(), which wait for the current queued transaction to finish
+ * and for any other device that has claimed the bus to be deselected, and release it in sspi_deselect_device().
+ *
+ * \return false if the transaction is invalid.
+ */
+bool sspi_queue_transaction(struct sspi_transaction *t);
+
+//! \brief Check for a queued DMA transfer that has timed out. Call this regularly in case a completion interrupt is missed.
+void sspi_poll_queue(void);
+
+//! \brief Get the transaction queue statistics, optionally clearing them.
+void sspi_get_queue_stats(struct sspi_queue_stats *stats, bool clear);
+
+#if SAME70
+//! \brief The application's XDMAC interrupt handler must call this when the receive channel passed to sspi_enable_dma() interrupts.
+void sspi_rx_dma_interrupt(void);
+#endif
+
 // Receive a packet
 static inline spi_status_t sspi_read_packet(uint8_t *buf, size_t len)
 {
@@ -126,18 +223,27 @@ static inline spi_status_t sspi_write_packet(uint8_t *buf, size_t len)
 	return sspi_transceive_packet(buf, NULL, len);
 }
 
-#if SAM3XA
 /**
- * \brief Send and receive a sequence of 16-bit words from the shared SPI device.
+ * \brief Send and receive a sequence of 16-bit words from the shared SPI device, most significant byte first.
  *
- * \param tx_data   Data buffer to send.
- * \param rx_data   Data buffer to read.
+ * If the device was initialised for 16 bits on an SPI peripheral then each word is one frame, otherwise it is sent as two bytes.
+ *
+ * \param tx_data   Data buffer to send, or NULL to send all ones.
+ * \param rx_data   Data buffer to read, or NULL.
  * \param len       Length of data to send and receive in 16-bit words.
  *
- * \pre SPI device must be selected with spi_select_device() first and in 16-bit data mode.
+ * \pre SPI device must be selected with spi_select_device() first.
  */
 spi_status_t sspi_transceive_packet16(const uint16_t *tx_data, uint16_t *rx_data, size_t len);
-#endif
+
+/**
+ * \brief Send and receive a sequence of 32-bit words from the shared SPI device, most significant byte first.
+ *
+ * Each word is sent as two 16-bit frames or four bytes, depending on the frame width of the device.
+ *
+ * \pre SPI device must be selected with spi_select_device() first.
+ */
+spi_status_t sspi_transceive_packet32(const uint32_t *tx_data, uint32_t *rx_data, size_t len);
 
 #if defined(USE_SAM3X_DMAC)
 
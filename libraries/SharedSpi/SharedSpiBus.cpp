@@ -0,0 +1,936 @@
+/**
+ * \file
+ *
+ * \brief Shared SPI bus class
+ *
+ * Each instance drives one SPI peripheral or one USART in SPI master mode.
+ *
+ */
+
+#include "Core.h"
+#include "SharedSpiBus.h"
+#include "variant.h"
+
+#if SSPI_XDMAC
+# include "xdmac/xdmac.h"
+#elif SSPI_PDC
+# include "pdc/pdc.h"
+#endif
+
+// How long we wait for the peripheral to become ready to send or receive a frame, or to finish sending
+constexpr uint32_t WaitTimeoutMicroseconds = 1000;
+
+// Timer for short waits. It uses the SysTick counter rather than millis(), so that it works when interrupts are disabled, and unlike a loop count it doesn't depend on the CPU speed.
+// It must be polled at least once per SysTick period, which is always the case in the busy-wait loops that use it.
+class WaitTimer
+{
+public:
+	WaitTimer(uint32_t microseconds)
+		: lastCount(SysTick->VAL), ticksLeft(microseconds * ((SysTick->LOAD + 1)/1000))
+	{
+	}
+
+	bool Expired()
+	{
+		const uint32_t count = SysTick->VAL;								// the counter counts down and reloads from LOAD
+		const uint32_t elapsed = (count <= lastCount) ? lastCount - count : lastCount + (SysTick->LOAD + 1) - count;
+		lastCount = count;
+		if (elapsed >= ticksLeft)
+		{
+			return true;
+		}
+		ticksLeft -= elapsed;
+		return false;
+	}
+
+private:
+	uint32_t lastCount;
+	uint32_t ticksLeft;
+};
+
+// We have to tell the SPI peripheral which NPCS output we are using, even though we drive the CS pins ourselves.
+// Use one that is not physically connected, because on some boards the others are configured as NPCS outputs for other devices.
+#if SAME70
+constexpr uint32_t PeripheralChannelId = 2;			// NPCS2 is not connected on the SAME70
+#else
+constexpr uint32_t PeripheralChannelId = 3;			// NPCS3 is not connected on the SAM3X
+#endif
+
+#if SSPI_XDMAC || SSPI_PDC
+extern "C" void CacheFlushBeforeDMASend(const volatile void *start, size_t length);
+extern "C" void CacheFlushBeforeDMAReceive(const volatile void *start, size_t length);
+#endif
+
+SharedSpiBus::SharedSpiBus(Spi *p_spi, Usart *p_usart, uint32_t p_peripheralId, Pin p_sckPin, Pin p_mosiPin, Pin p_misoPin)
+	: spi(p_spi), usart(p_usart), peripheralId(p_peripheralId), sckPin(p_sckPin), mosiPin(p_mosiPin), misoPin(p_misoPin), initDone(false),
+	  csrValue(0), frames16Bit(false), asyncStatus(SPI_OK),
+#if SSPI_XDMAC || SSPI_PDC
+	  dmaEnabled(false), dmaThreshold(SSPI_DEFAULT_DMA_THRESHOLD), clockFrequency(1000000),
+# if SSPI_XDMAC
+	  txDmaChannel(0), rxDmaChannel(0), txDmaPeripheralId(0), rxDmaPeripheralId(0),
+# endif
+	  dmaInProgress(false), dmaRxData(nullptr), dmaLength(0), dmaStartTime(0), dmaTimeout(0),
+#endif
+	  queueHead(nullptr), currentTransaction(nullptr), busClaimed(false), claimingDevice(nullptr), queueLength(0), queueStatsStartTime(0)
+{
+	memset(&queueStats, 0, sizeof(queueStats));
+}
+
+SharedSpiBus::SharedSpiBus(Spi *p_spi, uint32_t p_peripheralId, Pin p_sckPin, Pin p_mosiPin, Pin p_misoPin)
+	: SharedSpiBus(p_spi, nullptr, p_peripheralId, p_sckPin, p_mosiPin, p_misoPin)
+{
+}
+
+SharedSpiBus::SharedSpiBus(Usart *p_usart, uint32_t p_peripheralId, Pin p_sckPin, Pin p_mosiPin, Pin p_misoPin)
+	: SharedSpiBus(nullptr, p_usart, p_peripheralId, p_sckPin, p_mosiPin, p_misoPin)
+{
+}
+
+inline bool SharedSpiBus::IsTxReady() const
+{
+	return (usart != nullptr) ? (usart->US_CSR & US_CSR_TXRDY) != 0 : spi_is_tx_ready(spi);
+}
+
+inline bool SharedSpiBus::IsTxEmpty() const
+{
+	return (usart != nullptr) ? (usart->US_CSR & US_CSR_TXEMPTY) != 0 : spi_is_tx_empty(spi);
+}
+
+inline bool SharedSpiBus::IsRxReady() const
+{
+	return (usart != nullptr) ? (usart->US_CSR & US_CSR_RXRDY) != 0 : spi_is_rx_ready(spi);
+}
+
+// Wait for transmitter ready returning true if timed out
+bool SharedSpiBus::WaitForTxReady() const
+{
+	WaitTimer timer(WaitTimeoutMicroseconds);
+	while (!IsTxReady())
+	{
+		if (timer.Expired())
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Wait for transmitter empty returning true if timed out
+bool SharedSpiBus::WaitForTxEmpty() const
+{
+	WaitTimer timer(WaitTimeoutMicroseconds);
+	while (!IsTxEmpty())
+	{
+		if (timer.Expired())
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Wait for receive data available returning true if timed out
+bool SharedSpiBus::WaitForRxReady() const
+{
+	WaitTimer timer(WaitTimeoutMicroseconds);
+	while (!IsRxReady())
+	{
+		if (timer.Expired())
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+inline void SharedSpiBus::WriteData(uint32_t data, bool last)
+{
+	if (usart != nullptr)
+	{
+		usart->US_THR = data;
+	}
+	else
+	{
+		spi->SPI_TDR = (last) ? data | SPI_TDR_LASTXFER : data;
+	}
+}
+
+inline uint32_t SharedSpiBus::ReadData()
+{
+	return (usart != nullptr) ? usart->US_RHR : spi->SPI_RDR;
+}
+
+// Clear any received data and error flags
+void SharedSpiBus::ClearReceiver()
+{
+	if (usart != nullptr)
+	{
+		(void)usart->US_RHR;
+		usart->US_CR = US_CR_RSTSTA;
+	}
+	else
+	{
+		(void)spi->SPI_RDR;
+		(void)spi->SPI_SR;					// clear any overrun error
+	}
+}
+
+// Set up the peripheral. This is done when the first device is initialised.
+void SharedSpiBus::Init()
+{
+	ConfigurePin(sckPin);
+	ConfigurePin(mosiPin);
+	ConfigurePin(misoPin);
+	pmc_enable_periph_clk(peripheralId);
+
+	if (usart != nullptr)
+	{
+		// Set the USART in SPI master mode
+		usart->US_IDR = ~0u;
+		usart->US_CR = US_CR_RSTRX | US_CR_RSTTX | US_CR_RXDIS | US_CR_TXDIS;
+		usart->US_MR = US_MR_USART_MODE_SPI_MASTER
+						| US_MR_USCLKS_MCK
+						| US_MR_CHRL_8_BIT
+						| US_MR_CHMODE_NORMAL;
+		usart->US_BRGR = SystemPeripheralClock()/1000000;			// 1MHz SPI clock for now
+		usart->US_CR = US_CR_RSTRX | US_CR_RSTTX | US_CR_RXDIS | US_CR_TXDIS | US_CR_RSTSTA;
+	}
+	else
+	{
+		spi->SPI_CR = SPI_CR_SPIDIS;
+		spi->SPI_CR = SPI_CR_SWRST;
+		spi->SPI_MR = SPI_MR_MSTR | SPI_MR_MODFDIS;
+		spi_set_peripheral_chip_select_value(spi, spi_get_pcs(PeripheralChannelId));
+		spi_enable(spi);
+
+#if defined(USE_SAM3X_DMAC)
+		pmc_enable_periph_clk(ID_DMAC);
+		dmac_disable(DMAC);
+		dmac_set_priority_mode(DMAC, DMAC_GCFG_ARB_CFG_FIXED);
+		dmac_enable(DMAC);
+#endif
+	}
+	initDone = true;
+}
+
+// Set up a device on this bus
+void SharedSpiBus::InitDevice(struct sspi_device *device, uint32_t bits)
+{
+	pinMode(device->csPin, (device->csPolarity) ? OUTPUT_LOW : OUTPUT_HIGH);
+
+	if (!initDone)
+	{
+		Init();
+	}
+
+	if (usart != nullptr)
+	{
+		// On USARTs we only support 8-bit frames. 5, 6, 7 and 9 are also available. Word transfers are sent as several 8-bit frames.
+		device->bitsPerTransferControl = US_MR_CHRL_8_BIT;
+	}
+	else
+	{
+		// On SPI we only support 8 and 16 bit modes. 11-15 bit modes are also available.
+		switch (bits)
+		{
+		case 8:
+		default:
+			device->bitsPerTransferControl = SPI_CSR_BITS_8_BIT;
+			break;
+		case 16:
+			device->bitsPerTransferControl = SPI_CSR_BITS_16_BIT;
+			break;
+		}
+	}
+}
+
+// Return the divisor of the peripheral clock that gives the highest SPI clock frequency not exceeding the requested one
+uint32_t SharedSpiBus::GetClockDivisor(uint32_t frequency) const
+{
+	const uint32_t divisor = (SystemPeripheralClock() + frequency - 1)/frequency;
+	const uint32_t maxDivisor = (spi != nullptr) ? 255 : 0xFFFF;		// the SPI SCBR field is 8 bits, the USART CD field is 16 bits
+	return (divisor > maxDivisor) ? maxDivisor : divisor;
+}
+
+// Return the SPI clock frequency that the device actually runs at
+uint32_t SharedSpiBus::GetActualFrequency(const struct sspi_device *device) const
+{
+	return SystemPeripheralClock()/GetClockDivisor(device->clockFrequency);
+}
+
+// Program the SPI or USART for a device. If the settings are the same as for the previous device then there is nothing to do.
+void SharedSpiBus::ConfigureDevice(const struct sspi_device *device)
+{
+#if SSPI_XDMAC || SSPI_PDC
+	clockFrequency = device->clockFrequency;
+#endif
+	frames16Bit = (spi != nullptr && (device->bitsPerTransferControl & SPI_CSR_BITS_Msk) == SPI_CSR_BITS_16_BIT);
+	if (usart != nullptr)
+	{
+		const uint32_t brgr = GetClockDivisor(device->clockFrequency);
+		uint32_t mr = US_MR_USART_MODE_SPI_MASTER
+						| US_MR_USCLKS_MCK
+						| US_MR_CHRL_8_BIT
+						| US_MR_CHMODE_NORMAL
+						| US_MR_CLKO;
+		if (device->spiMode & 2)
+		{
+			mr |= US_MR_CPOL;
+		}
+		if ((device->spiMode & 1) == 0)							// the bit is called CPHA but is actually NPCHA
+		{
+			mr |= US_MR_CPHA;
+		}
+		if (mr == usart->US_MR && brgr == usart->US_BRGR)
+		{
+			return;
+		}
+		usart->US_CR = US_CR_RXDIS | US_CR_TXDIS;				// disable transmitter and receiver
+		usart->US_BRGR = brgr;
+		usart->US_MR = mr;
+		usart->US_CR = US_CR_RSTRX | US_CR_RSTTX;				// reset transmitter and receiver (required - see datasheet)
+		usart->US_CR = US_CR_RXEN | US_CR_TXEN;					// enable transmitter and receiver
+	}
+	else
+	{
+		// Set SPI mode, clock frequency, CS not active after transfer, delay between transfers
+		uint32_t csr = SPI_CSR_SCBR(GetClockDivisor(device->clockFrequency))				// Baud rate
+						| device->bitsPerTransferControl	// Transfer bit width
+						| SPI_CSR_DLYBCT(0);      			// Transfer delay
+		if ((device->spiMode & 0x01) == 0)
+		{
+			csr |= SPI_CSR_NCPHA;
+		}
+		if (device->spiMode & 0x02)
+		{
+			csr |= SPI_CSR_CPOL;
+		}
+		if (csr != csrValue)
+		{
+			spi->SPI_CSR[PeripheralChannelId] = csr;
+			csrValue = csr;
+		}
+	}
+}
+
+void SharedSpiBus::SetupDevice(const struct sspi_device *device)
+{
+	ClaimBus(device);
+	ConfigureDevice(device);
+}
+
+// Assert the chip select for a device
+void SharedSpiBus::AssertCs(const struct sspi_device *device)
+{
+	// Enable the CS line
+	digitalWrite(device->csPin, device->csPolarity);
+}
+
+void SharedSpiBus::Select(const struct sspi_device *device)
+{
+	ClaimBus(device);
+	AssertCs(device);
+}
+
+// Wait for the last byte to be sent, then release the chip select for a device
+void SharedSpiBus::ReleaseCs(const struct sspi_device *device)
+{
+	WaitForTxEmpty();
+
+	// Disable the CS line
+	digitalWrite(device->csPin, !device->csPolarity);
+}
+
+void SharedSpiBus::Deselect(const struct sspi_device *device)
+{
+	ReleaseCs(device);
+
+	// Let the queue and other devices have the bus
+	claimingDevice = nullptr;
+	busClaimed = false;
+	RunQueue();
+}
+
+// Send and receive a sequence of bytes by polling
+spi_status_t SharedSpiBus::TransceivePacketPolled(const uint8_t *tx_data, uint8_t *rx_data, size_t len)
+{
+	for (uint32_t i = 0; i < len; ++i)
+	{
+		const uint32_t dOut = (tx_data == nullptr) ? 0x000000FF : (uint32_t)*tx_data++;
+		if (WaitForTxReady())
+		{
+			return SPI_ERROR_TIMEOUT;
+		}
+
+		// Write to transmit register
+		WriteData(dOut, i + 1 == len);
+
+		// Some devices are transmit-only e.g. 12864 display, so don't wait for received data if we don't need to
+		if (rx_data != nullptr)
+		{
+			// Wait for receive register
+			if (WaitForRxReady())
+			{
+				return SPI_ERROR_TIMEOUT;
+			}
+
+			// Get data from receive register
+			*rx_data++ = (uint8_t)ReadData();
+		}
+	}
+
+	// If we didn't wait to receive, then we need to wait for transmit to finish and clear the receive buffer
+	if (rx_data == nullptr)
+	{
+		WaitForTxEmpty();
+		(void)ReadData();
+	}
+
+	return SPI_OK;
+}
+
+#if SSPI_XDMAC || SSPI_PDC
+
+# if SSPI_XDMAC
+
+// Get the XDMAC hardware interface number for transmitting to a peripheral. The one for receiving is one higher.
+static int GetXdmacTxPeripheralId(uint32_t peripheralId)
+{
+	switch (peripheralId)
+	{
+	case ID_SPI0:	return XDMAC_CHANNEL_HWID_SPI0_TX;
+#  ifdef ID_SPI1
+	case ID_SPI1:	return XDMAC_CHANNEL_HWID_SPI1_TX;
+#  endif
+	case ID_USART0:	return XDMAC_CHANNEL_HWID_USART0_TX;
+	case ID_USART1:	return XDMAC_CHANNEL_HWID_USART1_TX;
+	case ID_USART2:	return XDMAC_CHANNEL_HWID_USART2_TX;
+	default:		return -1;
+	}
+}
+
+// Use the specified XDMAC channels for transfers of at least the DMA threshold length
+bool SharedSpiBus::EnableDma(uint8_t txChannel, uint8_t rxChannel)
+{
+	const int xdmacPeripheralId = GetXdmacTxPeripheralId(peripheralId);
+	if (xdmacPeripheralId < 0)
+	{
+		return false;
+	}
+
+	pmc_enable_periph_clk(ID_XDMAC);
+	txDmaPeripheralId = (uint8_t)xdmacPeripheralId;
+	rxDmaPeripheralId = (uint8_t)(xdmacPeripheralId + 1);
+	txDmaChannel = txChannel;
+	rxDmaChannel = rxChannel;
+	xdmac_channel_disable(XDMAC, txDmaChannel);
+	xdmac_channel_disable(XDMAC, rxDmaChannel);
+	dmaEnabled = true;
+	return true;
+}
+
+// Start an XDMAC channel transferring bytes between memory and the SPI or USART data register
+void SharedSpiBus::StartXdmac(uint8_t channel, bool toPeripheral, const void *mem, bool fixedMem, size_t len)
+{
+	const volatile void * dataReg;
+	if (usart != nullptr)
+	{
+		dataReg = (toPeripheral) ? (const volatile void *)&usart->US_THR : (const volatile void *)&usart->US_RHR;
+	}
+	else
+	{
+		dataReg = (toPeripheral) ? (const volatile void *)&spi->SPI_TDR : (const volatile void *)&spi->SPI_RDR;
+	}
+	xdmac_channel_config_t p_cfg = {0, 0, 0, 0, 0, 0, 0, 0};
+	p_cfg.mbr_ubc = len;
+	if (toPeripheral)
+	{
+		p_cfg.mbr_sa = reinterpret_cast<uint32_t>(mem);
+		p_cfg.mbr_da = reinterpret_cast<uint32_t>(dataReg);
+		p_cfg.mbr_cfg = XDMAC_CC_DSYNC_MEM2PER
+						| XDMAC_CC_SIF_AHB_IF0
+						| XDMAC_CC_DIF_AHB_IF1
+						| ((fixedMem) ? XDMAC_CC_SAM_FIXED_AM : XDMAC_CC_SAM_INCREMENTED_AM)
+						| XDMAC_CC_DAM_FIXED_AM;
+	}
+	else
+	{
+		p_cfg.mbr_sa = reinterpret_cast<uint32_t>(dataReg);
+		p_cfg.mbr_da = reinterpret_cast<uint32_t>(mem);
+		p_cfg.mbr_cfg = XDMAC_CC_DSYNC_PER2MEM
+						| XDMAC_CC_SIF_AHB_IF1
+						| XDMAC_CC_DIF_AHB_IF0
+						| XDMAC_CC_SAM_FIXED_AM
+						| ((fixedMem) ? XDMAC_CC_DAM_FIXED_AM : XDMAC_CC_DAM_INCREMENTED_AM);
+	}
+	p_cfg.mbr_cfg |= XDMAC_CC_TYPE_PER_TRAN
+					| XDMAC_CC_MBSIZE_SINGLE
+					| XDMAC_CC_CSIZE_CHK_1
+					| XDMAC_CC_DWIDTH_BYTE
+					| XDMAC_CC_PERID((toPeripheral) ? txDmaPeripheralId : rxDmaPeripheralId);
+	xdmac_configure_transfer(XDMAC, channel, &p_cfg);
+	xdmac_channel_enable(XDMAC, channel);
+}
+
+static inline bool XdmacBusy(uint8_t channel)
+{
+	return (XDMAC->XDMAC_GS & (XDMAC_GS_ST0 << channel)) != 0;
+}
+
+# else
+
+// Use the PDC channel of the peripheral for transfers of at least the DMA threshold length, and enable the interrupt that runs the transaction queue
+bool SharedSpiBus::EnableDma()
+{
+	DisableDmaInterrupts();
+	NVIC_EnableIRQ((IRQn_Type)peripheralId);
+	dmaEnabled = true;
+	return true;
+}
+
+// The PDC registers start at the peripheral's RPR register. The Pdc struct members are already volatile, so it is safe to cast the qualifier away here.
+inline Pdc *SharedSpiBus::GetPdc() const
+{
+	return reinterpret_cast<Pdc*>(const_cast<uint32_t*>((usart != nullptr) ? &usart->US_RPR : &spi->SPI_RPR));
+}
+
+// The USART and SPI interrupt registers have different bit assignments, so the caller passes both
+inline void SharedSpiBus::EnableInterrupts(uint32_t usartMask, uint32_t spiMask)
+{
+	if (usart != nullptr)
+	{
+		usart->US_IER = usartMask;
+	}
+	else
+	{
+		spi->SPI_IER = spiMask;
+	}
+}
+
+inline void SharedSpiBus::DisableDmaInterrupts()
+{
+	if (usart != nullptr)
+	{
+		usart->US_IDR = US_IDR_ENDRX | US_IDR_ENDTX | US_IDR_TXEMPTY;
+	}
+	else
+	{
+		spi->SPI_IDR = SPI_IDR_ENDRX | SPI_IDR_ENDTX | SPI_IDR_TXEMPTY;
+	}
+}
+
+# endif
+
+// Set the minimum transfer length for which we use DMA. Shorter transfers are faster to do by polling.
+void SharedSpiBus::SetDmaThreshold(size_t bytes)
+{
+	dmaThreshold = (bytes == 0) ? 1 : bytes;
+}
+
+// Start a DMA transfer. If there is nothing to receive then we only use the transmit channel, as the polled code does.
+// If useInterrupt is true then we enable an interrupt when the transfer completes, which is used to run the transaction queue.
+void SharedSpiBus::StartDma(const uint8_t *tx_data, uint8_t *rx_data, size_t len, bool useInterrupt)
+{
+	ClearReceiver();
+	dmaRxData = rx_data;
+	dmaLength = len;
+
+	// Allow twice the time that the transfer should take, plus a margin
+	dmaTimeout = (uint32_t)(((uint64_t)len * 8 * 2 * 1000)/clockFrequency) + 2;
+	dmaStartTime = millis();
+	dmaInProgress = true;
+
+# if SSPI_XDMAC
+	static const uint8_t ones = 0xFF;
+	if (rx_data != nullptr)
+	{
+		CacheFlushBeforeDMAReceive(rx_data, len);
+		StartXdmac(rxDmaChannel, false, rx_data, false, len);
+	}
+	else if (useInterrupt)
+	{
+		// We only get an interrupt from the receive channel, so receive into a dummy byte. This also tells us when the last byte has been shifted out.
+		static uint8_t rxDiscard;
+		StartXdmac(rxDmaChannel, false, &rxDiscard, true, len);
+	}
+	if (useInterrupt)
+	{
+		xdmac_channel_enable_interrupt(XDMAC, rxDmaChannel, XDMAC_CIE_BIE);
+		xdmac_enable_interrupt(XDMAC, rxDmaChannel);
+	}
+	if (tx_data != nullptr)
+	{
+		CacheFlushBeforeDMASend(tx_data, len);
+		StartXdmac(txDmaChannel, true, tx_data, false, len);
+	}
+	else
+	{
+		StartXdmac(txDmaChannel, true, &ones, true, len);		// send 0xFF repeatedly
+	}
+# else
+	Pdc * const pdc = GetPdc();
+	pdc_disable_transfer(pdc, PERIPH_PTCR_RXTDIS | PERIPH_PTCR_TXTDIS);
+	pdc_packet_t packet;
+	packet.ul_size = len;
+	if (rx_data != nullptr)
+	{
+		if (tx_data == nullptr)
+		{
+			// The PDC can't send a fixed value, so send 0xFF from the receive buffer. Each byte is sent before the byte received in its place arrives.
+			memset(rx_data, 0xFF, len);
+			tx_data = rx_data;
+		}
+		packet.ul_addr = reinterpret_cast<uint32_t>(rx_data);
+		pdc_rx_init(pdc, &packet, nullptr);
+	}
+	packet.ul_addr = reinterpret_cast<uint32_t>(tx_data);
+	pdc_tx_init(pdc, &packet, nullptr);
+	pdc_enable_transfer(pdc, (rx_data != nullptr) ? (PERIPH_PTCR_RXTEN | PERIPH_PTCR_TXTEN) : PERIPH_PTCR_TXTEN);
+	if (useInterrupt)
+	{
+		// If there is nothing to receive then we wait for the PDC to finish transmitting, then for the last byte to be shifted out
+		if (rx_data != nullptr)
+		{
+			EnableInterrupts(US_IER_ENDRX, SPI_IER_ENDRX);
+		}
+		else
+		{
+			EnableInterrupts(US_IER_ENDTX, SPI_IER_ENDTX);
+		}
+	}
+# endif
+}
+
+// Return true if the DMA transfer has finished, including shifting out the last byte
+bool SharedSpiBus::IsDmaComplete() const
+{
+# if SSPI_XDMAC
+	if (dmaRxData != nullptr)
+	{
+		return !XdmacBusy(rxDmaChannel);
+	}
+	return !XdmacBusy(txDmaChannel) && IsTxEmpty();
+# else
+	Pdc * const pdc = GetPdc();
+	if (dmaRxData != nullptr)
+	{
+		return pdc_read_rx_counter(pdc) == 0;
+	}
+	return pdc_read_tx_counter(pdc) == 0 && IsTxEmpty();
+# endif
+}
+
+// Stop the DMA channels and tidy up after a transfer
+void SharedSpiBus::StopDma()
+{
+# if SSPI_XDMAC
+	xdmac_channel_disable_interrupt(XDMAC, rxDmaChannel, XDMAC_CID_BID);
+	xdmac_channel_disable(XDMAC, txDmaChannel);
+	xdmac_channel_disable(XDMAC, rxDmaChannel);
+	if (dmaRxData != nullptr)
+	{
+		CacheFlushBeforeDMAReceive(dmaRxData, dmaLength);		// invalidate the cache so that we see the data written by the DMA
+	}
+# else
+	DisableDmaInterrupts();
+	pdc_disable_transfer(GetPdc(), PERIPH_PTCR_RXTDIS | PERIPH_PTCR_TXTDIS);
+# endif
+	if (dmaRxData == nullptr)
+	{
+		ClearReceiver();										// we didn't read the received data, so discard it and the overrun error
+	}
+	dmaInProgress = false;
+}
+
+#endif
+
+// Send and receive a sequence of bytes. Transfers of at least the DMA threshold length use DMA if it has been enabled, others are polled.
+spi_status_t SharedSpiBus::TransceivePacket(const uint8_t *tx_data, uint8_t *rx_data, size_t len)
+{
+	const spi_status_t status = StartTransceivePacket(tx_data, rx_data, len);
+	return (status == SPI_OK) ? WaitTransceiveComplete() : status;
+}
+
+// Start a transfer. If DMA is not used then the transfer is completed before this returns.
+spi_status_t SharedSpiBus::StartTransceivePacket(const uint8_t *tx_data, uint8_t *rx_data, size_t len)
+{
+#if SSPI_XDMAC || SSPI_PDC
+	if (dmaEnabled && len >= dmaThreshold && (tx_data != nullptr || rx_data != nullptr))
+	{
+		StartDma(tx_data, rx_data, len, false);
+		asyncStatus = SPI_OK;
+		return SPI_OK;
+	}
+#endif
+	asyncStatus = TransceivePacketPolled(tx_data, rx_data, len);
+	return asyncStatus;
+}
+
+// Return true if the transfer started by StartTransceivePacket has finished
+bool SharedSpiBus::IsTransceiveComplete() const
+{
+#if SSPI_XDMAC || SSPI_PDC
+	return !dmaInProgress || IsDmaComplete();
+#else
+	return true;
+#endif
+}
+
+// Wait for the transfer started by StartTransceivePacket to finish and return its status
+spi_status_t SharedSpiBus::WaitTransceiveComplete()
+{
+#if SSPI_XDMAC || SSPI_PDC
+	if (dmaInProgress)
+	{
+		while (!IsDmaComplete())
+		{
+			if (millis() - dmaStartTime > dmaTimeout)
+			{
+				StopDma();
+				asyncStatus = SPI_ERROR_TIMEOUT;
+				return asyncStatus;
+			}
+		}
+		StopDma();
+	}
+#endif
+	return asyncStatus;
+}
+
+// Transaction queue
+
+// Finish the current queued transaction and call its callback. Must be called with interrupts disabled or from the ISR, or from the context that is running the queue.
+void SharedSpiBus::FinishTransaction(spi_status_t status)
+{
+	sspi_transaction * const t = currentTransaction;
+	ReleaseCs(t->device);
+
+	++queueStats.completed;
+	if (status != SPI_OK)
+	{
+		++queueStats.errors;
+	}
+	queueStats.bytes += t->len;
+	queueStats.busyMicroseconds += (uint32_t)(((uint64_t)t->len * 8 * 1000000)/t->device->clockFrequency);
+	const uint32_t latency = millis() - t->queuedTime;
+	if (latency > queueStats.maxLatencyMilliseconds)
+	{
+		queueStats.maxLatencyMilliseconds = latency;
+	}
+
+	if (t->callback != nullptr)
+	{
+		t->callback(t, status);					// currentTransaction is still set, so if the callback queues another transaction it won't be started yet
+	}
+	currentTransaction = nullptr;
+}
+
+// Start queued transactions until one is left running under DMA, the queue is empty or the bus has been claimed
+void SharedSpiBus::RunQueue()
+{
+	for (;;)
+	{
+		const irqflags_t flags = cpu_irq_save();
+		sspi_transaction * const t = queueHead;
+		if (t == nullptr || currentTransaction != nullptr || busClaimed)
+		{
+			cpu_irq_restore(flags);
+			return;
+		}
+		queueHead = t->next;
+		--queueLength;
+		currentTransaction = t;
+		cpu_irq_restore(flags);
+
+		ConfigureDevice(t->device);
+		AssertCs(t->device);
+#if SSPI_XDMAC || SSPI_PDC
+		// Queued transfers use DMA regardless of the threshold, because the caller isn't waiting for them
+		if (dmaEnabled && (t->tx_data != nullptr || t->rx_data != nullptr))
+		{
+			StartDma(t->tx_data, t->rx_data, t->len, true);
+			return;								// the completion interrupt will finish the transaction and start the next one
+		}
+#endif
+		FinishTransaction(TransceivePacketPolled(t->tx_data, t->rx_data, t->len));
+	}
+}
+
+// Wait until no queued transaction is in progress and no other device has claimed the bus, then stop the queue from starting any more until the bus is released in Deselect.
+// A device that has already claimed the bus may claim it again, because SetupDevice and Select are normally both called before Deselect.
+void SharedSpiBus::ClaimBus(const struct sspi_device *device)
+{
+	for (;;)
+	{
+		const irqflags_t flags = cpu_irq_save();
+		if (currentTransaction == nullptr && (!busClaimed || claimingDevice == device))
+		{
+			busClaimed = true;
+			claimingDevice = device;
+			cpu_irq_restore(flags);
+			return;
+		}
+		const bool claimedByOther = busClaimed;
+		cpu_irq_restore(flags);
+		if (claimedByOther)
+		{
+			yield();							// let the task using the other device finish with it
+		}
+		else
+		{
+			PollQueue();						// in case the completion interrupt has been missed
+		}
+	}
+}
+
+// Queue a transaction and start it if the bus is free
+bool SharedSpiBus::QueueTransaction(struct sspi_transaction *t)
+{
+	if (t == nullptr || t->device == nullptr || t->len == 0)
+	{
+		return false;
+	}
+
+	t->queuedTime = millis();
+	const irqflags_t flags = cpu_irq_save();
+	sspi_transaction **pp = &queueHead;
+	while (*pp != nullptr && (*pp)->priority >= t->priority)
+	{
+		pp = &(*pp)->next;
+	}
+	t->next = *pp;
+	*pp = t;
+	++queueLength;
+	if (queueLength > queueStats.maxQueueLength)
+	{
+		queueStats.maxQueueLength = queueLength;
+	}
+	cpu_irq_restore(flags);
+
+	RunQueue();
+	return true;
+}
+
+// Finish the queued transaction if its DMA transfer has completed, then start the next one
+void SharedSpiBus::Interrupt()
+{
+#if SSPI_XDMAC
+	(void)xdmac_channel_get_interrupt_status(XDMAC, rxDmaChannel);		// clear the interrupt
+#endif
+#if SSPI_XDMAC || SSPI_PDC
+	if (currentTransaction != nullptr && dmaInProgress)
+	{
+		if (IsDmaComplete())
+		{
+			StopDma();
+			FinishTransaction(SPI_OK);
+			RunQueue();
+		}
+# if SSPI_PDC
+		else if (dmaRxData == nullptr && pdc_read_tx_counter(GetPdc()) == 0)
+		{
+			// The PDC has finished, so wait for the last byte to be shifted out
+			DisableDmaInterrupts();
+			EnableInterrupts(US_IER_TXEMPTY, SPI_IER_TXEMPTY);
+		}
+# endif
+	}
+# if SSPI_PDC
+	else
+	{
+		DisableDmaInterrupts();
+	}
+# endif
+#endif
+}
+
+// Abandon the queued transaction in progress if its DMA transfer has timed out
+void SharedSpiBus::PollQueue()
+{
+#if SSPI_XDMAC || SSPI_PDC
+	const irqflags_t flags = cpu_irq_save();
+	if (currentTransaction != nullptr && dmaInProgress && millis() - dmaStartTime > dmaTimeout)
+	{
+		StopDma();
+		FinishTransaction(SPI_ERROR_TIMEOUT);
+		cpu_irq_restore(flags);
+		RunQueue();
+		return;
+	}
+	cpu_irq_restore(flags);
+#endif
+}
+
+void SharedSpiBus::GetQueueStats(struct sspi_queue_stats *stats, bool clear)
+{
+	const irqflags_t flags = cpu_irq_save();
+	*stats = queueStats;
+	const uint32_t now = millis();
+	stats->elapsedMilliseconds = now - queueStatsStartTime;
+	if (clear)
+	{
+		memset(&queueStats, 0, sizeof(queueStats));
+		queueStats.maxQueueLength = queueLength;
+		queueStatsStartTime = now;
+	}
+	cpu_irq_restore(flags);
+}
+
+// Send and receive words of wordBytes bytes, most significant byte first, by polling. Each word is sent as one or more frames of the current frame width.
+spi_status_t SharedSpiBus::TransceiveWordsPolled(const void *tx_data, void *rx_data, size_t len, size_t wordBytes)
+{
+	const unsigned int frameBits = (frames16Bit) ? 16 : 8;
+	const uint32_t frameMask = (1u << frameBits) - 1;
+	const unsigned int framesPerWord = (wordBytes * 8)/frameBits;
+	for (size_t i = 0; i < len; ++i)
+	{
+		const uint32_t dOut = (tx_data == nullptr) ? 0xFFFFFFFF
+								: (wordBytes == 2) ? (uint32_t)static_cast<const uint16_t*>(tx_data)[i]
+									: static_cast<const uint32_t*>(tx_data)[i];
+		uint32_t dIn = 0;
+		for (unsigned int frame = framesPerWord; frame != 0; )
+		{
+			--frame;
+			if (WaitForTxReady())
+			{
+				return SPI_ERROR_TIMEOUT;
+			}
+			WriteData((dOut >> (frame * frameBits)) & frameMask, i + 1 == len && frame == 0);
+
+			// We always wait for the received data, so that the receiver doesn't overrun
+			if (WaitForRxReady())
+			{
+				return SPI_ERROR_TIMEOUT;
+			}
+			dIn = (dIn << frameBits) | (ReadData() & frameMask);
+		}
+
+		if (rx_data != nullptr)
+		{
+			if (wordBytes == 2)
+			{
+				static_cast<uint16_t*>(rx_data)[i] = (uint16_t)dIn;
+			}
+			else
+			{
+				static_cast<uint32_t*>(rx_data)[i] = dIn;
+			}
+		}
+	}
+
+	return SPI_OK;
+}
+
+// Send and receive a sequence of 16-bit words
+spi_status_t SharedSpiBus::TransceivePacket16(const uint16_t *tx_data, uint16_t *rx_data, size_t len)
+{
+	return TransceiveWordsPolled(tx_data, rx_data, len, sizeof(uint16_t));
+}
+
+// Send and receive a sequence of 32-bit words
+spi_status_t SharedSpiBus::TransceivePacket32(const uint32_t *tx_data, uint32_t *rx_data, size_t len)
+{
+	return TransceiveWordsPolled(tx_data, rx_data, len, sizeof(uint32_t));
+}
+
+// End
@@ -0,0 +1,139 @@
+/**
+ * \file
+ *
+ * \brief Shared SPI bus class
+ *
+ * Each SharedSpiBus instance drives one SPI peripheral or one USART in SPI master mode, with its own lock, DMA channels, device settings cache and transaction queue.
+ * Instances are independent, so slow devices can be moved to a second bus and run at the same time as devices on the first one.
+ * The sspi_* functions in SharedSpi.h operate on the default bus SharedSpi.
+ *
+ */
+
+#ifndef SHAREDSPIBUS_H_
+#define SHAREDSPIBUS_H_
+
+#include "SharedSpi.h"
+
+#if SAME70
+# define SSPI_XDMAC		1			// the SPI and the USARTs use XDMAC channels chosen by the application
+#elif SAM4E || SAM4S
+# define SSPI_PDC		1			// the SPI and the USARTs have their own PDC channels
+#endif
+
+class SharedSpiBus
+{
+public:
+	// Bind the bus to an SPI peripheral, or to a USART that will be used in SPI master mode
+	SharedSpiBus(Spi *p_spi, uint32_t p_peripheralId, Pin p_sckPin, Pin p_mosiPin, Pin p_misoPin);
+	SharedSpiBus(Usart *p_usart, uint32_t p_peripheralId, Pin p_sckPin, Pin p_mosiPin, Pin p_misoPin);
+
+	// Direct use of the bus. SetupDevice or Select claims the bus from the transaction queue and Deselect releases it.
+	void InitDevice(struct sspi_device *device, uint32_t bits);
+	void SetupDevice(const struct sspi_device *device);
+	void Select(const struct sspi_device *device);
+	void Deselect(const struct sspi_device *device);
+	spi_status_t TransceivePacket(const uint8_t *tx_data, uint8_t *rx_data, size_t len);
+	spi_status_t StartTransceivePacket(const uint8_t *tx_data, uint8_t *rx_data, size_t len);
+	bool IsTransceiveComplete() const;
+	spi_status_t WaitTransceiveComplete();
+	uint32_t GetActualFrequency(const struct sspi_device *device) const;
+
+	// Word transfers, most significant byte first. A 16-bit word is one frame if the device was initialised for 16 bits on an SPI peripheral, otherwise it is sent as two bytes.
+	spi_status_t TransceivePacket16(const uint16_t *tx_data, uint16_t *rx_data, size_t len);
+	spi_status_t TransceivePacket32(const uint32_t *tx_data, uint32_t *rx_data, size_t len);
+
+#if SSPI_XDMAC
+	bool EnableDma(uint8_t txChannel, uint8_t rxChannel);
+#elif SSPI_PDC
+	bool EnableDma();
+#endif
+#if SSPI_XDMAC || SSPI_PDC
+	void SetDmaThreshold(size_t bytes);
+#endif
+
+	// Transaction queue
+	bool QueueTransaction(struct sspi_transaction *t);
+	void PollQueue();
+	void GetQueueStats(struct sspi_queue_stats *stats, bool clear);
+
+	// Call this from the peripheral's interrupt handler (SAM4E/SAM4S), or from the XDMAC interrupt handler when the receive channel interrupts (SAME70)
+	void Interrupt();
+
+private:
+	SharedSpiBus(Spi *p_spi, Usart *p_usart, uint32_t p_peripheralId, Pin p_sckPin, Pin p_mosiPin, Pin p_misoPin);
+
+	void Init();
+	uint32_t GetClockDivisor(uint32_t frequency) const;
+	void ConfigureDevice(const struct sspi_device *device);
+	void AssertCs(const struct sspi_device *device);
+	void ReleaseCs(const struct sspi_device *device);
+	void ClaimBus(const struct sspi_device *device);
+	void RunQueue();
+	void FinishTransaction(spi_status_t status);
+	spi_status_t TransceivePacketPolled(const uint8_t *tx_data, uint8_t *rx_data, size_t len);
+	spi_status_t TransceiveWordsPolled(const void *tx_data, void *rx_data, size_t len, size_t wordBytes);
+
+	bool IsTxReady() const;
+	bool IsTxEmpty() const;
+	bool IsRxReady() const;
+	bool WaitForTxReady() const;
+	bool WaitForTxEmpty() const;
+	bool WaitForRxReady() const;
+	void WriteData(uint32_t data, bool last);
+	uint32_t ReadData();
+	void ClearReceiver();
+
+#if SSPI_XDMAC || SSPI_PDC
+	void StartDma(const uint8_t *tx_data, uint8_t *rx_data, size_t len, bool useInterrupt);
+	bool IsDmaComplete() const;
+	void StopDma();
+# if SSPI_XDMAC
+	void StartXdmac(uint8_t channel, bool toPeripheral, const void *mem, bool fixedMem, size_t len);
+# else
+	Pdc *GetPdc() const;
+	void EnableInterrupts(uint32_t usartMask, uint32_t spiMask);
+	void DisableDmaInterrupts();
+# endif
+#endif
+
+	Spi * const spi;							// the SPI peripheral, or nullptr if we are using a USART
+	Usart * const usart;						// the USART, or nullptr if we are using an SPI peripheral
+	const uint32_t peripheralId;
+	const Pin sckPin, mosiPin, misoPin;
+	bool initDone;
+
+	// Device settings cache
+	uint32_t csrValue;							// the settings in the SPI chip select register we use, zero if not set yet because SCBR must be nonzero
+	bool frames16Bit;							// true if the current device uses 16-bit frames
+
+	spi_status_t asyncStatus;					// the result of the last transfer started by StartTransceivePacket
+
+#if SSPI_XDMAC || SSPI_PDC
+	bool dmaEnabled;
+	size_t dmaThreshold;
+	uint32_t clockFrequency;					// the clock frequency of the current device, used to calculate DMA timeouts
+# if SSPI_XDMAC
+	uint8_t txDmaChannel, rxDmaChannel;
+	uint8_t txDmaPeripheralId, rxDmaPeripheralId;
+# endif
+
+	// State of the current DMA transfer
+	bool dmaInProgress;
+	uint8_t *dmaRxData;
+	size_t dmaLength;
+	uint32_t dmaStartTime, dmaTimeout;
+#endif
+
+	// Transaction queue
+	sspi_transaction *queueHead;				// queued transactions in priority order
+	sspi_transaction *currentTransaction;		// the queued transaction in progress
+	volatile bool busClaimed;					// true if a caller is using the bus directly, so queued transactions and other devices must wait
+	const struct sspi_device *claimingDevice;	// the device that claimed the bus
+	size_t queueLength;
+	sspi_queue_stats queueStats;
+	uint32_t queueStatsStartTime;
+};
+
+extern SharedSpiBus SharedSpi;
+
+#endif /* SHAREDSPIBUS_H_ */
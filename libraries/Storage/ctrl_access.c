@@ -61,6 +61,7 @@
 
 #include "compiler.h"
 #include "preprocessor.h"
+#include <string.h>
 #ifdef FREERTOS_USED
 #include "FreeRTOS.h"
 #include "semphr.h"
@@ -128,6 +129,7 @@ static xSemaphoreHandle ctrl_access_semphr = NULL;
     TPASTE3(Lun_, lun, _unload),\
     TPASTE3(Lun_, lun, _wr_protect),\
     TPASTE3(Lun_, lun, _removal),\
+    TPASTE3(Lun_, lun, _generation),\
     TPASTE3(Lun_, lun, _usb_read_10),\
     TPASTE3(Lun_, lun, _usb_write_10),\
     TPASTE3(Lun_, lun, _mem_2_ram),\
@@ -142,6 +144,7 @@ static xSemaphoreHandle ctrl_access_semphr = NULL;
     TPASTE3(Lun_, lun, _unload),\
     TPASTE3(Lun_, lun, _wr_protect),\
     TPASTE3(Lun_, lun, _removal),\
+    TPASTE3(Lun_, lun, _generation),\
     TPASTE3(Lun_, lun, _usb_read_10),\
     TPASTE3(Lun_, lun, _usb_write_10),\
     TPASTE3(LUN_, lun, _NAME)\
@@ -154,6 +157,7 @@ static xSemaphoreHandle ctrl_access_semphr = NULL;
     TPASTE3(Lun_, lun, _unload),\
     TPASTE3(Lun_, lun, _wr_protect),\
     TPASTE3(Lun_, lun, _removal),\
+    TPASTE3(Lun_, lun, _generation),\
     TPASTE3(Lun_, lun, _mem_2_ram),\
     TPASTE3(Lun_, lun, _ram_2_mem),\
     TPASTE3(LUN_, lun, _NAME)\
@@ -166,6 +170,7 @@ static xSemaphoreHandle ctrl_access_semphr = NULL;
     TPASTE3(Lun_, lun, _unload),\
     TPASTE3(Lun_, lun, _wr_protect),\
     TPASTE3(Lun_, lun, _removal),\
+    TPASTE3(Lun_, lun, _generation),\
     TPASTE3(LUN_, lun, _NAME)\
   }
 #endif
@@ -178,6 +183,7 @@ static const struct
   bool (*unload)(bool);
   bool (*wr_protect)(void);
   bool (*removal)(void);
+  U32 (*generation)(void);  //!< Changes whenever the medium may have been changed, or NULL if the LUN can't tell.
 #if ACCESS_USB == true
   Ctrl_status (*usb_read_10)(U32, U16);
   Ctrl_status (*usb_write_10)(U32, U16);
@@ -192,48 +198,72 @@ static const struct
 #if LUN_0 == ENABLE
 # ifndef Lun_0_unload
 #  define Lun_0_unload NULL
+# endif
+# ifndef Lun_0_generation
+#  define Lun_0_generation NULL
 # endif
   Lun_desc_entry(0),
 #endif
 #if LUN_1 == ENABLE
 # ifndef Lun_1_unload
 #  define Lun_1_unload NULL
+# endif
+# ifndef Lun_1_generation
+#  define Lun_1_generation NULL
 # endif
   Lun_desc_entry(1),
 #endif
 #if LUN_2 == ENABLE
 # ifndef Lun_2_unload
 #  define Lun_2_unload NULL
+# endif
+# ifndef Lun_2_generation
+#  define Lun_2_generation NULL
 # endif
   Lun_desc_entry(2),
 #endif
 #if LUN_3 == ENABLE
 # ifndef Lun_3_unload
 #  define Lun_3_unload NULL
+# endif
+# ifndef Lun_3_generation
+#  define Lun_3_generation NULL
 # endif
   Lun_desc_entry(3),
 #endif
 #if LUN_4 == ENABLE
 # ifndef Lun_4_unload
 #  define Lun_4_unload NULL
+# endif
+# ifndef Lun_4_generation
+#  define Lun_4_generation NULL
 # endif
   Lun_desc_entry(4),
 #endif
 #if LUN_5 == ENABLE
 # ifndef Lun_5_unload
 #  define Lun_5_unload NULL
+# endif
+# ifndef Lun_5_generation
+#  define Lun_5_generation NULL
 # endif
   Lun_desc_entry(5),
 #endif
 #if LUN_6 == ENABLE
 # ifndef Lun_6_unload
 #  define Lun_6_unload NULL
+# endif
+# ifndef Lun_6_generation
+#  define Lun_6_generation NULL
 # endif
   Lun_desc_entry(6),
 #endif
 #if LUN_7 == ENABLE
 # ifndef Lun_7_unload
 #  define Lun_7_unload NULL
+# endif
+# ifndef Lun_7_generation
+#  define Lun_7_generation NULL
 # endif
   Lun_desc_entry(7)
 #endif
@@ -247,6 +277,379 @@ bool g_wr_protect;
 #endif
 
 
+#if ACCESS_MEM_TO_RAM == true && ACCESS_CACHE_SECTORS && MAX_LUN
+
+/*! \name Sector Cache
+ *
+ * Single-sector transfers of the static LUNs go through a set of cached sectors,
+ * with the least recently used one replaced on a miss. This keeps the FAT and
+ * directory sectors that the file system reads over and over in RAM.
+ *
+ * When single-sector reads are sequential, the next sectors are read with the
+ * same command into a separate read-ahead window, so streaming a file does not
+ * evict the cached sectors.
+ *
+ * Multi-sector transfers go straight to the memory, with the cache kept
+ * consistent with them.
+ */
+//! @{
+
+//! Cached sector.
+static struct
+{
+  U32 addr;       //!< Address of the sector.
+  U32 last_used;  //!< Value of ctrl_cache_clock when the sector was last used.
+  U8 lun;         //!< Logical Unit Number.
+  bool valid;     //!< The entry holds a sector.
+  bool dirty;     //!< The sector has been written to the cache but not yet to the memory.
+} ctrl_cache_entry[ACCESS_CACHE_SECTORS];
+
+//! Data of the cached sectors.
+COMPILER_WORD_ALIGNED
+static U8 ctrl_cache_data[ACCESS_CACHE_SECTORS][SECTOR_SIZE];
+
+//! Incremented on each access, to find the least recently used sector.
+static U32 ctrl_cache_clock;
+
+//! Generation of the medium of each LUN when its sectors were cached.
+static U32 ctrl_cache_generation[MAX_LUN];
+
+#if ACCESS_CACHE_READ_AHEAD > 1
+
+//! Sectors read by the last sequential read.
+COMPILER_WORD_ALIGNED
+static U8 ctrl_cache_window_data[ACCESS_CACHE_READ_AHEAD][SECTOR_SIZE];
+
+static U32 ctrl_cache_window_addr;      //!< Address of the first sector in the read-ahead window.
+static U32 ctrl_cache_window_count;     //!< Number of sectors in the read-ahead window, 0 if it is empty.
+static U8 ctrl_cache_window_lun;        //!< Logical Unit Number of the sectors in the read-ahead window.
+
+//! Address following the last single-sector read of each LUN, to detect sequential reads.
+static U32 ctrl_cache_next_addr[MAX_LUN];
+
+//! Address of the last sector of each LUN, or 0 if it has not been read yet.
+static U32 ctrl_cache_last_sector[MAX_LUN];
+
+#endif
+
+static Ctrl_cache_stats ctrl_cache_stats;
+
+//! @}
+
+#endif
+
+
+#if ACCESS_MEM_TO_RAM == true
+
+/*! \brief Copies sectors from a LUN to RAM without using the cache.
+ */
+static Ctrl_status ctrl_mem_2_ram(U8 lun, U32 addr, void *ram, uint32_t numBlocks)
+{
+#if MAX_LUN==0
+  UNUSED(lun);
+#endif
+  return
+#if MAX_LUN
+         (lun < MAX_LUN) ? lun_desc[lun].mem_2_ram(addr, ram, numBlocks) :
+#endif
+#if LUN_USB == ENABLE
+                           Lun_usb_mem_2_ram(addr, ram, numBlocks);
+#else
+                           CTRL_FAIL;
+#endif
+}
+
+
+/*! \brief Copies sectors from RAM to a LUN without using the cache.
+ */
+static Ctrl_status ctrl_ram_2_mem(U8 lun, U32 addr, const void *ram, uint32_t numBlocks)
+{
+#if MAX_LUN==0
+  UNUSED(lun);
+#endif
+  return
+#if MAX_LUN
+         (lun < MAX_LUN) ? lun_desc[lun].ram_2_mem(addr, ram, numBlocks) :
+#endif
+#if LUN_USB == ENABLE
+                           Lun_usb_ram_2_mem(addr, ram, numBlocks);
+#else
+                           CTRL_FAIL;
+#endif
+}
+
+#endif  // ACCESS_MEM_TO_RAM == true
+
+
+#if ACCESS_MEM_TO_RAM == true && ACCESS_CACHE_SECTORS && MAX_LUN
+
+/*! \brief Returns the index of the cache entry holding a sector, or -1.
+ */
+static int ctrl_cache_find(U8 lun, U32 addr)
+{
+  for (int i = 0; i < ACCESS_CACHE_SECTORS; i++)
+  {
+    if (ctrl_cache_entry[i].valid && ctrl_cache_entry[i].lun == lun && ctrl_cache_entry[i].addr == addr) return i;
+  }
+  return -1;
+}
+
+
+/*! \brief Writes a dirty cached sector to the memory.
+ */
+static Ctrl_status ctrl_cache_write_back(int i)
+{
+  if (!ctrl_cache_entry[i].dirty) return CTRL_GOOD;
+
+  const Ctrl_status status = ctrl_ram_2_mem(ctrl_cache_entry[i].lun, ctrl_cache_entry[i].addr, ctrl_cache_data[i], 1);
+  if (status == CTRL_GOOD)
+  {
+    ctrl_cache_entry[i].dirty = false;
+    ctrl_cache_stats.write_backs++;
+  }
+  return status;
+}
+
+
+/*! \brief Frees the least recently used cache entry, writing it back first if it is dirty.
+ *
+ * \return Index of the entry, or -1 if the write back failed.
+ */
+static int ctrl_cache_alloc(void)
+{
+  int victim = 0;
+  for (int i = 0; i < ACCESS_CACHE_SECTORS; i++)
+  {
+    if (!ctrl_cache_entry[i].valid)
+    {
+      return i;
+    }
+    if (ctrl_cache_entry[i].last_used < ctrl_cache_entry[victim].last_used)
+    {
+      victim = i;
+    }
+  }
+
+  if (ctrl_cache_write_back(victim) != CTRL_GOOD) return -1;
+  ctrl_cache_entry[victim].valid = false;
+  return victim;
+}
+
+
+/*! \brief Discards the cached sectors of a LUN, including any that are dirty.
+ *
+ * This is used when the medium has been removed or changed.
+ */
+static void ctrl_cache_invalidate(U8 lun)
+{
+  for (int i = 0; i < ACCESS_CACHE_SECTORS; i++)
+  {
+    if (ctrl_cache_entry[i].lun == lun)
+    {
+      ctrl_cache_entry[i].valid = false;
+      ctrl_cache_entry[i].dirty = false;
+    }
+  }
+#if ACCESS_CACHE_READ_AHEAD > 1
+  if (ctrl_cache_window_lun == lun) ctrl_cache_window_count = 0;
+  ctrl_cache_next_addr[lun] = 0;
+  ctrl_cache_last_sector[lun] = 0;
+#endif
+}
+
+
+/*! \brief Discards the cached sectors of each LUN whose medium has changed since they were cached.
+ *
+ * Applications usually detect a new card through the driver rather than
+ * through mem_test_unit_ready(), so the LUN driver reports a generation
+ * number that changes each time the medium is initialised. All the LUNs are
+ * checked, because a miss on one LUN may write back a sector of another.
+ */
+static void ctrl_cache_check_generations(void)
+{
+  for (U8 lun = 0; lun < MAX_LUN; lun++)
+  {
+    if (lun_desc[lun].generation != NULL)
+    {
+      const U32 generation = lun_desc[lun].generation();
+      if (generation != ctrl_cache_generation[lun])
+      {
+        ctrl_cache_invalidate(lun);
+        ctrl_cache_generation[lun] = generation;
+      }
+    }
+  }
+}
+
+
+/*! \brief Writes the dirty cached sectors of a LUN to the memory.
+ */
+static Ctrl_status ctrl_cache_sync(U8 lun)
+{
+  Ctrl_status status = CTRL_GOOD;
+
+  for (int i = 0; i < ACCESS_CACHE_SECTORS; i++)
+  {
+    if (ctrl_cache_entry[i].valid && ctrl_cache_entry[i].lun == lun)
+    {
+      const Ctrl_status entry_status = ctrl_cache_write_back(i);
+      if (entry_status != CTRL_GOOD) status = entry_status;
+    }
+  }
+  return status;
+}
+
+
+/*! \brief Makes the cached copies of sectors that have just been written to the memory match it.
+ *
+ * \param dirty \c true if the sectors were written to the cache only.
+ */
+static void ctrl_cache_update(U8 lun, U32 addr, const void *ram, uint32_t numBlocks, bool dirty)
+{
+  for (int i = 0; i < ACCESS_CACHE_SECTORS; i++)
+  {
+    if (ctrl_cache_entry[i].valid && ctrl_cache_entry[i].lun == lun && ctrl_cache_entry[i].addr - addr < numBlocks)
+    {
+      memcpy(ctrl_cache_data[i], (const U8 *)ram + (ctrl_cache_entry[i].addr - addr) * SECTOR_SIZE, SECTOR_SIZE);
+      ctrl_cache_entry[i].dirty = dirty;
+    }
+  }
+#if ACCESS_CACHE_READ_AHEAD > 1
+  if (ctrl_cache_window_lun == lun)
+  {
+    for (U32 n = 0; n < ctrl_cache_window_count; n++)
+    {
+      if (ctrl_cache_window_addr + n - addr < numBlocks)
+      {
+        memcpy(ctrl_cache_window_data[n], (const U8 *)ram + (ctrl_cache_window_addr + n - addr) * SECTOR_SIZE, SECTOR_SIZE);
+      }
+    }
+  }
+#endif
+}
+
+
+#if ACCESS_CACHE_READ_AHEAD > 1
+
+/*! \brief Reads a sector and the ones that follow it into the read-ahead window.
+ *
+ * \return \c true if the sector is now in the window.
+ */
+static bool ctrl_cache_read_ahead(U8 lun, U32 addr)
+{
+  if (ctrl_cache_last_sector[lun] == 0 && lun_desc[lun].read_capacity(&ctrl_cache_last_sector[lun]) != CTRL_GOOD)
+  {
+    ctrl_cache_last_sector[lun] = 0;
+    return false;
+  }
+  if (addr >= ctrl_cache_last_sector[lun]) return false;
+
+  const U32 count = Min(ACCESS_CACHE_READ_AHEAD, ctrl_cache_last_sector[lun] - addr + 1);
+  ctrl_cache_window_count = 0;
+  if (ctrl_mem_2_ram(lun, addr, ctrl_cache_window_data, count) != CTRL_GOOD) return false;
+
+  // Sectors written to the cache but not yet to the memory are newer than the ones just read
+  for (int i = 0; i < ACCESS_CACHE_SECTORS; i++)
+  {
+    if (ctrl_cache_entry[i].valid && ctrl_cache_entry[i].lun == lun && ctrl_cache_entry[i].dirty && ctrl_cache_entry[i].addr - addr < count)
+    {
+      memcpy(ctrl_cache_window_data[ctrl_cache_entry[i].addr - addr], ctrl_cache_data[i], SECTOR_SIZE);
+    }
+  }
+
+  ctrl_cache_window_lun = lun;
+  ctrl_cache_window_addr = addr;
+  ctrl_cache_window_count = count;
+  ctrl_cache_stats.read_ahead += count - 1;
+  return true;
+}
+
+#endif
+
+
+/*! \brief Copies 1 sector from the memory to RAM through the cache.
+ */
+static Ctrl_status ctrl_cache_mem_2_ram(U8 lun, U32 addr, void *ram)
+{
+  int i = ctrl_cache_find(lun, addr);
+  if (i >= 0)
+  {
+    ctrl_cache_stats.hits++;
+  }
+  else
+  {
+#if ACCESS_CACHE_READ_AHEAD > 1
+    const bool sequential = (addr == ctrl_cache_next_addr[lun]);
+    ctrl_cache_next_addr[lun] = addr + 1;
+
+    if (ctrl_cache_window_lun == lun && addr - ctrl_cache_window_addr < ctrl_cache_window_count)
+    {
+      ctrl_cache_stats.hits++;
+      memcpy(ram, ctrl_cache_window_data[addr - ctrl_cache_window_addr], SECTOR_SIZE);
+      return CTRL_GOOD;
+    }
+
+    ctrl_cache_stats.misses++;
+    if (sequential && ctrl_cache_read_ahead(lun, addr))
+    {
+      memcpy(ram, ctrl_cache_window_data[0], SECTOR_SIZE);
+      return CTRL_GOOD;
+    }
+#else
+    ctrl_cache_stats.misses++;
+#endif
+
+    i = ctrl_cache_alloc();
+    if (i < 0) return CTRL_FAIL;
+
+    const Ctrl_status status = ctrl_mem_2_ram(lun, addr, ctrl_cache_data[i], 1);
+    if (status != CTRL_GOOD) return status;
+    ctrl_cache_entry[i].lun = lun;
+    ctrl_cache_entry[i].addr = addr;
+    ctrl_cache_entry[i].valid = true;
+    ctrl_cache_entry[i].dirty = false;
+  }
+
+  ctrl_cache_entry[i].last_used = ++ctrl_cache_clock;
+  memcpy(ram, ctrl_cache_data[i], SECTOR_SIZE);
+  return CTRL_GOOD;
+}
+
+
+/*! \brief Copies 1 sector from RAM to the memory through the cache.
+ *
+ * With write-back caching the sector is only written to the memory when it is evicted or mem_sync() is called.
+ */
+static Ctrl_status ctrl_cache_ram_2_mem(U8 lun, U32 addr, const void *ram)
+{
+  int i = ctrl_cache_find(lun, addr);
+
+#if ACCESS_CACHE_WRITE_BACK != true
+  const Ctrl_status status = ctrl_ram_2_mem(lun, addr, ram, 1);
+  if (status != CTRL_GOOD)
+  {
+    // The sector in the memory may have changed, so the cached copy can't be trusted
+    if (i >= 0) ctrl_cache_entry[i].valid = false;
+    return status;
+  }
+#endif
+
+  if (i < 0)
+  {
+    i = ctrl_cache_alloc();
+    if (i < 0) return CTRL_FAIL;
+    ctrl_cache_entry[i].lun = lun;
+    ctrl_cache_entry[i].addr = addr;
+    ctrl_cache_entry[i].valid = true;
+  }
+  ctrl_cache_entry[i].last_used = ++ctrl_cache_clock;
+  ctrl_cache_update(lun, addr, ram, 1, ACCESS_CACHE_WRITE_BACK == true);
+  return CTRL_GOOD;
+}
+
+#endif  // ACCESS_MEM_TO_RAM == true && ACCESS_CACHE_SECTORS && MAX_LUN
+
+
 /*! \name Control Interface
  */
 //! @{
@@ -331,6 +734,11 @@ Ctrl_status mem_test_unit_ready(U8 lun)
                              CTRL_FAIL;
 #endif
 
+#if ACCESS_MEM_TO_RAM == true && ACCESS_CACHE_SECTORS && MAX_LUN
+  // The medium may have been removed or changed
+  if (status != CTRL_GOOD && lun < MAX_LUN) ctrl_cache_invalidate(lun);
+#endif
+
   Ctrl_access_unlock();
 
   return status;
@@ -390,6 +798,14 @@ bool mem_unload(U8 lun, bool unload)
 
   if (!Ctrl_access_lock()) return false;
 
+#if ACCESS_MEM_TO_RAM == true && ACCESS_CACHE_SECTORS && MAX_LUN
+  if (unload && lun < MAX_LUN)
+  {
+    ctrl_cache_sync(lun);
+    ctrl_cache_invalidate(lun);
+  }
+#endif
+
   unloaded =
 #if MAX_LUN
           (lun < MAX_LUN) ?
@@ -540,22 +956,39 @@ Ctrl_status usb_2_memory(U8 lun, U32 addr, U16 nb_sector)
 Ctrl_status memory_2_ram(U8 lun, U32 addr, void *ram, uint32_t numBlocks)
 {
   Ctrl_status status;
-#if MAX_LUN==0
-  UNUSED(lun);
-#endif
 
   if (!Ctrl_access_lock()) return CTRL_FAIL;
 
   memory_start_read_action(1);
-  status =
-#if MAX_LUN
-           (lun < MAX_LUN) ? lun_desc[lun].mem_2_ram(addr, ram, numBlocks) :
-#endif
-#if LUN_USB == ENABLE
-                             Lun_usb_mem_2_ram(addr, ram, numBlocks);
-#else
-                             CTRL_FAIL;
+#if ACCESS_CACHE_SECTORS && MAX_LUN
+  if (lun < MAX_LUN)
+  {
+    ctrl_cache_check_generations();
+    if (numBlocks == 1)
+    {
+      status = ctrl_cache_mem_2_ram(lun, addr, ram);
+    }
+    else
+    {
+      ctrl_cache_stats.direct++;
+      status = ctrl_mem_2_ram(lun, addr, ram, numBlocks);
+# if ACCESS_CACHE_WRITE_BACK == true
+      // Sectors written to the cache but not yet to the memory are newer than the ones just read
+      for (int i = 0; status == CTRL_GOOD && i < ACCESS_CACHE_SECTORS; i++)
+      {
+        if (ctrl_cache_entry[i].valid && ctrl_cache_entry[i].lun == lun && ctrl_cache_entry[i].dirty && ctrl_cache_entry[i].addr - addr < numBlocks)
+        {
+          memcpy((U8 *)ram + (ctrl_cache_entry[i].addr - addr) * SECTOR_SIZE, ctrl_cache_data[i], SECTOR_SIZE);
+        }
+      }
+# endif
+    }
+  }
+  else
 #endif
+  {
+    status = ctrl_mem_2_ram(lun, addr, ram, numBlocks);
+  }
   memory_stop_read_action();
 
   Ctrl_access_unlock();
@@ -567,22 +1000,30 @@ Ctrl_status memory_2_ram(U8 lun, U32 addr, void *ram, uint32_t numBlocks)
 Ctrl_status ram_2_memory(U8 lun, U32 addr, const void *ram, uint32_t numBlocks)
 {
   Ctrl_status status;
-#if MAX_LUN==0
-  UNUSED(lun);
-#endif
 
   if (!Ctrl_access_lock()) return CTRL_FAIL;
 
   memory_start_write_action(1);
-  status =
-#if MAX_LUN
-           (lun < MAX_LUN) ? lun_desc[lun].ram_2_mem(addr, ram, numBlocks) :
-#endif
-#if LUN_USB == ENABLE
-                             Lun_usb_ram_2_mem(addr, ram, numBlocks);
-#else
-                             CTRL_FAIL;
+#if ACCESS_CACHE_SECTORS && MAX_LUN
+  if (lun < MAX_LUN)
+  {
+    ctrl_cache_check_generations();
+    if (numBlocks == 1)
+    {
+      status = ctrl_cache_ram_2_mem(lun, addr, ram);
+    }
+    else
+    {
+      ctrl_cache_stats.direct++;
+      status = ctrl_ram_2_mem(lun, addr, ram, numBlocks);
+      if (status == CTRL_GOOD) ctrl_cache_update(lun, addr, ram, numBlocks, false);
+    }
+  }
+  else
 #endif
+  {
+    status = ctrl_ram_2_mem(lun, addr, ram, numBlocks);
+  }
   memory_stop_write_action();
 
   Ctrl_access_unlock();
@@ -591,6 +1032,49 @@ Ctrl_status ram_2_memory(U8 lun, U32 addr, const void *ram, uint32_t numBlocks)
 }
 
 
+Ctrl_status mem_sync(U8 lun)
+{
+  Ctrl_status status = CTRL_GOOD;
+#if !ACCESS_CACHE_SECTORS || !MAX_LUN
+  UNUSED(lun);
+#endif
+
+  if (!Ctrl_access_lock()) return CTRL_FAIL;
+
+#if ACCESS_CACHE_SECTORS && MAX_LUN
+  if (lun < MAX_LUN)
+  {
+    ctrl_cache_check_generations();
+    status = ctrl_cache_sync(lun);
+  }
+#endif
+
+  Ctrl_access_unlock();
+
+  return status;
+}
+
+
+void mem_get_cache_stats(Ctrl_cache_stats *stats, bool clear)
+{
+#if ACCESS_CACHE_SECTORS && MAX_LUN
+  if (!Ctrl_access_lock())
+  {
+    memset(stats, 0, sizeof(*stats));
+    return;
+  }
+
+  *stats = ctrl_cache_stats;
+  if (clear) memset(&ctrl_cache_stats, 0, sizeof(ctrl_cache_stats));
+
+  Ctrl_access_unlock();
+#else
+  UNUSED(clear);
+  memset(stats, 0, sizeof(*stats));
+#endif
+}
+
+
 //! @}
 
 #endif  // ACCESS_MEM_TO_RAM == true
@@ -80,6 +80,16 @@ extern "C" {
 #define SECTOR_SIZE  512
 #endif
 
+#ifndef ACCESS_CACHE_SECTORS
+#define ACCESS_CACHE_SECTORS     0
+#endif
+#ifndef ACCESS_CACHE_READ_AHEAD
+#define ACCESS_CACHE_READ_AHEAD  0
+#endif
+#ifndef ACCESS_CACHE_WRITE_BACK
+#define ACCESS_CACHE_WRITE_BACK  false
+#endif
+
 //! Status returned by CTRL_ACCESS interfaces.
 typedef enum
 {
@@ -337,6 +347,30 @@ extern Ctrl_status memory_2_ram(U8 lun, U32 addr, void *ram, uint32_t numBlocks)
  */
 extern Ctrl_status ram_2_memory(U8 lun, U32 addr, const void *ram, uint32_t numBlocks);
 
+//! Statistics of the sector cache.
+typedef struct
+{
+  U32 hits;         //!< Single-sector reads found in the cache.
+  U32 misses;       //!< Single-sector reads that had to access the memory.
+  U32 read_ahead;   //!< Sectors read ahead of sequential reads.
+  U32 write_backs;  //!< Dirty sectors written from the cache to the memory.
+  U32 direct;       //!< Multi-sector transfers, which do not use the cache.
+} Ctrl_cache_stats;
+
+/*! \brief Writes the sectors held in the sector cache to the memory.
+ * Call this when a file is closed or flushed, and before the medium is removed.
+ * \param lun   Logical Unit Number.
+ * \return Status.
+ * \note Only needed when ACCESS_CACHE_WRITE_BACK is \c true.
+ */
+extern Ctrl_status mem_sync(U8 lun);
+
+/*! \brief Gets the statistics of the sector cache.
+ * \param stats Pointer to the statistics to fill in.
+ * \param clear \c true to clear the statistics after reading them.
+ */
+extern void mem_get_cache_stats(Ctrl_cache_stats *stats, bool clear);
+
 //! @}
 
 #endif  // ACCESS_MEM_TO_RAM == true
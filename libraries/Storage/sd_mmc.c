@@ -201,6 +201,7 @@ struct sd_mmc_card {
 	uint8_t bus_width;			//!< Number of DATA lines on bus (MCI only)
 	uint8_t csd[CSD_REG_BSIZE];	//!< CSD register
 	uint8_t high_speed;			//!< High speed card (1)
+	uint32_t generation;		// Incremented each time the card is initialised or unmounted
 };
 
 //! SD/MMC card list
@@ -1466,13 +1467,14 @@ static bool sd_mmc_spi_card_init(void)
 			return sd_mmc_spi_install_mmc();
 		}
 
-		/* The CRC on card is disabled by default.
-		 * However, to be sure, the CRC OFF command is send.
+		/* The CRC on card is disabled by default in SPI mode.
+		 * Enable it, so that the card checks the command and data CRCs
+		 * and the driver can detect corrupted data.
 		 * Unfortunately, specific SDIO card does not support it
 		 * (H&D wireless card - HDG104 WiFi SIP)
 		 * and the command is send only on SD card.
 		 */
-		if (!sd_mmc_card->iface->send_cmd(SDMMC_SPI_CMD59_CRC_ON_OFF, 0)) {
+		if (!sd_mmc_card->iface->send_cmd(SDMMC_SPI_CMD59_CRC_ON_OFF, 1)) {
 			return false;
 		}
 	}
@@ -1656,8 +1658,8 @@ static bool sd_mmc_spi_install_mmc(void)
 		return false;
 	}
 
-	// Disable CRC check for SPI mode
-	if (!sd_mmc_card->iface->send_cmd(SDMMC_SPI_CMD59_CRC_ON_OFF, 0)) {
+	// Enable CRC check for SPI mode
+	if (!sd_mmc_card->iface->send_cmd(SDMMC_SPI_CMD59_CRC_ON_OFF, 1)) {
 		return false;
 	}
 	// Get the Card-Specific Data
@@ -1831,7 +1833,8 @@ sd_mmc_err_t sd_mmc_check(uint8_t slot)
 		return sd_mmc_err;
 	}
 
-	// Initialization of the card requested
+	// Initialization of the card requested. It may be a different card, so anything cached from the previous one is stale.
+	sd_mmc_card->generation++;
 	if (sd_mmc_card->iface->is_spi ? sd_mmc_spi_card_init() : sd_mmc_mci_card_init()) {
 		sd_mmc_debug("SD/MMC card ready\n\r");
 		sd_mmc_card->state = SD_MMC_CARD_STATE_READY;
@@ -1889,6 +1892,13 @@ bool sd_mmc_is_write_protected(uint8_t slot)
 void sd_mmc_unmount(uint8_t slot)
 {
 	sd_mmc_cards[slot].state = SD_MMC_CARD_STATE_NO_CARD;
+	sd_mmc_cards[slot].generation++;
+}
+
+// Get a number that changes whenever the card in the slot may have been changed
+uint32_t sd_mmc_get_card_generation(uint8_t slot)
+{
+	return sd_mmc_cards[slot].generation;
 }
 
 // Get the interface speed in bytes/sec
@@ -177,6 +177,9 @@ void sd_mmc_unmount(uint8_t slot);
 // Get the interface speed in bytes/sec
 uint32_t sd_mmc_get_interface_speed(uint8_t slot);
 
+// Get a number that changes whenever the card in the slot is initialised or unmounted, so that callers can tell when data they cached from it is stale
+uint32_t sd_mmc_get_card_generation(uint8_t slot);
+
 #endif
 
 /**
@@ -135,6 +135,21 @@ bool sd_mmc_unload_1(bool unload)
 	return sd_mmc_unload(1, unload);
 }
 
+uint32_t sd_mmc_generation(uint8_t slot)
+{
+	return sd_mmc_get_card_generation(slot);
+}
+
+uint32_t sd_mmc_generation_0(void)
+{
+	return sd_mmc_generation(0);
+}
+
+uint32_t sd_mmc_generation_1(void)
+{
+	return sd_mmc_generation(1);
+}
+
 bool sd_mmc_wr_protect(uint8_t slot)
 {
 	return sd_mmc_is_write_protected(slot);
@@ -175,16 +190,43 @@ bool sd_mmc_removal_1(void)
 
 #include "udi_msc.h"
 
-COMPILER_WORD_ALIGNED
-uint8_t sector_buf_0[SD_MMC_BLOCK_SIZE];
+#ifndef SD_MMC_USB_NB_CHUNKS
+//! Number of buffers in the pipeline between the card and USB
+# define SD_MMC_USB_NB_CHUNKS       4
+#endif
+
+#ifndef SD_MMC_USB_CHUNK_SECTORS
+//! Number of sectors in each buffer, so 4KB per buffer by default
+# define SD_MMC_USB_CHUNK_SECTORS   8
+#endif
 
 COMPILER_WORD_ALIGNED
-uint8_t sector_buf_1[SD_MMC_BLOCK_SIZE];
+static uint8_t sd_mmc_usb_chunks[SD_MMC_USB_NB_CHUNKS][SD_MMC_USB_CHUNK_SECTORS * SD_MMC_BLOCK_SIZE];
+
+//! Number of sectors held in each buffer
+static uint16_t sd_mmc_usb_chunk_nb_sector[SD_MMC_USB_NB_CHUNKS];
+
+//! Waits for a USB transfer to finish, so that we don't return while it is still using a buffer
+static void sd_mmc_usb_wait_trans(bool b_usb_busy)
+{
+	bool b_aborted;
+
+	if (b_usb_busy) {
+		while (!udi_msc_is_trans_block_done(&b_aborted)) {
+		}
+	}
+}
 
 Ctrl_status sd_mmc_usb_read_10(uint8_t slot, uint32_t addr, uint16_t nb_sector)
 {
-	bool b_first_step = true;
-	uint16_t nb_step;
+	uint16_t nb_sector_to_read = nb_sector;   // sectors not yet read from the card
+	uint16_t nb_sector_to_send = nb_sector;   // sectors not yet sent to USB
+	uint8_t chunk_read = 0;                   // next buffer to fill from the card
+	uint8_t chunk_send = 0;                   // next buffer to send to USB
+	uint8_t nb_chunk_ready = 0;               // buffers filled but not yet completely sent
+	bool b_usb_busy = false;
+	bool b_aborted;
+	uint16_t nb;
 
 	switch (sd_mmc_init_read_blocks(slot, addr, nb_sector)) {
 	case SD_MMC_OK:
@@ -194,37 +236,46 @@ Ctrl_status sd_mmc_usb_read_10(uint8_t slot, uint32_t addr, uint16_t nb_sector)
 	default:
 		return CTRL_FAIL;
 	}
-	// Pipeline the 2 transfer in order to speed-up the performances
-	nb_step = nb_sector + 1;
-	while (nb_step--) {
-		if (nb_step) { // Skip last step
-			// MCI -> RAM
-			if (SD_MMC_OK != sd_mmc_start_read_blocks(((nb_step % 2) == 0) ?
-					sector_buf_0 : sector_buf_1, 1)) {
+	// Pipeline the transfers through a ring of multi-sector buffers in order to speed-up the performances.
+	// The card keeps streaming the whole command (CMD18) while USB sends the buffers that are already full.
+	while (nb_sector_to_send != 0) {
+		if (b_usb_busy && udi_msc_is_trans_block_done(&b_aborted)) {
+			b_usb_busy = false;
+			if (b_aborted) {
+				if (nb_sector_to_read != 0) {
+					sd_mmc_wait_end_of_read_blocks(true);
+				}
 				return CTRL_FAIL;
 			}
+			nb_sector_to_send -= sd_mmc_usb_chunk_nb_sector[chunk_send];
+			chunk_send = (chunk_send + 1) % SD_MMC_USB_NB_CHUNKS;
+			nb_chunk_ready--;
 		}
-		if (!b_first_step) { // Skip first step
+		if (!b_usb_busy && nb_chunk_ready != 0) {
 			// RAM -> USB
-			if (!udi_msc_trans_block(true,
-					((nb_step % 2) == 0) ?
-					sector_buf_1 : sector_buf_0,
-					SD_MMC_BLOCK_SIZE,
-					NULL)) {
-				if (!b_first_step) {
+			if (!udi_msc_start_trans_block(true,
+					sd_mmc_usb_chunks[chunk_send],
+					sd_mmc_usb_chunk_nb_sector[chunk_send] * SD_MMC_BLOCK_SIZE)) {
+				if (nb_sector_to_read != 0) {
 					sd_mmc_wait_end_of_read_blocks(true);
 				}
 				return CTRL_FAIL;
 			}
-		} else {
-			b_first_step = false;
+			b_usb_busy = true;
 		}
-		if (nb_step) { // Skip last step
-			if (SD_MMC_OK != sd_mmc_wait_end_of_read_blocks(false)) {
+		if (nb_sector_to_read != 0 && nb_chunk_ready < SD_MMC_USB_NB_CHUNKS) {
+			// MCI -> RAM, while USB sends the previous buffers
+			nb = Min(nb_sector_to_read, SD_MMC_USB_CHUNK_SECTORS);
+			if (SD_MMC_OK != sd_mmc_start_read_blocks(sd_mmc_usb_chunks[chunk_read], nb)
+					|| SD_MMC_OK != sd_mmc_wait_end_of_read_blocks(false)) {
+				sd_mmc_usb_wait_trans(b_usb_busy);
 				return CTRL_FAIL;
 			}
+			sd_mmc_usb_chunk_nb_sector[chunk_read] = nb;
+			nb_sector_to_read -= nb;
+			chunk_read = (chunk_read + 1) % SD_MMC_USB_NB_CHUNKS;
+			nb_chunk_ready++;
 		}
-		b_first_step = false;
 	}
 	return CTRL_GOOD;
 }
@@ -241,8 +292,15 @@ Ctrl_status sd_mmc_usb_read_10_1(uint32_t addr, uint16_t nb_sector)
 
 Ctrl_status sd_mmc_usb_write_10(uint8_t slot, uint32_t addr, uint16_t nb_sector)
 {
-	bool b_first_step = true;
-	uint16_t nb_step;
+	uint16_t nb_sector_to_receive = nb_sector;    // sectors not yet requested from USB
+	uint16_t nb_sector_to_write = nb_sector;      // sectors not yet written to the card
+	uint8_t chunk_receive = 0;                    // next buffer to fill from USB
+	uint8_t chunk_write = 0;                      // next buffer to write to the card
+	uint8_t nb_chunk_used = 0;                    // buffers being filled or waiting to be written
+	uint8_t nb_chunk_ready = 0;                   // buffers waiting to be written
+	bool b_usb_busy = false;
+	bool b_aborted;
+	uint16_t nb;
 
 	switch (sd_mmc_init_write_blocks(slot, addr, nb_sector)) {
 	case SD_MMC_OK:
@@ -252,35 +310,48 @@ Ctrl_status sd_mmc_usb_write_10(uint8_t slot, uint32_t addr, uint16_t nb_sector)
 	default:
 		return CTRL_FAIL;
 	}
-	// Pipeline the 2 transfer in order to speed-up the performances
-	nb_step = nb_sector + 1;
-	while (nb_step--) {
-		if (!b_first_step) { // Skip first step
-			// RAM -> MCI
-			if (SD_MMC_OK != sd_mmc_start_write_blocks(((nb_step % 2) == 0) ?
-					sector_buf_0 : sector_buf_1, 1)) {
+	// Pipeline the transfers through a ring of multi-sector buffers in order to speed-up the performances.
+	// The card keeps the whole command (CMD25) open while USB fills the next buffers.
+	while (nb_sector_to_write != 0) {
+		if (b_usb_busy && udi_msc_is_trans_block_done(&b_aborted)) {
+			b_usb_busy = false;
+			if (b_aborted) {
+				if (nb_sector_to_write != nb_sector) {
+					sd_mmc_wait_end_of_write_blocks(true);
+				}
 				return CTRL_FAIL;
 			}
+			chunk_receive = (chunk_receive + 1) % SD_MMC_USB_NB_CHUNKS;
+			nb_chunk_ready++;
 		}
-		if (nb_step) { // Skip last step
+		if (!b_usb_busy && nb_sector_to_receive != 0 && nb_chunk_used < SD_MMC_USB_NB_CHUNKS) {
 			// USB -> RAM
-			if (!udi_msc_trans_block(false,
-					((nb_step % 2) == 0) ?
-					sector_buf_1 : sector_buf_0,
-					SD_MMC_BLOCK_SIZE,
-					NULL)) {
-				if (!b_first_step) {
+			nb = Min(nb_sector_to_receive, SD_MMC_USB_CHUNK_SECTORS);
+			if (!udi_msc_start_trans_block(false,
+					sd_mmc_usb_chunks[chunk_receive],
+					nb * SD_MMC_BLOCK_SIZE)) {
+				if (nb_sector_to_write != nb_sector) {
 					sd_mmc_wait_end_of_write_blocks(true);
 				}
 				return CTRL_FAIL;
 			}
+			sd_mmc_usb_chunk_nb_sector[chunk_receive] = nb;
+			nb_sector_to_receive -= nb;
+			nb_chunk_used++;
+			b_usb_busy = true;
 		}
-		if (!b_first_step) { // Skip first step
-			if (SD_MMC_OK != sd_mmc_wait_end_of_write_blocks(false)) {
+		if (nb_chunk_ready != 0) {
+			// RAM -> MCI, while USB receives the next buffer
+			nb = sd_mmc_usb_chunk_nb_sector[chunk_write];
+			if (SD_MMC_OK != sd_mmc_start_write_blocks(sd_mmc_usb_chunks[chunk_write], nb)
+					|| SD_MMC_OK != sd_mmc_wait_end_of_write_blocks(false)) {
+				sd_mmc_usb_wait_trans(b_usb_busy);
 				return CTRL_FAIL;
 			}
-		} else {
-			b_first_step = false;
+			nb_sector_to_write -= nb;
+			chunk_write = (chunk_write + 1) % SD_MMC_USB_NB_CHUNKS;
+			nb_chunk_ready--;
+			nb_chunk_used--;
 		}
 	}
 	return CTRL_GOOD;
@@ -304,7 +375,13 @@ Ctrl_status sd_mmc_usb_write_10_1(uint32_t addr, uint16_t nb_sector)
  * \name MEM <-> RAM Interface
  * @{
  */
-Ctrl_status sd_mmc_mem_2_ram(uint8_t slot, uint32_t addr, void *ram, uint32_t numBlocks)
+
+#ifndef SD_MMC_MEM_NB_RETRIES
+//! Number of times a failed transfer is retried. The SPI driver reduces the clock after a CRC error, so the retries run slower.
+# define SD_MMC_MEM_NB_RETRIES      3
+#endif
+
+static Ctrl_status sd_mmc_mem_2_ram_attempt(uint8_t slot, uint32_t addr, void *ram, uint32_t numBlocks)
 {
 	switch (sd_mmc_init_read_blocks(slot, addr, numBlocks)) {
 	case SD_MMC_OK:
@@ -315,6 +392,8 @@ Ctrl_status sd_mmc_mem_2_ram(uint8_t slot, uint32_t addr, void *ram, uint32_t nu
 		return CTRL_FAIL;
 	}
 	if (SD_MMC_OK != sd_mmc_start_read_blocks(ram, numBlocks)) {
+		// Stop the transfer and release the card
+		sd_mmc_wait_end_of_read_blocks(true);
 		return CTRL_FAIL;
 	}
 	if (SD_MMC_OK != sd_mmc_wait_end_of_read_blocks(false)) {
@@ -323,6 +402,16 @@ Ctrl_status sd_mmc_mem_2_ram(uint8_t slot, uint32_t addr, void *ram, uint32_t nu
 	return CTRL_GOOD;
 }
 
+Ctrl_status sd_mmc_mem_2_ram(uint8_t slot, uint32_t addr, void *ram, uint32_t numBlocks)
+{
+	Ctrl_status status;
+	uint8_t retries = SD_MMC_MEM_NB_RETRIES;
+	do {
+		status = sd_mmc_mem_2_ram_attempt(slot, addr, ram, numBlocks);
+	} while (status == CTRL_FAIL && retries-- != 0);
+	return status;
+}
+
 Ctrl_status sd_mmc_mem_2_ram_0(uint32_t addr, void *ram, uint32_t numBlocks)
 {
 	return sd_mmc_mem_2_ram(0, addr, ram, numBlocks);
@@ -333,7 +422,7 @@ Ctrl_status sd_mmc_mem_2_ram_1(uint32_t addr, void *ram, uint32_t numBlocks)
 	return sd_mmc_mem_2_ram(1, addr, ram, numBlocks);
 }
 
-Ctrl_status sd_mmc_ram_2_mem(uint8_t slot, uint32_t addr, const void *ram, uint32_t numBlocks)
+static Ctrl_status sd_mmc_ram_2_mem_attempt(uint8_t slot, uint32_t addr, const void *ram, uint32_t numBlocks)
 {
 	switch (sd_mmc_init_write_blocks(slot, addr, numBlocks)) {
 	case SD_MMC_OK:
@@ -344,6 +433,8 @@ Ctrl_status sd_mmc_ram_2_mem(uint8_t slot, uint32_t addr, const void *ram, uint3
 		return CTRL_FAIL;
 	}
 	if (SD_MMC_OK != sd_mmc_start_write_blocks(ram, numBlocks)) {
+		// Stop the transfer and release the card
+		sd_mmc_wait_end_of_write_blocks(true);
 		return CTRL_FAIL;
 	}
 	if (SD_MMC_OK != sd_mmc_wait_end_of_write_blocks(false)) {
@@ -352,6 +443,16 @@ Ctrl_status sd_mmc_ram_2_mem(uint8_t slot, uint32_t addr, const void *ram, uint3
 	return CTRL_GOOD;
 }
 
+Ctrl_status sd_mmc_ram_2_mem(uint8_t slot, uint32_t addr, const void *ram, uint32_t numBlocks)
+{
+	Ctrl_status status;
+	uint8_t retries = SD_MMC_MEM_NB_RETRIES;
+	do {
+		status = sd_mmc_ram_2_mem_attempt(slot, addr, ram, numBlocks);
+	} while (status == CTRL_FAIL && retries-- != 0);
+	return status;
+}
+
 Ctrl_status sd_mmc_ram_2_mem_0(uint32_t addr, const void *ram, uint32_t numBlocks)
 {
 	return sd_mmc_ram_2_mem(0, addr, ram, numBlocks);
@@ -114,6 +114,20 @@ extern bool sd_mmc_unload_0(bool unload);
 //! Instance Declaration for sd_mmc_unload Slot 1
 extern bool sd_mmc_unload_1(bool unload);
 
+/*! \brief Returns a number that changes whenever the SD/MMC card selected may have been changed
+ *
+ * The sector cache compares it with the value it saw when it cached sectors of the card.
+ *
+ * \param slot SD/MMC Slot Card Selected.
+ *
+ * \return Card generation.
+ */
+extern uint32_t sd_mmc_generation(uint8_t slot);
+//! Instance Declaration for sd_mmc_generation Slot O
+extern uint32_t sd_mmc_generation_0(void);
+//! Instance Declaration for sd_mmc_generation Slot 1
+extern uint32_t sd_mmc_generation_1(void);
+
 /*! \brief Returns the write-protection state of the memory.
  *
 *  \param slot SD/MMC Slot Card Selected.
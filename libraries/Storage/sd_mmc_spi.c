@@ -89,13 +89,97 @@ static uint16_t sd_mmc_spi_block_size;
 //! Total number of block requested by last mci_adtc_start()
 static uint16_t sd_mmc_spi_nb_block;
 
+//! Maximum clock of each slot, reduced when CRC errors occur
+static uint32_t sd_mmc_spi_max_clock[SD_MMC_SPI_MEM_CNT];
+//! Slot selected by the last call to sd_mmc_spi_select_device()
+static uint8_t sd_mmc_spi_slot;
+//! CRC16 of the data transferred so far in the current block by sd_mmc_spi_read_word() or sd_mmc_spi_write_word()
+static uint16_t sd_mmc_spi_block_crc;
+
+//! Number of bytes read from the card each time it is polled while waiting for it
+#define SD_MMC_SPI_POLL_BYTES          8
+//! Time for which a wait polls the card continuously before it starts calling the idle function between polls
+#define SD_MMC_SPI_YIELD_AFTER_MS      2
+//! Maximum time to wait for the start of a data block (Nac)
+#define SD_MMC_SPI_READ_TIMEOUT_MS     250
+//! Maximum time to wait for the card to finish programming (Nec), which is 500ms for SDXC cards
+#define SD_MMC_SPI_BUSY_TIMEOUT_MS     500
+
+//! Function called while waiting for the card, set by sd_mmc_spi_set_idle_func()
+static spiIdleFunc_t spiIdleFunc = NULL;
+//! Statistics for the waits for the start of a data block
+static sd_mmc_spi_wait_stats_t sd_mmc_spi_read_wait_stats;
+//! Statistics for the waits for the card to finish programming
+static sd_mmc_spi_wait_stats_t sd_mmc_spi_busy_wait_stats;
+
 static uint8_t sd_mmc_spi_crc7(uint8_t * buf, uint8_t size);
+static uint16_t sd_mmc_spi_crc16(uint16_t crc, const uint8_t * buf, size_t size);
+static void sd_mmc_spi_reduce_clock(void);
+static bool sd_mmc_spi_wait_yield(sd_mmc_spi_wait_stats_t *stats, uint32_t start_time, uint32_t timeout, bool release_bus);
+static void sd_mmc_spi_wait_done(sd_mmc_spi_wait_stats_t *stats, uint32_t start_time);
 static bool sd_mmc_spi_wait_busy(void);
 static bool sd_mmc_spi_start_read_block(void);
-static void sd_mmc_spi_stop_read_block(void);
+static bool sd_mmc_spi_stop_read_block(uint16_t crc);
 static void sd_mmc_spi_start_write_block(void);
-static bool sd_mmc_spi_stop_write_block(void);
+static bool sd_mmc_spi_stop_write_block(uint16_t crc);
 static bool sd_mmc_spi_stop_multiwrite_block(void);
+static bool sd_mmc_spi_send_stop_tran(void);
+
+//! CRC7 of each byte value, shifted left by one bit (polynomial x^7 + x^3 + 1)
+static const uint8_t sd_mmc_spi_crc7_table[256] = {
+	0x00, 0x12, 0x24, 0x36, 0x48, 0x5A, 0x6C, 0x7E, 0x90, 0x82, 0xB4, 0xA6, 0xD8, 0xCA, 0xFC, 0xEE,
+	0x32, 0x20, 0x16, 0x04, 0x7A, 0x68, 0x5E, 0x4C, 0xA2, 0xB0, 0x86, 0x94, 0xEA, 0xF8, 0xCE, 0xDC,
+	0x64, 0x76, 0x40, 0x52, 0x2C, 0x3E, 0x08, 0x1A, 0xF4, 0xE6, 0xD0, 0xC2, 0xBC, 0xAE, 0x98, 0x8A,
+	0x56, 0x44, 0x72, 0x60, 0x1E, 0x0C, 0x3A, 0x28, 0xC6, 0xD4, 0xE2, 0xF0, 0x8E, 0x9C, 0xAA, 0xB8,
+	0xC8, 0xDA, 0xEC, 0xFE, 0x80, 0x92, 0xA4, 0xB6, 0x58, 0x4A, 0x7C, 0x6E, 0x10, 0x02, 0x34, 0x26,
+	0xFA, 0xE8, 0xDE, 0xCC, 0xB2, 0xA0, 0x96, 0x84, 0x6A, 0x78, 0x4E, 0x5C, 0x22, 0x30, 0x06, 0x14,
+	0xAC, 0xBE, 0x88, 0x9A, 0xE4, 0xF6, 0xC0, 0xD2, 0x3C, 0x2E, 0x18, 0x0A, 0x74, 0x66, 0x50, 0x42,
+	0x9E, 0x8C, 0xBA, 0xA8, 0xD6, 0xC4, 0xF2, 0xE0, 0x0E, 0x1C, 0x2A, 0x38, 0x46, 0x54, 0x62, 0x70,
+	0x82, 0x90, 0xA6, 0xB4, 0xCA, 0xD8, 0xEE, 0xFC, 0x12, 0x00, 0x36, 0x24, 0x5A, 0x48, 0x7E, 0x6C,
+	0xB0, 0xA2, 0x94, 0x86, 0xF8, 0xEA, 0xDC, 0xCE, 0x20, 0x32, 0x04, 0x16, 0x68, 0x7A, 0x4C, 0x5E,
+	0xE6, 0xF4, 0xC2, 0xD0, 0xAE, 0xBC, 0x8A, 0x98, 0x76, 0x64, 0x52, 0x40, 0x3E, 0x2C, 0x1A, 0x08,
+	0xD4, 0xC6, 0xF0, 0xE2, 0x9C, 0x8E, 0xB8, 0xAA, 0x44, 0x56, 0x60, 0x72, 0x0C, 0x1E, 0x28, 0x3A,
+	0x4A, 0x58, 0x6E, 0x7C, 0x02, 0x10, 0x26, 0x34, 0xDA, 0xC8, 0xFE, 0xEC, 0x92, 0x80, 0xB6, 0xA4,
+	0x78, 0x6A, 0x5C, 0x4E, 0x30, 0x22, 0x14, 0x06, 0xE8, 0xFA, 0xCC, 0xDE, 0xA0, 0xB2, 0x84, 0x96,
+	0x2E, 0x3C, 0x0A, 0x18, 0x66, 0x74, 0x42, 0x50, 0xBE, 0xAC, 0x9A, 0x88, 0xF6, 0xE4, 0xD2, 0xC0,
+	0x1C, 0x0E, 0x38, 0x2A, 0x54, 0x46, 0x70, 0x62, 0x8C, 0x9E, 0xA8, 0xBA, 0xC4, 0xD6, 0xE0, 0xF2
+};
+
+//! CRC16 of each byte value (CRC-CCITT polynomial x^16 + x^12 + x^5 + 1)
+static const uint16_t sd_mmc_spi_crc16_table[256] = {
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+	0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+	0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+	0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+	0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+	0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+	0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+	0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+	0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+	0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+	0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+	0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+	0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+	0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+	0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+	0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+	0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+	0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+	0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+	0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+	0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+	0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+	0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+	0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+	0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+	0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+	0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+	0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+	0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+	0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+	0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+	0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
+};
 
 /**
  * \brief Calculates the CRC7
@@ -107,23 +191,100 @@ static bool sd_mmc_spi_stop_multiwrite_block(void);
  */
 static uint8_t sd_mmc_spi_crc7(uint8_t * buf, uint8_t size)
 {
-	uint8_t crc, value, i;
+	uint8_t crc = 0;
+	while (size--) {
+		crc = sd_mmc_spi_crc7_table[crc ^ *buf++];
+	}
+	return crc | 1;
+}
 
-	crc = 0;
+/**
+ * \brief Calculates the CRC16 of a data block
+ *
+ * \param crc     CRC of the preceding data, or 0 at the start of the block
+ * \param buf     Buffer data to compute
+ * \param size    Size of buffer data
+ *
+ * \return CRC16 computed
+ */
+static uint16_t sd_mmc_spi_crc16(uint16_t crc, const uint8_t * buf, size_t size)
+{
 	while (size--) {
-		value = *buf++;
-		for (i = 0; i < 8; i++) {
-			crc <<= 1;
-			if ((value & 0x80) ^ (crc & 0x80)) {
-				crc ^= 0x09;
-			}
-			value <<= 1;
-		}
+		crc = (crc << 8) ^ sd_mmc_spi_crc16_table[(crc >> 8) ^ *buf++];
 	}
-	crc = (crc << 1) | 1;
 	return crc;
 }
 
+/**
+ * \brief Halves the maximum clock of the selected slot after a CRC error or a corrupted token
+ *
+ * The new limit is used from the next call to sd_mmc_spi_select_device(), so a retry of the failed transfer runs slower.
+ */
+static void sd_mmc_spi_reduce_clock(void)
+{
+	const uint32_t clock = sd_mmc_spi_devices[sd_mmc_spi_slot].clockFrequency;
+	if (clock > SDMMC_CLOCK_INIT) {
+		sd_mmc_spi_max_clock[sd_mmc_spi_slot] = Max(clock / 2, SDMMC_CLOCK_INIT);
+		sd_mmc_spi_debug("%s: slot %d clock reduced to %lu\n\r",
+				__func__, (int)sd_mmc_spi_slot, sd_mmc_spi_max_clock[sd_mmc_spi_slot]);
+	}
+}
+
+/**
+ * \brief Called when a poll of the card finds that it is not ready yet
+ *
+ * Once the wait has lasted SD_MMC_SPI_YIELD_AFTER_MS the idle function is called, so that other tasks can run.
+ * If release_bus is true the card is deselected while the idle function runs, so that other devices can use the bus.
+ *
+ * \param stats       Statistics to update
+ * \param start_time  Value of millis() when the wait started
+ * \param timeout     Maximum duration of the wait in milliseconds
+ * \param release_bus true if the card may be deselected while the idle function runs
+ *
+ * \return true to keep waiting, false if the wait has timed out
+ */
+static bool sd_mmc_spi_wait_yield(sd_mmc_spi_wait_stats_t *stats, uint32_t start_time, uint32_t timeout, bool release_bus)
+{
+	const uint32_t elapsed = millis() - start_time;
+	if (elapsed >= timeout) {
+		stats->nb_timeout++;
+		sd_mmc_spi_wait_done(stats, start_time);
+		return false;
+	}
+	if (elapsed >= SD_MMC_SPI_YIELD_AFTER_MS && spiIdleFunc != NULL) {
+		stats->nb_yield++;
+		if (release_bus) {
+			struct sspi_device *dev = &sd_mmc_spi_devices[sd_mmc_spi_slot];
+			sspi_deselect_device(dev);
+			spiIdleFunc(0, 0);
+			sspi_master_setup_device(dev);		// another device may have changed the bus settings
+			sspi_select_device(dev);
+		} else {
+			spiIdleFunc(0, 0);
+		}
+	}
+	return true;
+}
+
+/**
+ * \brief Records the duration of a finished wait
+ *
+ * The duration is measured in whole milliseconds, so a short wait counts as 0 or 1 depending on whether it crossed a tick,
+ * which makes the total correct on average.
+ *
+ * \param stats       Statistics to update
+ * \param start_time  Value of millis() when the wait started
+ */
+static void sd_mmc_spi_wait_done(sd_mmc_spi_wait_stats_t *stats, uint32_t start_time)
+{
+	const uint32_t elapsed = millis() - start_time;
+	stats->nb_wait++;
+	stats->total_ms += elapsed;
+	if (elapsed > stats->max_ms) {
+		stats->max_ms = elapsed;
+	}
+}
+
 /**
  * \brief Wait the end of busy on DAT0 line
  *
@@ -131,27 +292,30 @@ static uint8_t sd_mmc_spi_crc7(uint8_t * buf, uint8_t size)
  */
 static bool sd_mmc_spi_wait_busy(void)
 {
-	uint8_t line = 0xFF;
+	uint8_t line[SD_MMC_SPI_POLL_BYTES];
 
 	/* Delay before check busy
 	 * Nbr timing minimum = 8 cylces
 	 */
-	sspi_read_packet(&line, 1);
+	sspi_read_packet(line, 1);
 
 	/* Wait end of busy signal
 	 * Nec timing: 0 to unlimited
 	 * However a timeout is used.
-	 * 200 000 * 8 cycles
+	 * The card holds the line low while it is busy,
+	 * so it has finished when the last byte of a burst is 0xFF.
+	 * The card carries on programming while it is deselected,
+	 * so we release the bus while the idle function runs.
 	 */
-	uint32_t nec_timeout = 200000;
-	sspi_read_packet(&line, 1);
+	const uint32_t start_time = millis();
 	do {
-		sspi_read_packet(&line, 1);
-		if (!(nec_timeout--)) {
-			return false;
+		sspi_read_packet(line, sizeof(line));
+		if (line[sizeof(line) - 1] == 0xFF) {
+			sd_mmc_spi_wait_done(&sd_mmc_spi_busy_wait_stats, start_time);
+			return true;
 		}
-	} while (line != 0xFF);
-	return true;
+	} while (sd_mmc_spi_wait_yield(&sd_mmc_spi_busy_wait_stats, start_time, SD_MMC_SPI_BUSY_TIMEOUT_MS, true));
+	return false;
 }
 
 /**
@@ -171,46 +335,65 @@ static bool sd_mmc_spi_start_read_block(void)
 	 * The read timeout is the Nac timing.
 	 * Nac must be computed trough CSD values,
 	 * or it is 100ms for SDHC / SDXC
-	 * Compute the maximum timeout:
-	 * Frequency maximum = 25MHz
-	 * 1 byte = 8 cycles
-	 * 100ms = 312500 x sd_mmc_spi_drv_read_packet() maximum
+	 * A longer timeout is used to allow for slow cards.
+	 * The token is read one byte at a time because the data follows it.
+	 * The card must stay selected until the data has been read, so the bus is not released.
 	 */
-	token = 0;
-	i = 500000;
-	do {
-		if (i-- == 0) {
+	const uint32_t start_time = millis();
+	for (;;) {
+		for (i = 0; i < SD_MMC_SPI_POLL_BYTES; i++) {
+			sspi_read_packet(&token, 1);
+			if (token == SPI_TOKEN_SINGLE_MULTI_READ || SPI_TOKEN_DATA_ERROR_VALID(token)) {
+				break;
+			}
+		}
+		if (i < SD_MMC_SPI_POLL_BYTES) {
+			break;
+		}
+		if (!sd_mmc_spi_wait_yield(&sd_mmc_spi_read_wait_stats, start_time, SD_MMC_SPI_READ_TIMEOUT_MS, false)) {
 			sd_mmc_spi_err = SD_MMC_SPI_ERR_READ_TIMEOUT;
 			sd_mmc_spi_debug("%s: Read blocks timeout\n\r", __func__);
 			return false;
 		}
-		sspi_read_packet(&token, 1);
-		if (SPI_TOKEN_DATA_ERROR_VALID(token)) {
-			Assert(SPI_TOKEN_DATA_ERROR_ERRORS & token);
-			if (token & (SPI_TOKEN_DATA_ERROR_ERROR
-					| SPI_TOKEN_DATA_ERROR_ECC_ERROR
-					| SPI_TOKEN_DATA_ERROR_CC_ERROR)) {
-				sd_mmc_spi_debug("%s: CRC data error token\n\r", __func__);
-				sd_mmc_spi_err = SD_MMC_SPI_ERR_READ_CRC;
-			} else {
-				sd_mmc_spi_debug("%s: Out of range data error token\n\r", __func__);
-				sd_mmc_spi_err = SD_MMC_SPI_ERR_OUT_OF_RANGE;
-			}
-			return false;
+	}
+	sd_mmc_spi_wait_done(&sd_mmc_spi_read_wait_stats, start_time);
+
+	if (SPI_TOKEN_DATA_ERROR_VALID(token)) {
+		Assert(SPI_TOKEN_DATA_ERROR_ERRORS & token);
+		if (token & (SPI_TOKEN_DATA_ERROR_ERROR
+				| SPI_TOKEN_DATA_ERROR_ECC_ERROR
+				| SPI_TOKEN_DATA_ERROR_CC_ERROR)) {
+			sd_mmc_spi_debug("%s: CRC data error token\n\r", __func__);
+			sd_mmc_spi_err = SD_MMC_SPI_ERR_READ_CRC;
+		} else {
+			sd_mmc_spi_debug("%s: Out of range data error token\n\r", __func__);
+			sd_mmc_spi_err = SD_MMC_SPI_ERR_OUT_OF_RANGE;
 		}
-	} while (token != SPI_TOKEN_SINGLE_MULTI_READ);
-
+		return false;
+	}
 	return true;
 }
 
 /**
  * \brief Executed the end of a read block transfer
+ *
+ * \param crc     CRC16 of the data received
+ *
+ * \return true if the CRC sent by the card matches, otherwise false
+ *         with a update of \ref sd_mmc_spi_err.
  */
-static void sd_mmc_spi_stop_read_block(void)
+static bool sd_mmc_spi_stop_read_block(uint16_t crc)
 {
-	uint8_t crc[2];
-	// Read 16-bit CRC (not cheked)
-	sspi_read_packet(crc, 2);
+	uint8_t card_crc[2];
+	// Read 16-bit CRC, most significant byte first
+	sspi_read_packet(card_crc, 2);
+	if (crc != (((uint16_t)card_crc[0] << 8) | card_crc[1])) {
+		sd_mmc_spi_err = SD_MMC_SPI_ERR_READ_CRC;
+		sd_mmc_spi_debug("%s: Read blocks CRC error\n\r", __func__);
+		sd_mmc_spi_reduce_clock();
+		return false;
+	}
+	return true;
 }
 
 /**
@@ -236,22 +419,26 @@ static void sd_mmc_spi_start_write_block(void)
 /**
  * \brief Waits the TOKEN which notify the end of write block transfer
  *
+ * \param crc     CRC16 of the data sent
+ *
  * \return true if success, otherwise false
  *         with a update of \ref sd_mmc_spi_err.
  */
-static bool sd_mmc_spi_stop_write_block(void)
+static bool sd_mmc_spi_stop_write_block(uint16_t crc)
 {
 	uint8_t resp;
-	uint16_t crc;
+	uint8_t crc_bytes[2];
 
-	// Send CRC
-	crc = 0xFFFF; /// CRC is disabled in SPI mode
-	sspi_write_packet((uint8_t *)&crc, 2);
+	// Send CRC, most significant byte first
+	crc_bytes[0] = crc >> 8;
+	crc_bytes[1] = crc;
+	sspi_write_packet(crc_bytes, 2);
 	// Receive data response token
 	sspi_read_packet(&resp, 1);
 	if (!SPI_TOKEN_DATA_RESP_VALID(resp)) {
 		sd_mmc_spi_err = SD_MMC_SPI_ERR;
 		sd_mmc_spi_debug("%s: Invalid Data Response Token 0x%x\n\r", __func__, resp);
+		sd_mmc_spi_reduce_clock();	// the token may have been corrupted
 		return false;
 	}
 	// Check data response
@@ -261,6 +448,7 @@ static bool sd_mmc_spi_stop_write_block(void)
 	case SPI_TOKEN_DATA_RESP_CRC_ERR:
 		sd_mmc_spi_err = SD_MMC_SPI_ERR_WRITE_CRC;
 		sd_mmc_spi_debug("%s: Write blocks, SD_MMC_SPI_ERR_CRC, resp 0x%x\n\r", __func__, resp);
+		sd_mmc_spi_reduce_clock();
 		return false;
 	case SPI_TOKEN_DATA_RESP_WRITE_ERR:
 	default:
@@ -279,14 +467,26 @@ static bool sd_mmc_spi_stop_write_block(void)
  */
 static bool sd_mmc_spi_stop_multiwrite_block(void)
 {
-	uint8_t value;
-
 	if (1 == sd_mmc_spi_nb_block) {
 		return true; // Single block write
 	}
 	if (sd_mmc_spi_nb_block > (sd_mmc_spi_transfert_pos / sd_mmc_spi_block_size)) {
 		return true; // It is not the End of multi write
 	}
+	return sd_mmc_spi_send_stop_tran();
+}
+
+/**
+ * \brief Sends the token that ends a multi blocks write transfer
+ *
+ * This is also used to abandon a multi blocks write after an error, so that the card is ready for the next command.
+ *
+ * \return true if success, otherwise false
+ *         with a update of \ref sd_mmc_spi_err.
+ */
+static bool sd_mmc_spi_send_stop_tran(void)
+{
+	uint8_t value;
 
 	// Delay before start write block:
 	// Nwr timing minimum = 8 cylces
@@ -313,11 +513,9 @@ static bool sd_mmc_spi_stop_multiwrite_block(void)
 // Get the speed of the SPI SD card interface for reporting purposes, in bytes/sec
 uint32_t spi_mmc_get_speed(void)
 {
-	return SD_MMC_SPI_MAX_CLOCK/8;
+	return sspi_get_actual_frequency(&sd_mmc_spi_devices[sd_mmc_spi_slot])/8;
 }
 
-static spiIdleFunc_t spiIdleFunc = NULL;
-
 // Set the idle function and return the old one
 spiIdleFunc_t sd_mmc_spi_set_idle_func(spiIdleFunc_t p)
 {
@@ -326,6 +524,19 @@ spiIdleFunc_t sd_mmc_spi_set_idle_func(spiIdleFunc_t p)
 	return ret;
 }
 
+// Get the statistics for the waits for the card, optionally clearing them
+void sd_mmc_spi_get_wait_stats(sd_mmc_spi_wait_stats_t *read_stats, sd_mmc_spi_wait_stats_t *busy_stats, bool clear)
+{
+	const irqflags_t flags = cpu_irq_save();
+	*read_stats = sd_mmc_spi_read_wait_stats;
+	*busy_stats = sd_mmc_spi_busy_wait_stats;
+	if (clear) {
+		memset(&sd_mmc_spi_read_wait_stats, 0, sizeof(sd_mmc_spi_read_wait_stats));
+		memset(&sd_mmc_spi_busy_wait_stats, 0, sizeof(sd_mmc_spi_busy_wait_stats));
+	}
+	cpu_irq_restore(flags);
+}
+
 #endif
 
 sd_mmc_spi_errno_t sd_mmc_spi_get_errno(void)
@@ -343,6 +554,7 @@ void sd_mmc_spi_init(const Pin csPins[SD_MMC_SPI_MEM_CNT])
 		sd_mmc_spi_devices[i].csPin = csPins[i];
 		sd_mmc_spi_devices[i].csPolarity = false;
 		sspi_master_init(&sd_mmc_spi_devices[i], 8);
+		sd_mmc_spi_max_clock[i] = SD_MMC_SPI_MAX_CLOCK;
 	}
 }
 
@@ -352,12 +564,11 @@ void sd_mmc_spi_select_device(uint8_t slot, uint32_t clock, uint8_t bus_width, b
 	UNUSED(high_speed);
 	sd_mmc_spi_err = SD_MMC_SPI_NO_ERR;
 
-#ifdef SD_MMC_SPI_MAX_CLOCK
-	if (clock > SD_MMC_SPI_MAX_CLOCK) {
-		clock = SD_MMC_SPI_MAX_CLOCK;
+	if (clock > sd_mmc_spi_max_clock[slot]) {
+		clock = sd_mmc_spi_max_clock[slot];
 	}
-#endif
 
+	sd_mmc_spi_slot = slot;
 	struct sspi_device *dev = &sd_mmc_spi_devices[slot];
 	dev->spiMode = SPI_MODE_0;
 	dev->clockFrequency = clock;
@@ -379,6 +590,8 @@ void sd_mmc_spi_send_clock(void)
 	uint8_t dummy = 0xFF;
 
 	sd_mmc_spi_err = SD_MMC_SPI_NO_ERR;
+	// A card is being installed, so allow it the maximum clock again
+	sd_mmc_spi_max_clock[sd_mmc_spi_slot] = SD_MMC_SPI_MAX_CLOCK;
 	//! Send 80 cycles
 	for (i = 0; i < 10; i++) {
 		sspi_write_packet(&dummy, 1); // 8 cycles
@@ -449,6 +662,7 @@ bool sd_mmc_spi_adtc_start(sdmmc_cmd_def_t cmd, uint32_t arg,
 		sd_mmc_spi_debug("%s: cmd %02d, arg 0x%08lx, r1 0x%02x, R1_SPI_COM_CRC\n\r",
 				__func__, (int)SDMMC_CMD_GET_INDEX(cmd), arg, r1);
 		sd_mmc_spi_err = SD_MMC_SPI_ERR_RESP_CRC;
+		sd_mmc_spi_reduce_clock();
 		return false;
 	}
 	if (r1 & R1_SPI_ILLEGAL_COMMAND) {
@@ -506,15 +720,17 @@ bool sd_mmc_spi_read_word(uint32_t* value)
 		if (!sd_mmc_spi_start_read_block()) {
 			return false;
 		}
+		sd_mmc_spi_block_crc = 0;
 	}
 	// Read data
 	sspi_read_packet((uint8_t*)value, 4);
+	sd_mmc_spi_block_crc = sd_mmc_spi_crc16(sd_mmc_spi_block_crc, (const uint8_t*)value, 4);
 	*value = le32_to_cpu(*value);
 	sd_mmc_spi_transfert_pos += 4;
 
 	if (!(sd_mmc_spi_transfert_pos % sd_mmc_spi_block_size)) {
 		// End of block
-		sd_mmc_spi_stop_read_block();
+		return sd_mmc_spi_stop_read_block(sd_mmc_spi_block_crc);
 	}
 	return true;
 }
@@ -528,16 +744,18 @@ bool sd_mmc_spi_write_word(uint32_t value)
 	if (!(sd_mmc_spi_transfert_pos % sd_mmc_spi_block_size)) {
 		// New block
 		sd_mmc_spi_start_write_block();
+		sd_mmc_spi_block_crc = 0;
 	}
 
 	// Write data
 	value = cpu_to_le32(value);
+	sd_mmc_spi_block_crc = sd_mmc_spi_crc16(sd_mmc_spi_block_crc, (const uint8_t*)&value, 4);
 	sspi_write_packet((uint8_t*)&value, 4);
 	sd_mmc_spi_transfert_pos += 4;
 
 	if (!(sd_mmc_spi_transfert_pos % sd_mmc_spi_block_size)) {
 		// End of block
-		if (!sd_mmc_spi_stop_write_block()) {
+		if (!sd_mmc_spi_stop_write_block(sd_mmc_spi_block_crc)) {
 			return false;
 		}
 		// Wait busy due to data programmation
@@ -564,11 +782,14 @@ bool sd_mmc_spi_start_read_blocks(void *dest, uint16_t nb_block)
 		}
 
 		// Read block
-		sspi_read_packet(&((uint8_t*)dest)[pos], sd_mmc_spi_block_size);
+		uint8_t * const block = &((uint8_t*)dest)[pos];
+		sspi_read_packet(block, sd_mmc_spi_block_size);
 		pos += sd_mmc_spi_block_size;
 		sd_mmc_spi_transfert_pos += sd_mmc_spi_block_size;
 
-		sd_mmc_spi_stop_read_block();
+		if (!sd_mmc_spi_stop_read_block(sd_mmc_spi_crc16(0, block, sd_mmc_spi_block_size))) {
+			return false;
+		}
 	}
 	return true;
 }
@@ -589,12 +810,21 @@ bool sd_mmc_spi_start_write_blocks(const void *src, uint16_t nb_block)
 				(sd_mmc_spi_transfert_pos / sd_mmc_spi_block_size));
 		sd_mmc_spi_start_write_block();
 
-		// Write block
-		sspi_write_packet(&((uint8_t*)src)[pos], sd_mmc_spi_block_size);
+		// Write block, calculating its CRC while a DMA transfer is in progress
+		const uint8_t * const block = &((const uint8_t*)src)[pos];
+		sspi_start_transceive_packet(block, NULL, sd_mmc_spi_block_size);
+		const uint16_t crc = sd_mmc_spi_crc16(0, block, sd_mmc_spi_block_size);
+		sspi_wait_transceive_complete();
 		pos += sd_mmc_spi_block_size;
 		sd_mmc_spi_transfert_pos += sd_mmc_spi_block_size;
 
-		if (!sd_mmc_spi_stop_write_block()) {
+		if (!sd_mmc_spi_stop_write_block(crc)) {
+			if (sd_mmc_spi_nb_block > 1) {
+				// Abandon the multi blocks write, keeping the original error code
+				const sd_mmc_spi_errno_t err = sd_mmc_spi_err;
+				sd_mmc_spi_send_stop_tran();
+				sd_mmc_spi_err = err;
+			}
 			return false;
 		}
 		// Do not check busy of last block
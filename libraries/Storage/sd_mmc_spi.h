@@ -235,9 +235,24 @@ uint32_t spi_mmc_get_speed(void);
 
 typedef void (*spiIdleFunc_t)(uint32_t, uint32_t);
 
-// Set the idle function and return the old one
+// Set the idle function and return the old one.
+// It is called with both arguments zero while waiting for the card to send a data block or to finish programming, once the wait has lasted a few milliseconds.
+// While waiting for a data block the card is still selected and the shared SPI bus is claimed, so the idle function must not use the shared SPI bus.
+// While waiting for the card to finish programming the card is deselected and the bus released, so the idle function may use the bus then.
 spiIdleFunc_t sd_mmc_spi_set_idle_func(spiIdleFunc_t);
 
+//! Statistics for the waits for the card
+typedef struct {
+	uint32_t nb_wait;		//!< Number of waits completed, including those that timed out
+	uint32_t nb_yield;		//!< Number of times the idle function was called
+	uint32_t nb_timeout;	//!< Number of waits that timed out
+	uint32_t total_ms;		//!< Total time spent waiting
+	uint32_t max_ms;		//!< Longest wait
+} sd_mmc_spi_wait_stats_t;
+
+// Get the statistics for the waits for the start of a data block and for the card to finish programming, optionally clearing them
+void sd_mmc_spi_get_wait_stats(sd_mmc_spi_wait_stats_t *read_stats, sd_mmc_spi_wait_stats_t *busy_stats, bool clear);
+
 #endif
 //! @}
 
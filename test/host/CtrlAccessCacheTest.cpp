@@ -0,0 +1,169 @@
+/*
+  CtrlAccessCacheTest.cpp - Check the sector cache in ctrl_access.c against a model of two RAM disks
+
+  Random single and multi-sector reads and writes, syncs and card changes are applied to both the cache and a simple
+  model of what each card should hold. Every read must match the model, and after a final sync each card must hold
+  exactly what the model says, so sectors written to one card must never reach the card that replaced it.
+*/
+
+#include "HostTest.h"
+#include <cstring>
+
+extern "C"
+{
+#include "ctrl_access.h"
+}
+
+constexpr U32 MaxSectors = 64;
+constexpr size_t SectorSize = 512;
+
+// A RAM disk that can have its card changed
+struct TestCard
+{
+	U8 data[MaxSectors][SectorSize];
+	U32 sectors;
+	U32 generation;
+	unsigned int transfers;
+	unsigned int outOfRange;			// requests beyond the end of the card, which the cache should never make
+};
+
+static TestCard cards[2];
+static U8 model[2][MaxSectors][SectorSize];
+static Xorshift64 rng;
+
+static Ctrl_status CardRead(TestCard& card, U32 addr, void *ram, U32 numBlocks)
+{
+	if (addr >= card.sectors || numBlocks > card.sectors - addr)
+	{
+		++card.outOfRange;
+		return CTRL_FAIL;
+	}
+	++card.transfers;
+	memcpy(ram, card.data[addr], numBlocks * SectorSize);
+	return CTRL_GOOD;
+}
+
+static Ctrl_status CardWrite(TestCard& card, U32 addr, const void *ram, U32 numBlocks)
+{
+	if (addr >= card.sectors || numBlocks > card.sectors - addr)
+	{
+		++card.outOfRange;
+		return CTRL_FAIL;
+	}
+	++card.transfers;
+	memcpy(card.data[addr], ram, numBlocks * SectorSize);
+	return CTRL_GOOD;
+}
+
+#define TEST_LUN_DEFINITIONS(n) \
+	extern "C" Ctrl_status test_lun_test_unit_ready_##n(void) { return CTRL_GOOD; } \
+	extern "C" Ctrl_status test_lun_read_capacity_##n(U32 *last_sector) { *last_sector = cards[n].sectors - 1; return CTRL_GOOD; } \
+	extern "C" bool test_lun_wr_protect_##n(void) { return false; } \
+	extern "C" bool test_lun_removal_##n(void) { return true; } \
+	extern "C" Ctrl_status test_lun_mem_2_ram_##n(U32 addr, void *ram, U32 numBlocks) { return CardRead(cards[n], addr, ram, numBlocks); } \
+	extern "C" Ctrl_status test_lun_ram_2_mem_##n(U32 addr, const void *ram, U32 numBlocks) { return CardWrite(cards[n], addr, ram, numBlocks); } \
+	extern "C" U32 test_lun_generation_##n(void) { return cards[n].generation; }
+
+TEST_LUN_DEFINITIONS(0)
+TEST_LUN_DEFINITIONS(1)
+
+static void FillRandom(U8 *p, size_t length)
+{
+	for (size_t i = 0; i < length; ++i)
+	{
+		p[i] = (U8)rng.Next();
+	}
+}
+
+// Put a new card with random contents and the given number of sectors in the slot, as sd_mmc_check() does when it initialises one
+static void ChangeCard(unsigned int lun, U32 sectors)
+{
+	TestCard& card = cards[lun];
+	FillRandom(&card.data[0][0], sizeof(card.data));
+	memcpy(model[lun], card.data, sizeof(card.data));
+	card.sectors = sectors;
+	++card.generation;
+}
+
+// Read a sector that the cache holds, change the card, and read it again
+static void CheckCardChange()
+{
+	U8 before[SectorSize], after[SectorSize];
+	ChangeCard(0, MaxSectors);
+	CHECK(memory_2_ram(LUN_ID_2, 0, before, 1) == CTRL_GOOD, "read before the card change");
+	CHECK(memcmp(before, model[0][0], SectorSize) == 0, "sector 0 before the card change");
+
+	// Leave a written sector in the cache, which belongs to the old card
+	FillRandom(after, SectorSize);
+	CHECK(ram_2_memory(LUN_ID_2, 1, after, 1) == CTRL_GOOD, "write before the card change");
+
+	ChangeCard(0, MaxSectors/2);
+	CHECK(memory_2_ram(LUN_ID_2, 0, after, 1) == CTRL_GOOD, "read after the card change");
+	CHECK(memcmp(after, model[0][0], SectorSize) == 0, "sector 0 after the card change comes from the old card");
+	CHECK(mem_sync(LUN_ID_2) == CTRL_GOOD, "sync after the card change");
+	CHECK(memcmp(cards[0].data[1], model[0][1], SectorSize) == 0, "a sector written to the old card reached the new one");
+}
+
+static void CheckRandomAccesses()
+{
+	ChangeCard(0, MaxSectors);
+	ChangeCard(1, MaxSectors);
+	U32 nextSequential[2] = { 0, 0 };
+	U8 buf[8 * SectorSize];
+	for (unsigned int iteration = 0; iteration < 200000; ++iteration)
+	{
+		const uint64_t r = rng.Next();
+		const unsigned int lun = r & 1;
+		const unsigned int op = (r >> 1) % 100;
+		const U32 sectors = cards[lun].sectors;
+		U32 addr = (U32)(r >> 8) % sectors;
+		U32 numBlocks = ((r >> 40) % 4 == 0) ? 1 + (U32)(r >> 42) % 8 : 1;
+		if (op < 30)
+		{
+			addr = nextSequential[lun]++ % sectors;			// reads that should trigger read-ahead
+			numBlocks = 1;
+		}
+		numBlocks = Min(numBlocks, sectors - addr);
+
+		if (op < 60)
+		{
+			CHECK(memory_2_ram(LUN_ID_2 + lun, addr, buf, numBlocks) == CTRL_GOOD, "read of LUN %u sector %u", lun, addr);
+			CHECK(memcmp(buf, model[lun][addr], numBlocks * SectorSize) == 0, "iteration %u: read of %u sectors at %u of LUN %u", iteration, numBlocks, addr, lun);
+		}
+		else if (op < 90)
+		{
+			FillRandom(buf, numBlocks * SectorSize);
+			memcpy(model[lun][addr], buf, numBlocks * SectorSize);
+			CHECK(ram_2_memory(LUN_ID_2 + lun, addr, buf, numBlocks) == CTRL_GOOD, "write of LUN %u sector %u", lun, addr);
+		}
+		else if (op < 99)
+		{
+			CHECK(mem_sync(LUN_ID_2 + lun) == CTRL_GOOD, "sync of LUN %u", lun);
+			CHECK(memcmp(cards[lun].data, model[lun], sectors * SectorSize) == 0, "iteration %u: LUN %u after sync", iteration, lun);
+		}
+		else
+		{
+			// Whatever was written to the old card but not synced is lost with it
+			ChangeCard(lun, MaxSectors / (1 + (U32)(r >> 50) % 4));
+			nextSequential[lun] = 0;
+		}
+	}
+
+	for (unsigned int lun = 0; lun < 2; ++lun)
+	{
+		CHECK(mem_sync(LUN_ID_2 + lun) == CTRL_GOOD, "final sync of LUN %u", lun);
+		CHECK(memcmp(cards[lun].data, model[lun], cards[lun].sectors * SectorSize) == 0, "LUN %u at the end", lun);
+		CHECK(cards[lun].outOfRange == 0, "%u transfers beyond the end of LUN %u", cards[lun].outOfRange, lun);
+	}
+
+	Ctrl_cache_stats stats;
+	mem_get_cache_stats(&stats, false);
+	CHECK(stats.hits != 0 && stats.read_ahead != 0 && stats.write_backs != 0, "the cache was not exercised");
+}
+
+int main()
+{
+	CheckCardChange();
+	CheckRandomAccesses();
+	return HostTestResult("CtrlAccessCacheTest");
+}
@@ -0,0 +1,74 @@
+/*
+  HostTest.h - Minimal helpers for the host-side tests and benchmarks
+*/
+
+#ifndef HOSTTEST_H_
+#define HOSTTEST_H_
+
+#include <cstdio>
+#include <cstdint>
+#include <chrono>
+
+inline unsigned int hostTestFailures = 0;
+
+// Report a failed check. Only the first few failures are printed, so an exhaustive test that goes badly wrong doesn't flood the output.
+#define CHECK(cond, ...) \
+	do \
+	{ \
+		if (!(cond) && hostTestFailures++ < 20) \
+		{ \
+			fprintf(stderr, "%s:%d: check failed: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__); \
+			fputc('\n', stderr); \
+		} \
+	} while (0)
+
+// Print the result of a test program and return its exit status
+inline int HostTestResult(const char *name)
+{
+	if (hostTestFailures == 0)
+	{
+		printf("%s: passed\n", name);
+		return 0;
+	}
+	printf("%s: %u checks failed\n", name, hostTestFailures);
+	return 1;
+}
+
+// A simple random number generator, so that failures can be reproduced
+class Xorshift64
+{
+public:
+	explicit Xorshift64(uint64_t seed = 0x2545F4914F6CDD1Du) : state(seed) { }
+
+	uint64_t Next()
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return state;
+	}
+
+private:
+	uint64_t state;
+};
+
+// Stop the compiler optimising away a value that a benchmark computes
+template<class T> inline void KeepResult(const T& value)
+{
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Call f(i) for i from 0 to iterations - 1 and return the mean time per call in nanoseconds
+template<class F> double TimeNanoseconds(size_t iterations, F f)
+{
+	const auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < iterations; ++i)
+	{
+		f(i);
+	}
+	const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count()/(double)iterations;
+}
+
+#endif
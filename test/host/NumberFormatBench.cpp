@@ -0,0 +1,90 @@
+/*
+  NumberFormatBench.cpp - Compare the number formatting routines with snprintf and with the Print code they replaced
+
+  On the host the hardware divide is fast, so the gain is smaller than on a Cortex-M, where the old code's
+  division by a variable base is a library call and the float code is software double precision.
+*/
+
+#include "HostTest.h"
+#include "NumberFormat.h"
+#include <cstring>
+
+// The digit loop from the old Print::printNumber, which divides by a base that isn't known at compile time
+__attribute__((noinline)) static size_t OldFormatNumber(unsigned long n, uint8_t base, char *out)
+{
+	char buf[8 * sizeof(long) + 1];
+	char *str = &buf[sizeof(buf) - 1];
+	*str = '\0';
+	if (base < 2) base = 10;
+	do
+	{
+		const unsigned long m = n;
+		n /= base;
+		const char c = (char)(m - base * n);
+		*--str = (char)((c < 10) ? c + '0' : c + 'A' - 10);
+	} while (n);
+	const size_t len = (size_t)(&buf[sizeof(buf) - 1] - str);
+	memcpy(out, str, len);
+	return len;
+}
+
+// The digit generation from the old Print::printFloat, in double precision
+__attribute__((noinline)) static size_t OldFormatFloat(double number, uint8_t digits, char *out)
+{
+	size_t n = 0;
+	if (number < 0.0)
+	{
+		out[n++] = '-';
+		number = -number;
+	}
+	double rounding = 0.5;
+	for (uint8_t i = 0; i < digits; ++i)
+	{
+		rounding /= 10.0;
+	}
+	number += rounding;
+	const unsigned long intPart = (unsigned long)number;
+	double remainder = number - (double)intPart;
+	n += OldFormatNumber(intPart, 10, out + n);
+	if (digits > 0)
+	{
+		out[n++] = '.';
+	}
+	while (digits-- > 0)
+	{
+		remainder *= 10.0;
+		const int toPrint = (int)remainder;
+		out[n++] = (char)('0' + toPrint);
+		remainder -= toPrint;
+	}
+	return n;
+}
+
+int main()
+{
+	constexpr size_t Count = 1 << 16;
+	constexpr size_t Iterations = 20000000;
+	static uint32_t values[Count];
+	static float floats[Count];
+	Xorshift64 rng;
+	for (size_t i = 0; i < Count; ++i)
+	{
+		const uint64_t r = rng.Next();
+		values[i] = (uint32_t)(r >> 32) >> (r & 31);					// numbers of all lengths
+		floats[i] = (float)(int32_t)(r >> 32) / 2147483648.0f * 1000.0f;
+	}
+
+	char buf[80];
+	volatile uint8_t base = 10;		// stop the compiler turning the old code's divide into a multiply
+	printf("ns per conversion\n");
+	printf("%-34s %8.1f\n", "formatUnsigned32", TimeNanoseconds(Iterations, [&](size_t i) { KeepResult(formatUnsigned32(values[i & (Count - 1)], buf)); }));
+	printf("%-34s %8.1f\n", "old printNumber digit loop", TimeNanoseconds(Iterations, [&](size_t i) { KeepResult(OldFormatNumber(values[i & (Count - 1)], base, buf)); }));
+	printf("%-34s %8.1f\n", "snprintf %u", TimeNanoseconds(Iterations/10, [&](size_t i) { KeepResult(snprintf(buf, sizeof(buf), "%u", (unsigned int)values[i & (Count - 1)])); }));
+	printf("%-34s %8.1f\n", "formatUnsignedRadix, base 16", TimeNanoseconds(Iterations, [&](size_t i) { KeepResult(formatUnsignedRadix(values[i & (Count - 1)], 16, true, buf)); }));
+	const uint8_t base16 = base + 6;
+	printf("%-34s %8.1f\n", "old printNumber digit loop, base 16", TimeNanoseconds(Iterations, [&](size_t i) { KeepResult(OldFormatNumber(values[i & (Count - 1)], base16, buf)); }));
+	printf("%-34s %8.1f\n", "formatFloat, 3 decimals", TimeNanoseconds(Iterations, [&](size_t i) { KeepResult(formatFloat(floats[i & (Count - 1)], 3, buf)); }));
+	printf("%-34s %8.1f\n", "old printFloat, 3 decimals", TimeNanoseconds(Iterations, [&](size_t i) { KeepResult(OldFormatFloat(floats[i & (Count - 1)], 3, buf)); }));
+	printf("%-34s %8.1f\n", "snprintf %.3f", TimeNanoseconds(Iterations/10, [&](size_t i) { KeepResult(snprintf(buf, sizeof(buf), "%.3f", (double)floats[i & (Count - 1)])); }));
+	return 0;
+}
@@ -0,0 +1,232 @@
+/*
+  NumberFormatTest.cpp - Check the number formatting routines against snprintf
+
+  The reciprocal divides are checked for every 32-bit value. The formatting routines are checked on every value
+  below 2^22, on the values around each power of 2 and 10, and on random values, and each result must also parse
+  back to the original value.
+*/
+
+#include "HostTest.h"
+#include "NumberFormat.h"
+#include "itoa.h"
+#include "Print.h"
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+static void CheckDivides()
+{
+	uint32_t n = 0;
+	do
+	{
+		CHECK(divideBy10(n) == n/10, "divideBy10(%" PRIu32 ")", n);
+		CHECK(divideBy100(n) == n/100, "divideBy100(%" PRIu32 ")", n);
+		++n;
+	} while (n != 0);
+}
+
+static void CheckUnsigned32(uint32_t value)
+{
+	char buf[1 + FORMAT_MAX_UNSIGNED32_LENGTH + 1], ref[32];
+	const size_t len = formatUnsigned32(value, buf);
+	buf[len] = 0;
+	snprintf(ref, sizeof(ref), "%" PRIu32, value);
+	CHECK(strcmp(buf, ref) == 0, "formatUnsigned32(%s) gave %s", ref, buf);
+	CHECK(strtoul(buf, nullptr, 10) == value, "formatUnsigned32(%s) doesn't parse back", ref);
+
+	const size_t slen = formatSigned32((int32_t)value, buf);
+	buf[slen] = 0;
+	snprintf(ref, sizeof(ref), "%" PRId32, (int32_t)value);
+	CHECK(strcmp(buf, ref) == 0, "formatSigned32(%s) gave %s", ref, buf);
+}
+
+static void CheckUnsigned64(uint64_t value)
+{
+	char buf[1 + FORMAT_MAX_RADIX_LENGTH + 1], ref[80];
+	size_t len = formatUnsigned64(value, buf);
+	buf[len] = 0;
+	snprintf(ref, sizeof(ref), "%" PRIu64, value);
+	CHECK(strcmp(buf, ref) == 0, "formatUnsigned64(%s) gave %s", ref, buf);
+	CHECK(strtoull(buf, nullptr, 10) == value, "formatUnsigned64(%s) doesn't parse back", ref);
+
+	len = formatSigned64((int64_t)value, buf);
+	buf[len] = 0;
+	snprintf(ref, sizeof(ref), "%" PRId64, (int64_t)value);
+	CHECK(strcmp(buf, ref) == 0, "formatSigned64(%s) gave %s", ref, buf);
+
+	static const struct { unsigned int radix; bool upperCase; const char *format; } radixFormats[] =
+	{
+		{ 16, true, "%" PRIX64 }, { 16, false, "%" PRIx64 }, { 8, false, "%" PRIo64 }
+	};
+	for (const auto& rf : radixFormats)
+	{
+		len = formatUnsignedRadix(value, rf.radix, rf.upperCase, buf);
+		buf[len] = 0;
+		snprintf(ref, sizeof(ref), rf.format, value);
+		CHECK(strcmp(buf, ref) == 0, "formatUnsignedRadix(%" PRIu64 ", %u) gave %s, expected %s", value, rf.radix, buf, ref);
+	}
+
+	// snprintf has no binary or base 36, so just check that they parse back
+	for (unsigned int radix : { 2u, 3u, 36u })
+	{
+		len = formatUnsignedRadix(value, radix, false, buf);
+		buf[len] = 0;
+		CHECK(strtoull(buf, nullptr, (int)radix) == value, "formatUnsignedRadix(%" PRIu64 ", %u) gave %s", value, radix, buf);
+	}
+}
+
+static void CheckIntegers()
+{
+	for (uint32_t n = 0; n < (1u << 22); ++n)
+	{
+		CheckUnsigned32(n);
+		CheckUnsigned32(0u - n);
+	}
+
+	// Values either side of the points where the number of digits changes
+	for (unsigned int shift = 0; shift < 64; ++shift)
+	{
+		for (int64_t delta = -3; delta <= 3; ++delta)
+		{
+			const uint64_t v = ((uint64_t)1 << shift) + (uint64_t)delta;
+			CheckUnsigned32((uint32_t)v);
+			CheckUnsigned64(v);
+		}
+	}
+	uint64_t p = 1;
+	for (unsigned int digits = 0; digits < 20; ++digits, p *= 10)
+	{
+		for (int64_t delta = -1000; delta <= 1000; ++delta)
+		{
+			CheckUnsigned32((uint32_t)(p + (uint64_t)delta));
+			CheckUnsigned64(p + (uint64_t)delta);
+		}
+	}
+
+	// Random values of every length
+	Xorshift64 rng;
+	for (unsigned int i = 0; i < 2000000; ++i)
+	{
+		const uint64_t r = rng.Next();
+		const uint64_t v = r >> (r & 63);
+		CheckUnsigned32((uint32_t)v);
+		CheckUnsigned64(v);
+	}
+}
+
+// The float routine works in single precision, so it may differ from snprintf in the last digit.
+// It must never be further from the exact value than snprintf's result plus one unit in the last place.
+static void CheckFloat(float value, unsigned int decimals)
+{
+	char buf[FORMAT_MAX_FLOAT_LENGTH + 1], ref[64];
+	const size_t len = formatFloat(value, decimals, buf);
+	buf[len] = 0;
+	snprintf(ref, sizeof(ref), "%.*f", (int)decimals, (double)value);
+	if (strcmp(buf, ref) != 0)
+	{
+		const double unit = pow(10.0, -(double)decimals);
+		const double error = fabs(strtod(buf, nullptr) - (double)value);
+		// A float only has about 7 significant digits, so also allow the error in the float itself
+		const double allowed = unit + (double)fabsf(value) * 1.2e-7;
+		CHECK(error <= allowed, "formatFloat(%.9g, %u) gave %s, expected %s", (double)value, decimals, buf, ref);
+	}
+}
+
+static void CheckFloats()
+{
+	Xorshift64 rng(12345);
+	for (unsigned int i = 0; i < 1000000; ++i)
+	{
+		const uint64_t r = rng.Next();
+		const float scale = ldexpf(1.0f, (int)(r % 48) - 16);			// from 2^-16 to 2^31
+		const float value = (float)(int32_t)(r >> 32) / 2147483648.0f * scale;
+		CheckFloat(value, (unsigned int)((r >> 8) % (FORMAT_MAX_FLOAT_DECIMALS + 1)));
+	}
+
+	char buf[FORMAT_MAX_FLOAT_LENGTH + 1];
+	buf[formatFloat(0.5f, 0, buf)] = 0;
+	CHECK(strcmp(buf, "1") == 0, "formatFloat(0.5, 0) gave %s", buf);
+	buf[formatFloat(-0.999999f, 2, buf)] = 0;
+	CHECK(strcmp(buf, "-1.00") == 0, "formatFloat(-0.999999, 2) gave %s", buf);
+	buf[formatFloat(5e9f, 2, buf)] = 0;
+	CHECK(strcmp(buf, "ovf") == 0, "formatFloat(5e9, 2) gave %s", buf);
+	buf[formatFloat(-INFINITY, 2, buf)] = 0;
+	CHECK(strcmp(buf, "inf") == 0, "formatFloat(-inf, 2) gave %s", buf);
+	buf[formatFloat(NAN, 2, buf)] = 0;
+	CHECK(strcmp(buf, "nan") == 0, "formatFloat(nan, 2) gave %s", buf);
+}
+
+static void CheckItoa()
+{
+	char buf[80], ref[80];
+	Xorshift64 rng(999);
+	for (unsigned int i = 0; i < 100000; ++i)
+	{
+		const uint64_t r = rng.Next();
+		const int v = (int)(int32_t)(r >> (r & 31));
+		snprintf(ref, sizeof(ref), "%d", v);
+		CHECK(strcmp(itoa(v, buf, 10), ref) == 0, "itoa(%s) gave %s", ref, buf);
+		snprintf(ref, sizeof(ref), "%lx", (unsigned long)(long)v);
+		CHECK(strcmp(ltoa(v, buf, 16), ref) == 0, "ltoa(%d, 16) gave %s", v, buf);
+		snprintf(ref, sizeof(ref), "%u", (unsigned int)v);
+		CHECK(strcmp(utoa((unsigned int)v, buf, 10), ref) == 0, "utoa(%s) gave %s", ref, buf);
+		snprintf(ref, sizeof(ref), "%lo", (unsigned long)(unsigned int)v);
+		CHECK(strcmp(ultoa((unsigned int)v, buf, 8), ref) == 0, "ultoa(%s, 8) gave %s", ref, buf);
+	}
+}
+
+// A Print that collects its output in a string
+class StringPrint : public Print
+{
+public:
+	size_t write(uint8_t c) override { text += (char)c; return 1; }
+	size_t write(const uint8_t *buffer, size_t size) override { text.append((const char *)buffer, size); return size; }
+	std::string text;
+};
+
+// Check print() and println() of a value against the text that snprintf gives for the same value converted to the type that Print uses
+template<class T, class R> static void CheckPrint(T value, int base, const char *format, R refValue)
+{
+	char ref[80];
+	snprintf(ref, sizeof(ref), format, refValue);
+	StringPrint p;
+	p.print(value, base);
+	CHECK(p.text == ref, "print(%s, %d) gave %s", ref, base, p.text.c_str());
+	p.text.clear();
+	p.println(value, base);
+	CHECK(p.text == std::string(ref) + "\r\n", "println(%s, %d) gave %s", ref, base, p.text.c_str());
+}
+
+static void CheckPrintIntegers()
+{
+	// Negative values in other bases are printed as the two's complement of an unsigned long, as printf does
+	for (long v : { 0L, 1L, -1L, 255L, -255L, 1000000L, -1000000L, (long)INT32_MIN, (long)INT32_MAX })
+	{
+		CheckPrint(v, DEC, "%ld", v);
+		CheckPrint(v, HEX, "%lX", (unsigned long)v);
+		CheckPrint(v, OCT, "%lo", (unsigned long)v);
+		CheckPrint((int)v, DEC, "%ld", (long)(int)v);
+		CheckPrint((int)v, HEX, "%lX", (unsigned long)(long)(int)v);
+		CheckPrint((unsigned long)v, HEX, "%lX", (unsigned long)v);
+	}
+	for (long long v : { 0LL, -1LL, (long long)INT64_MIN, (long long)INT64_MAX, -123456789012345LL })
+	{
+		CheckPrint(v, DEC, "%lld", v);
+		CheckPrint(v, HEX, "%llX", (unsigned long long)v);
+	}
+
+	StringPrint p;
+	p.print(-1L, BIN);
+	CHECK(p.text == std::string(sizeof(long) * 8, '1'), "print(-1L, BIN) gave %s", p.text.c_str());
+}
+
+int main()
+{
+	CheckDivides();
+	CheckIntegers();
+	CheckFloats();
+	CheckItoa();
+	CheckPrintIntegers();
+	return HostTestResult("NumberFormatTest");
+}
@@ -0,0 +1,225 @@
+/*
+  PdcTxBench.cpp - Compare the interrupt load of sending a character per TXRDY interrupt with sending blocks by PDC
+
+  A simulated UART sends one character per character time from its holding register. Its PDC transmit channel has
+  the TPR/TCR/TNPR/TNCR registers and sets ENDTX and TXBUFE as the hardware does. The two transmit paths are copies of
+  the ones in UARTClass: the TXRDY handler that moves one character from the ring buffer to THR, and StartTxDma(),
+  which the ENDTX interrupt calls to release the block just sent and start the next contiguous block.
+
+  The application writes replies of random length with gaps between them, as the firmware does to PanelDue or the SBC.
+  Every byte written must come out of the transmitter in order. The host times include the simulated hardware, which
+  costs about the same per character in both modes, so the interrupt counts are the figures that carry over to the target.
+*/
+
+#include "HostTest.h"
+#include "RingBuffer.h"
+#include <algorithm>
+#include <vector>
+
+constexpr uint32_t SR_TXRDY = 1u << 1;			// bit positions as in the SAM3X/SAM4 UART_SR
+constexpr uint32_t SR_ENDTX = 1u << 4;
+constexpr uint32_t SR_TXBUFE = 1u << 11;
+
+constexpr size_t TotalBytes = 1u << 20;
+constexpr size_t Passes = 5;
+
+// The transmit side of a UART and its PDC channel
+struct SimUart
+{
+	uint32_t imr = 0;
+	int thr = -1;								// the holding register, -1 when it is empty
+	int shifter = -1;							// the character being sent, -1 when the line is idle
+	bool txten = false;							// PTCR.TXTEN
+	const uint8_t *tpr = nullptr;
+	uint32_t tcr = 0;
+	const uint8_t *tnpr = nullptr;
+	uint32_t tncr = 0;
+	std::vector<uint8_t> line;					// what has been sent
+
+	uint32_t Status() const
+	{
+		return ((thr < 0) ? SR_TXRDY : 0) | ((tcr == 0) ? SR_ENDTX : 0) | ((tcr == 0 && tncr == 0) ? SR_TXBUFE : 0);
+	}
+
+	// The PDC writes the next byte as soon as the holding register is empty, and moves on to the next buffer when the current one is done
+	void PdcStep()
+	{
+		if (txten && thr < 0 && tcr != 0)
+		{
+			thr = *tpr++;
+			if (--tcr == 0 && tncr != 0)
+			{
+				tpr = tnpr;
+				tcr = tncr;
+				tncr = 0;
+			}
+		}
+	}
+
+	// The shift register finishes its character and takes the next one from the holding register
+	void CharacterTime()
+	{
+		if (shifter >= 0)
+		{
+			line.push_back((uint8_t)shifter);
+		}
+		shifter = thr;
+		thr = -1;
+		PdcStep();
+	}
+};
+
+// The transmit code of UARTClass, running on the simulated UART
+class TxPort
+{
+public:
+	TxPort(SimUart& p_uart, bool dma) : uart(p_uart), txInterrupts((dma) ? SR_ENDTX : SR_TXRDY), txDmaCount(0), txDmaEnabled(dma)
+	{
+		uart.txten = dma;
+	}
+
+	// One pass of the loop in UARTClass::write(const uint8_t *, size_t). The caller comes back for the rest if the buffer is full.
+	size_t WriteSome(const uint8_t *buffer, size_t size)
+	{
+		const size_t written = txBuffer.storeBlock(buffer, size);
+		uart.imr |= txInterrupts;
+		return written;
+	}
+
+	__attribute__((noinline)) void IrqHandler()
+	{
+		const uint32_t status = uart.Status();
+		if (txDmaEnabled)
+		{
+			if ((status & txInterrupts) != 0)
+			{
+				StartTxDma();
+			}
+		}
+		else if ((status & SR_TXRDY) != 0)
+		{
+			const int c = txBuffer.read();
+			if (c >= 0)
+			{
+				uart.thr = (uint8_t)c;
+			}
+			else
+			{
+				uart.imr &= ~SR_TXRDY;
+			}
+		}
+	}
+
+	bool IsIdle() const { return txBuffer.isEmpty(); }
+
+private:
+	void StartTxDma()
+	{
+		txBuffer.consume(txDmaCount);
+		size_t len;
+		const uint8_t * const data = txBuffer.peekContiguous(len);
+		txDmaCount = len;
+		if (len == 0)
+		{
+			uart.imr &= ~txInterrupts;
+			return;
+		}
+
+		// pdc_tx_init() with no next packet
+		uart.tpr = data;
+		uart.tcr = len;
+	}
+
+	SimUart& uart;
+	RingBuffer<SERIAL_BUFFER_SIZE> txBuffer;
+	uint32_t txInterrupts;
+	size_t txDmaCount;
+	bool txDmaEnabled;
+};
+
+static uint8_t source[TotalBytes];
+
+struct RunResult
+{
+	size_t interrupts;
+	bool ok;
+};
+
+// Send the source data as a series of replies and count the interrupts taken
+static RunResult Run(bool dma)
+{
+	SimUart uart;
+	uart.line.reserve(TotalBytes);
+	TxPort port(uart, dma);
+	Xorshift64 rng;
+	RunResult result = { 0, true };
+
+	auto serviceInterrupts = [&]() {
+		while ((uart.Status() & uart.imr) != 0)
+		{
+			++result.interrupts;
+			port.IrqHandler();
+			uart.PdcStep();
+		}
+	};
+
+	size_t written = 0, replyEnd = 0;
+	unsigned int gap = 0;
+	while (uart.line.size() < TotalBytes)
+	{
+		if (written < replyEnd)
+		{
+			written += port.WriteSome(source + written, replyEnd - written);
+			serviceInterrupts();
+		}
+		else if (gap != 0)
+		{
+			--gap;
+		}
+		else if (written < TotalBytes)
+		{
+			const uint64_t r = rng.Next();
+			replyEnd = std::min(written + 16 + (size_t)(r % 497), TotalBytes);
+			gap = (unsigned int)(r >> 32) % 400;
+			continue;
+		}
+		else if (port.IsIdle() && uart.thr < 0 && uart.shifter < 0)
+		{
+			break;
+		}
+
+		uart.CharacterTime();
+		serviceInterrupts();
+	}
+
+	result.ok = uart.line.size() == TotalBytes && std::equal(uart.line.begin(), uart.line.end(), source);
+	return result;
+}
+
+static bool Report(const char *name, bool dma)
+{
+	RunResult result = { 0, false };
+	const double ns = TimeNanoseconds(Passes, [&](size_t) { result = Run(dma); });
+	printf("%-34s %10.3f %12.1f %10.2f\n", name, (double)result.interrupts/TotalBytes, (double)TotalBytes/result.interrupts, ns/TotalBytes);
+	if (!result.ok)
+	{
+		printf("  the bytes sent did not match the bytes written\n");
+	}
+	return result.ok;
+}
+
+int main()
+{
+	Xorshift64 rng;
+	for (size_t i = 0; i < TotalBytes; ++i)
+	{
+		source[i] = (uint8_t)rng.Next();
+	}
+
+	bool ok = true;
+	printf("replies of 16 to 512 bytes through a %zu-byte transmit buffer\n", SERIAL_BUFFER_SIZE);
+	printf("%-34s %10s %12s %10s\n", "", "irqs/byte", "bytes/irq", "ns/byte");
+	ok &= Report("TXRDY interrupt per character", false);
+	ok &= Report("PDC block per ENDTX interrupt", true);
+	return (ok) ? 0 : 1;
+}
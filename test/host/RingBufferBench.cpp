@@ -0,0 +1,213 @@
+/*
+  RingBufferBench.cpp - Compare the throughput of the ring buffer with the volatile modulo-indexed one it replaced
+
+  The producer and the consumer take turns on one thread, as the receive interrupt and the task that reads the port do
+  on the target: the producer stores a burst of characters, then the consumer takes them all. The consumer folds each
+  byte into a checksum, which must match the data that was sent.
+*/
+
+#include "HostTest.h"
+#include "RingBuffer.h"
+#include <cstring>
+
+// The ring buffer before it became a template, with the read functions that UARTClass used with it
+class OldRingBuffer
+{
+public:
+	volatile uint8_t _aucBuffer[SERIAL_BUFFER_SIZE];
+	volatile size_t _iHead = 0;
+	volatile size_t _iTail = 0;
+
+	void store_char(uint8_t c)
+	{
+		size_t i = (_iHead + 1) % SERIAL_BUFFER_SIZE;
+		if (i != _iTail)
+		{
+			_aucBuffer[_iHead] = c;
+			_iHead = i;
+		}
+		else
+		{
+			_aucBuffer[(_iHead - 1) % SERIAL_BUFFER_SIZE] = 0x7F;
+		}
+	}
+
+	size_t roomLeft() const
+	{
+		return (_iTail + (SERIAL_BUFFER_SIZE - 1) - _iHead) % SERIAL_BUFFER_SIZE;
+	}
+
+	size_t storeBlock(const uint8_t *data, size_t len)
+	{
+		const size_t room = roomLeft();
+		if (room < len)
+		{
+			len = room;
+		}
+		if (len != 0)
+		{
+			const size_t roomToEnd = SERIAL_BUFFER_SIZE - _iHead;
+			if (roomToEnd <= len)
+			{
+				memcpy((void*)(_aucBuffer + _iHead), data, roomToEnd);
+				memcpy((void*)_aucBuffer, data + roomToEnd, len - roomToEnd);
+				_iHead = len - roomToEnd;
+			}
+			else
+			{
+				memcpy((void*)(_aucBuffer + _iHead), data, len);
+				_iHead += len;
+			}
+		}
+		return len;
+	}
+
+	int available()
+	{
+		return (SERIAL_BUFFER_SIZE + _iHead - _iTail) % SERIAL_BUFFER_SIZE;
+	}
+
+	int read()
+	{
+		if (_iHead == _iTail)
+		{
+			return -1;
+		}
+		uint8_t uc = _aucBuffer[_iTail];
+		_iTail = (_iTail + 1) % SERIAL_BUFFER_SIZE;
+		return uc;
+	}
+};
+
+constexpr size_t TotalBytes = 1u << 20;
+constexpr size_t Burst = 64;						// about what arrives between two polls of a busy port
+constexpr size_t Passes = 20;
+
+static uint8_t source[TotalBytes];
+
+static inline uint32_t Fold(uint32_t checksum, uint8_t b)
+{
+	return checksum * 31 + b;
+}
+
+// Time a transfer of the source data and check that it arrived intact
+template<class F> static bool Report(const char *name, uint32_t expected, F transfer)
+{
+	uint32_t checksum = 0;
+	const double ns = TimeNanoseconds(Passes, [&](size_t) { checksum = transfer(); });
+	printf("%-46s %8.2f\n", name, ns / TotalBytes);
+	if (checksum != expected)
+	{
+		printf("  checksum 0x%08x, expected 0x%08x\n", (unsigned int)checksum, (unsigned int)expected);
+		return false;
+	}
+	return true;
+}
+
+int main()
+{
+	Xorshift64 rng;
+	uint32_t expected = 0;
+	for (size_t i = 0; i < TotalBytes; ++i)
+	{
+		source[i] = (uint8_t)rng.Next();
+		expected = Fold(expected, source[i]);
+	}
+
+	static OldRingBuffer oldBuffer;
+	static RingBuffer<SERIAL_BUFFER_SIZE> newBuffer;
+	bool ok = true;
+
+	printf("ns per byte, in bursts of %zu through a %zu-byte buffer\n", Burst, SERIAL_BUFFER_SIZE);
+	ok &= Report("old store_char and read", expected, [&]() {
+				uint32_t checksum = 0;
+				for (size_t pos = 0; pos < TotalBytes; pos += Burst)
+				{
+					for (size_t i = 0; i < Burst; ++i)
+					{
+						oldBuffer.store_char(source[pos + i]);
+					}
+					int c;
+					while ((c = oldBuffer.read()) >= 0)
+					{
+						checksum = Fold(checksum, (uint8_t)c);
+					}
+				}
+				return checksum;
+			});
+	ok &= Report("store_char and read", expected, [&]() {
+				uint32_t checksum = 0;
+				for (size_t pos = 0; pos < TotalBytes; pos += Burst)
+				{
+					for (size_t i = 0; i < Burst; ++i)
+					{
+						newBuffer.store_char(source[pos + i]);
+					}
+					int c;
+					while ((c = newBuffer.read()) >= 0)
+					{
+						checksum = Fold(checksum, (uint8_t)c);
+					}
+				}
+				return checksum;
+			});
+	ok &= Report("old storeBlock and read", expected, [&]() {
+				uint32_t checksum = 0;
+				for (size_t pos = 0; pos < TotalBytes; pos += Burst)
+				{
+					oldBuffer.storeBlock(source + pos, Burst);
+					while (oldBuffer.available() != 0)
+					{
+						checksum = Fold(checksum, (uint8_t)oldBuffer.read());
+					}
+				}
+				return checksum;
+			});
+	ok &= Report("storeBlock and readBlock", expected, [&]() {
+				uint32_t checksum = 0;
+				uint8_t block[Burst];
+				for (size_t pos = 0; pos < TotalBytes; pos += Burst)
+				{
+					newBuffer.storeBlock(source + pos, Burst);
+					size_t n;
+					while ((n = newBuffer.readBlock(block, sizeof(block))) != 0)
+					{
+						for (size_t i = 0; i < n; ++i)
+						{
+							checksum = Fold(checksum, block[i]);
+						}
+					}
+				}
+				return checksum;
+			});
+	ok &= Report("reserve/commit and peekContiguous/consume", expected, [&]() {
+				uint32_t checksum = 0;
+				for (size_t pos = 0; pos < TotalBytes; pos += Burst)
+				{
+					// The DMA controller writes straight into the buffer on the target, so the copy here stands in for it
+					size_t stored = 0;
+					while (stored < Burst)
+					{
+						size_t room;
+						uint8_t * const p = newBuffer.reserve(room);
+						const size_t n = (room < Burst - stored) ? room : Burst - stored;
+						memcpy(p, source + pos + stored, n);
+						newBuffer.commit(n);
+						stored += n;
+					}
+
+					size_t n;
+					const uint8_t *p;
+					while (p = newBuffer.peekContiguous(n), n != 0)
+					{
+						for (size_t i = 0; i < n; ++i)
+						{
+							checksum = Fold(checksum, p[i]);
+						}
+						newBuffer.consume(n);
+					}
+				}
+				return checksum;
+			});
+	return (ok) ? 0 : 1;
+}
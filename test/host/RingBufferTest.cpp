@@ -0,0 +1,189 @@
+/*
+  RingBufferTest.cpp - Check the ring buffer against a queue, and with a producer running concurrently with the consumer
+
+  The model check mixes every producer and consumer function with random lengths, so the data wraps round the end of
+  the buffer at every possible offset. The concurrent check streams a known sequence from a producer thread while the
+  consumer peeks and reads blocks. On a host with more than one core, a consumer that reads the head more than once
+  during a copy soon sees bytes out of sequence. With a single core the producer seldom runs inside that window.
+*/
+
+#include "HostTest.h"
+#include "RingBuffer.h"
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <thread>
+
+static void CheckAgainstModel()
+{
+	RingBuffer<64> buffer;
+	std::deque<uint8_t> model;
+	Xorshift64 rng;
+	uint8_t next = 0;
+	uint8_t block[100];
+
+	for (unsigned int iteration = 0; iteration < 1000000; ++iteration)
+	{
+		const uint64_t r = rng.Next();
+		const size_t len = (r >> 8) % 80;
+		switch (r % 8)
+		{
+		case 0:			// store_char, which replaces the last character by DEL when the buffer is full
+			if (model.size() < buffer.size())
+			{
+				model.push_back(next);
+			}
+			else
+			{
+				model.back() = 0x7F;
+			}
+			buffer.store_char(next++);
+			break;
+
+		case 1:			// storeBlock
+			{
+				for (size_t i = 0; i < len; ++i)
+				{
+					block[i] = (uint8_t)(next + i);
+				}
+				const size_t expected = std::min(len, buffer.size() - model.size());
+				const size_t stored = buffer.storeBlock(block, len);
+				CHECK(stored == expected, "iteration %u: storeBlock stored %zu of %zu, expected %zu", iteration, stored, len, expected);
+				for (size_t i = 0; i < stored; ++i)
+				{
+					model.push_back(block[i]);
+				}
+				next += stored;
+			}
+			break;
+
+		case 2:			// reserve and commit
+			{
+				size_t room;
+				uint8_t * const p = buffer.reserve(room);
+				const size_t n = std::min(room, len);
+				for (size_t i = 0; i < n; ++i)
+				{
+					p[i] = next;
+					model.push_back(next++);
+				}
+				buffer.commit(n);
+			}
+			break;
+
+		case 3:			// read
+			{
+				const int c = buffer.read();
+				CHECK(c == (model.empty() ? -1 : model.front()), "iteration %u: read", iteration);
+				if (!model.empty())
+				{
+					model.pop_front();
+				}
+			}
+			break;
+
+		case 4:			// peekBlock
+		case 5:			// readBlock
+			{
+				const size_t n = (r % 8 == 4) ? buffer.peekBlock(block, len) : buffer.readBlock(block, len);
+				CHECK(n == std::min(len, model.size()), "iteration %u: block of %zu from %zu returned %zu", iteration, len, model.size(), n);
+				for (size_t i = 0; i < n && i < model.size(); ++i)
+				{
+					CHECK(block[i] == model[i], "iteration %u: byte %zu of a block", iteration, i);
+				}
+				if (r % 8 == 5)
+				{
+					model.erase(model.begin(), model.begin() + std::min(n, model.size()));
+				}
+			}
+			break;
+
+		case 6:			// peekContiguous and consume
+			{
+				size_t avail;
+				const uint8_t * const p = buffer.peekContiguous(avail);
+				CHECK(avail <= model.size(), "iteration %u: peekContiguous returned %zu of %zu", iteration, avail, model.size());
+				const size_t n = std::min(std::min(avail, len), model.size());
+				for (size_t i = 0; i < n; ++i)
+				{
+					CHECK(p[i] == model[i], "iteration %u: byte %zu of a contiguous block", iteration, i);
+				}
+				buffer.consume(n);
+				model.erase(model.begin(), model.begin() + n);
+			}
+			break;
+
+		case 7:			// peek
+			CHECK(buffer.peek() == (model.empty() ? -1 : model.front()), "iteration %u: peek", iteration);
+			break;
+		}
+
+		CHECK(buffer.available() == model.size(), "iteration %u: available %zu, expected %zu", iteration, buffer.available(), model.size());
+		CHECK(buffer.roomLeft() == buffer.size() - model.size(), "iteration %u: roomLeft", iteration);
+	}
+}
+
+static void CheckConcurrentProducer()
+{
+	constexpr size_t Total = 4000000;
+	static RingBuffer<256> buffer;
+	std::atomic<bool> done(false);
+
+	std::thread producer([&]() {
+		uint8_t next = 0;
+		size_t sent = 0;
+		while (sent < Total)
+		{
+			size_t room;
+			uint8_t * const p = buffer.reserve(room);
+			if (room == 0)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+			const size_t n = std::min(std::min(room, (size_t)7), Total - sent);		// small stores, so that they often land while the consumer is copying
+			for (size_t i = 0; i < n; ++i)
+			{
+				p[i] = next++;
+			}
+			buffer.commit(n);
+			sent += n;
+		}
+		done = true;
+	});
+
+	uint8_t expected = 0;
+	size_t received = 0;
+	uint8_t block[200];
+	unsigned int errors = 0;
+	while (received < Total)
+	{
+		const size_t peeked = buffer.peekBlock(block, sizeof(block));
+		for (size_t i = 0; i < peeked; ++i)
+		{
+			errors += (block[i] != (uint8_t)(expected + i));
+		}
+		const size_t n = buffer.readBlock(block, sizeof(block));
+		if (n == 0)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+		CHECK(n >= peeked, "readBlock returned %zu after peekBlock returned %zu", n, peeked);
+		for (size_t i = 0; i < n; ++i)
+		{
+			errors += (block[i] != expected++);
+		}
+		received += n;
+	}
+	producer.join();
+	CHECK(errors == 0, "%u bytes out of sequence with a concurrent producer", errors);
+	CHECK(done && buffer.available() == 0, "the producer sent more than expected");
+}
+
+int main()
+{
+	CheckAgainstModel();
+	CheckConcurrentProducer();
+	return HostTestResult("RingBufferTest");
+}
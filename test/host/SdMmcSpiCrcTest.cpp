@@ -0,0 +1,118 @@
+/*
+  SdMmcSpiCrcTest.cpp - Check the table-driven CRC7 and CRC16 in the SD card driver against bitwise references
+
+  Every single-byte input and random blocks of every length up to a sector are checked. The CRC16 is also checked when
+  a block is fed in pieces, as sd_mmc_spi_read_word() and sd_mmc_spi_write_word() do, and against the examples in
+  the SD specification.
+*/
+
+#include "HostTest.h"
+#include <cstddef>
+#include <cstring>
+
+extern "C" uint8_t test_sd_mmc_spi_crc7(uint8_t *buf, uint8_t size);
+extern "C" uint16_t test_sd_mmc_spi_crc16(uint16_t crc, const uint8_t *buf, size_t size);
+
+// CRC7 with polynomial x^7 + x^3 + 1, returned the way the driver sends it: shifted left by one bit, with the end bit set
+static uint8_t ReferenceCrc7(const uint8_t *buf, size_t size)
+{
+	unsigned int crc = 0;
+	for (size_t i = 0; i < size; ++i)
+	{
+		for (int bit = 7; bit >= 0; --bit)
+		{
+			const unsigned int feedback = ((buf[i] >> bit) ^ (crc >> 6)) & 1;
+			crc = (crc << 1) & 0x7F;
+			if (feedback != 0)
+			{
+				crc ^= 0x09;
+			}
+		}
+	}
+	return (uint8_t)((crc << 1) | 1);
+}
+
+// CRC16 with polynomial x^16 + x^12 + x^5 + 1 and an initial value of 0
+static uint16_t ReferenceCrc16(uint16_t crc, const uint8_t *buf, size_t size)
+{
+	for (size_t i = 0; i < size; ++i)
+	{
+		for (int bit = 7; bit >= 0; --bit)
+		{
+			const unsigned int feedback = ((buf[i] >> bit) ^ (crc >> 15)) & 1;
+			crc = (uint16_t)(crc << 1);
+			if (feedback != 0)
+			{
+				crc ^= 0x1021;
+			}
+		}
+	}
+	return crc;
+}
+
+static void CheckKnownValues()
+{
+	// The CMD0 and CMD8 tokens that every card initialisation sends
+	uint8_t cmd0[5] = { 0x40, 0x00, 0x00, 0x00, 0x00 };
+	uint8_t cmd8[5] = { 0x48, 0x00, 0x00, 0x01, 0xAA };
+	CHECK(test_sd_mmc_spi_crc7(cmd0, 5) == 0x95, "CRC7 of CMD0 is 0x%02x", test_sd_mmc_spi_crc7(cmd0, 5));
+	CHECK(test_sd_mmc_spi_crc7(cmd8, 5) == 0x87, "CRC7 of CMD8 is 0x%02x", test_sd_mmc_spi_crc7(cmd8, 5));
+
+	// The CRC16 of a 512-byte block of 0xFF given in the SD specification
+	uint8_t block[512];
+	memset(block, 0xFF, sizeof(block));
+	const uint16_t crc = test_sd_mmc_spi_crc16(0, block, sizeof(block));
+	CHECK(crc == 0x7FA1, "CRC16 of 512 bytes of 0xFF is 0x%04x", crc);
+}
+
+static void CheckSingleBytes()
+{
+	for (unsigned int i = 0; i < 256; ++i)
+	{
+		uint8_t b = (uint8_t)i;
+		CHECK(test_sd_mmc_spi_crc7(&b, 1) == ReferenceCrc7(&b, 1), "CRC7 of byte 0x%02x", i);
+		CHECK(test_sd_mmc_spi_crc16(0, &b, 1) == ReferenceCrc16(0, &b, 1), "CRC16 of byte 0x%02x", i);
+	}
+}
+
+static void CheckBlocks()
+{
+	Xorshift64 rng;
+	uint8_t block[512];
+	for (size_t length = 0; length <= sizeof(block); ++length)
+	{
+		for (unsigned int pass = 0; pass < 4; ++pass)
+		{
+			for (size_t i = 0; i < length; ++i)
+			{
+				block[i] = (uint8_t)rng.Next();
+			}
+
+			if (length <= 255)
+			{
+				CHECK(test_sd_mmc_spi_crc7(block, (uint8_t)length) == ReferenceCrc7(block, length), "CRC7 of %zu random bytes", length);
+			}
+
+			const uint16_t expected = ReferenceCrc16(0, block, length);
+			CHECK(test_sd_mmc_spi_crc16(0, block, length) == expected, "CRC16 of %zu random bytes", length);
+
+			// Fed one word at a time, carrying the CRC over as the driver does
+			uint16_t crc = 0;
+			size_t pos = 0;
+			for (; pos + 4 <= length; pos += 4)
+			{
+				crc = test_sd_mmc_spi_crc16(crc, block + pos, 4);
+			}
+			crc = test_sd_mmc_spi_crc16(crc, block + pos, length - pos);
+			CHECK(crc == expected, "CRC16 of %zu random bytes in 4-byte pieces", length);
+		}
+	}
+}
+
+int main()
+{
+	CheckKnownValues();
+	CheckSingleBytes();
+	CheckBlocks();
+	return HostTestResult("SdMmcSpiCrcTest");
+}
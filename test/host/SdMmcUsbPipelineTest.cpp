@@ -0,0 +1,260 @@
+/*
+  SdMmcUsbPipelineTest.cpp - Check the card to USB pipeline of sd_mmc_mem.c against mocked card and USB transfers
+
+  The mocked USB transfers finish after a random number of polls, and each one copies its data only when it finishes,
+  so a buffer that the pipeline reuses too early gets the wrong data sent to the host or written to the card. The card
+  and USB mocks also check that they never work on the same buffer at once, that no more than one USB transfer is
+  active, and that no USB transfer is left using a buffer when READ(10) or WRITE(10) returns. Some commands have a USB
+  abort, a failed USB start or a card error injected at a random point, and must then fail cleanly.
+*/
+
+#include "HostTest.h"
+#include <cstring>
+
+extern "C"
+{
+#include "sd_mmc.h"
+#include "sd_mmc_mem.h"
+#include "udi_msc.h"
+}
+
+constexpr uint32_t CardSectors = 1024;
+constexpr uint16_t MaxCommandSectors = 200;
+
+static uint8_t card[CardSectors * SD_MMC_BLOCK_SIZE];
+static uint8_t host[MaxCommandSectors * SD_MMC_BLOCK_SIZE];		// what the host sent or received
+static Xorshift64 rng;
+
+// The failure injected into the current command, and the transfer number at which it happens
+enum class Failure { none, noCard, usbAbort, usbStart, cardError };
+static Failure failure;
+static unsigned int failAt;
+
+// State of the card command opened by sd_mmc_init_read_blocks() or sd_mmc_init_write_blocks()
+static bool cardOpen;
+static bool cardWriting;
+static uint32_t cardPos;
+static uint32_t cardRemaining;
+static unsigned int cardTransfers;
+static unsigned int cardWhileUsbBusy;			// card transfers that ran while USB was moving another buffer
+
+// State of the USB transfer started by udi_msc_start_trans_block()
+static bool usbActive;
+static bool usbRead;
+static bool usbAbort;
+static uint8_t *usbBuffer;
+static uint32_t usbLength;
+static unsigned int usbPolls;
+static uint32_t hostPos;
+static uint8_t usbSnapshot[8 * SD_MMC_BLOCK_SIZE];
+static unsigned int usbTransfers;
+static unsigned int usbBusyPolls;
+
+static bool Overlaps(const void *p, size_t length)
+{
+	return usbActive && (const uint8_t *)p < usbBuffer + usbLength && usbBuffer < (const uint8_t *)p + length;
+}
+
+static sd_mmc_err_t InitBlocks(bool writing, uint8_t slot, uint32_t start, uint16_t nb_block)
+{
+	CHECK(slot == 0, "command for slot %u", slot);
+	CHECK(!cardOpen, "a card command was started while another was open");
+	if (failure == Failure::noCard)
+	{
+		return SD_MMC_ERR_NO_CARD;
+	}
+	cardOpen = true;
+	cardWriting = writing;
+	cardPos = start;
+	cardRemaining = nb_block;
+	return SD_MMC_OK;
+}
+
+static sd_mmc_err_t StartBlocks(bool writing, void *buffer, uint16_t nb_block)
+{
+	CHECK(cardOpen && cardWriting == writing, "card transfer without an open command");
+	CHECK(nb_block != 0 && nb_block <= cardRemaining, "card transfer of %u blocks with %u remaining", nb_block, cardRemaining);
+	CHECK(!Overlaps(buffer, nb_block * SD_MMC_BLOCK_SIZE), "card transfer into the buffer that USB is using");
+	if (failure == Failure::cardError && cardTransfers++ == failAt)
+	{
+		cardOpen = false;					// the driver gives up on the command after an error
+		return SD_MMC_ERR_COMM;
+	}
+	if (usbActive)
+	{
+		++cardWhileUsbBusy;
+	}
+	nb_block = Min(nb_block, cardRemaining);
+	uint8_t * const p = &card[cardPos * SD_MMC_BLOCK_SIZE];
+	if (writing)
+	{
+		memcpy(p, buffer, nb_block * SD_MMC_BLOCK_SIZE);
+	}
+	else
+	{
+		memcpy(buffer, p, nb_block * SD_MMC_BLOCK_SIZE);
+	}
+	cardPos += nb_block;
+	cardRemaining -= nb_block;
+	return SD_MMC_OK;
+}
+
+static sd_mmc_err_t WaitEndOfBlocks(bool writing, bool abort)
+{
+	CHECK(cardOpen && cardWriting == writing, "wait for the end of a card transfer without an open command");
+	if (abort || cardRemaining == 0)
+	{
+		cardOpen = false;
+	}
+	return SD_MMC_OK;
+}
+
+extern "C" sd_mmc_err_t sd_mmc_init_read_blocks(uint8_t slot, uint32_t start, uint16_t nb_block) { return InitBlocks(false, slot, start, nb_block); }
+extern "C" sd_mmc_err_t sd_mmc_init_write_blocks(uint8_t slot, uint32_t start, uint16_t nb_block) { return InitBlocks(true, slot, start, nb_block); }
+extern "C" sd_mmc_err_t sd_mmc_start_read_blocks(void *dest, uint16_t nb_block) { return StartBlocks(false, dest, nb_block); }
+extern "C" sd_mmc_err_t sd_mmc_start_write_blocks(const void *src, uint16_t nb_block) { return StartBlocks(true, const_cast<void *>(src), nb_block); }
+extern "C" sd_mmc_err_t sd_mmc_wait_end_of_read_blocks(bool abort) { return WaitEndOfBlocks(false, abort); }
+extern "C" sd_mmc_err_t sd_mmc_wait_end_of_write_blocks(bool abort) { return WaitEndOfBlocks(true, abort); }
+
+extern "C" bool udi_msc_start_trans_block(bool b_read, uint8_t *block, iram_size_t block_size)
+{
+	CHECK(!usbActive, "a USB transfer was started while another was active");
+	CHECK(block_size != 0 && block_size <= sizeof(usbSnapshot) && block_size % SD_MMC_BLOCK_SIZE == 0, "USB transfer of %u bytes", (unsigned int)block_size);
+	CHECK(hostPos + block_size <= sizeof(host), "USB transfer beyond the end of the command");
+	const unsigned int transfer = usbTransfers++;
+	if (failure == Failure::usbStart && transfer == failAt)
+	{
+		return false;
+	}
+	usbActive = true;
+	usbAbort = (failure == Failure::usbAbort && transfer == failAt);
+	usbRead = b_read;
+	usbBuffer = block;
+	usbLength = Min(block_size, (iram_size_t)sizeof(usbSnapshot));
+	usbPolls = rng.Next() % 8;
+	if (b_read)
+	{
+		memcpy(usbSnapshot, block, usbLength);
+	}
+	return true;
+}
+
+// The data moves when the transfer finishes, so the buffer must be left alone until then
+extern "C" bool udi_msc_is_trans_block_done(bool *b_aborted)
+{
+	if (!usbActive)
+	{
+		*b_aborted = false;
+		return true;
+	}
+	if (usbPolls != 0)
+	{
+		--usbPolls;
+		++usbBusyPolls;
+		return false;
+	}
+
+	usbActive = false;
+	if (usbAbort)
+	{
+		*b_aborted = true;
+		return true;
+	}
+	if (usbRead)
+	{
+		CHECK(memcmp(usbSnapshot, usbBuffer, usbLength) == 0, "a buffer was changed while USB was sending it");
+		memcpy(&host[hostPos], usbBuffer, usbLength);
+	}
+	else
+	{
+		memcpy(usbBuffer, &host[hostPos], usbLength);
+	}
+	hostPos += usbLength;
+	*b_aborted = false;
+	return true;
+}
+
+static void FillRandom(uint8_t *p, size_t length)
+{
+	for (size_t i = 0; i < length; ++i)
+	{
+		p[i] = (uint8_t)rng.Next();
+	}
+}
+
+static void StartCommand(Failure f, uint16_t nb_sector)
+{
+	failure = f;
+	failAt = rng.Next() % ((nb_sector + 7) / 8);
+	cardTransfers = usbTransfers = 0;
+	hostPos = 0;
+}
+
+static void CheckCommands()
+{
+	static uint8_t before[sizeof(card)];
+	FillRandom(card, sizeof(card));
+	unsigned int failures = 0;
+
+	for (unsigned int iteration = 0; iteration < 20000; ++iteration)
+	{
+		const uint64_t r = rng.Next();
+		const uint16_t nb_sector = 1 + (uint16_t)((r >> 8) % MaxCommandSectors);
+		const uint32_t addr = (uint32_t)(r >> 24) % (CardSectors - nb_sector + 1);
+		const bool writing = (r & 1) != 0;
+		const unsigned int f = (r >> 40) % 32;
+		const Failure injected = (f == 0) ? Failure::noCard
+								: (f == 1) ? Failure::usbAbort
+								: (f == 2) ? Failure::usbStart
+								: (f == 3) ? Failure::cardError
+								: Failure::none;
+		StartCommand(injected, nb_sector);
+		const size_t length = nb_sector * SD_MMC_BLOCK_SIZE;
+
+		Ctrl_status status;
+		if (writing)
+		{
+			memcpy(before, card, sizeof(card));
+			FillRandom(host, length);
+			status = sd_mmc_usb_write_10_0(addr, nb_sector);
+			CHECK(memcmp(before, card, addr * SD_MMC_BLOCK_SIZE) == 0
+					&& memcmp(before + addr * SD_MMC_BLOCK_SIZE + length, card + addr * SD_MMC_BLOCK_SIZE + length, sizeof(card) - addr * SD_MMC_BLOCK_SIZE - length) == 0,
+					"iteration %u: write of %u sectors at %u changed sectors outside it", iteration, nb_sector, addr);
+		}
+		else
+		{
+			status = sd_mmc_usb_read_10_0(addr, nb_sector);
+		}
+
+		CHECK(!usbActive, "iteration %u: a USB transfer was still using a buffer after the command returned", iteration);
+		usbActive = false;
+		switch (injected)
+		{
+		case Failure::none:
+			CHECK(status == CTRL_GOOD, "iteration %u: %s of %u sectors at %u returned %d", iteration, (writing) ? "write" : "read", nb_sector, addr, (int)status);
+			CHECK(hostPos == length, "iteration %u: USB moved %u of %zu bytes", iteration, (unsigned int)hostPos, length);
+			CHECK(memcmp(host, &card[addr * SD_MMC_BLOCK_SIZE], length) == 0, "iteration %u: data of a %s of %u sectors at %u", iteration, (writing) ? "write" : "read", nb_sector, addr);
+			CHECK(!cardOpen, "iteration %u: the card command was left open", iteration);
+			break;
+
+		case Failure::noCard:
+			CHECK(status == CTRL_NO_PRESENT, "iteration %u: no card returned %d", iteration, (int)status);
+			break;
+
+		default:
+			CHECK(status == CTRL_FAIL, "iteration %u: failure %u returned %d", iteration, f, (int)status);
+			++failures;
+			break;
+		}
+		cardOpen = false;					// sd_mmc_check() resets the card after a failure
+	}
+
+	CHECK(failures != 0, "no failures were injected");
+	CHECK(cardWhileUsbBusy != 0 && usbBusyPolls != 0, "the card and USB transfers never overlapped");
+}
+
+int main()
+{
+	CheckCommands();
+	return HostTestResult("SdMmcUsbPipelineTest");
+}
@@ -0,0 +1,190 @@
+/*
+  SpanParserBench.cpp - Compare the non-blocking parsers with the character-at-a-time Stream code they replaced
+
+  The old code called the virtual peek() and read() functions, via the timed wrappers, once or twice for every character.
+  The new code looks at blocks of characters with peekAvailable() and parses them from memory.
+  The float data has three decimals, like G-code coordinates, so ParseFloat seldom needs to fall back to strtof.
+*/
+
+#include "HostTest.h"
+#include "SpanParser.h"
+#include "Stream.h"
+#include "UartLikeStream.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+// The old Stream functions, as free functions using the same virtual calls
+static int OldTimedPeek(Stream& s)
+{
+	const uint32_t start = millis();
+	do
+	{
+		const int c = s.peek();
+		if (c >= 0) return c;
+	} while (millis() - start < 1);
+	return -1;
+}
+
+static int OldTimedRead(Stream& s)
+{
+	const uint32_t start = millis();
+	do
+	{
+		const int c = s.read();
+		if (c >= 0) return c;
+	} while (millis() - start < 1);
+	return -1;
+}
+
+static int OldPeekNextDigit(Stream& s)
+{
+	while (true)
+	{
+		const int c = OldTimedPeek(s);
+		if (c < 0) return c;
+		if (c == '-') return c;
+		if (c >= '0' && c <= '9') return c;
+		s.read();
+	}
+}
+
+static long OldParseInt(Stream& s)
+{
+	bool isNegative = false;
+	long value = 0;
+	int c = OldPeekNextDigit(s);
+	if (c < 0) return 0;
+	do
+	{
+		if (c == '-') isNegative = true;
+		else if (c >= '0' && c <= '9') value = value * 10 + c - '0';
+		s.read();
+		c = OldTimedPeek(s);
+	} while (c >= '0' && c <= '9');
+	return (isNegative) ? -value : value;
+}
+
+static float OldParseFloat(Stream& s)
+{
+	bool isNegative = false, isFraction = false;
+	long value = 0;
+	float fraction = 1.0f;
+	int c = OldPeekNextDigit(s);
+	if (c < 0) return 0;
+	do
+	{
+		if (c == '-') isNegative = true;
+		else if (c == '.') isFraction = true;
+		else if (c >= '0' && c <= '9')
+		{
+			value = value * 10 + c - '0';
+			if (isFraction) fraction *= 0.1f;
+		}
+		s.read();
+		c = OldTimedPeek(s);
+	} while ((c >= '0' && c <= '9') || c == '.');
+	if (isNegative) value = -value;
+	return (isFraction) ? value * fraction : value;
+}
+
+static bool OldFindUntil(Stream& s, const char *target, size_t targetLen, const char *terminator, size_t termLen)
+{
+	size_t index = 0, termIndex = 0;
+	int c;
+	while ((c = OldTimedRead(s)) > 0)
+	{
+		if (c != target[index]) index = 0;
+		if (c == target[index] && ++index >= targetLen) return true;
+		if (termLen > 0 && c == terminator[termIndex])
+		{
+			if (++termIndex >= termLen) return false;
+		}
+		else
+		{
+			termIndex = 0;
+		}
+	}
+	return false;
+}
+
+int main()
+{
+	// A typical line of comma-separated numbers, as received from a host
+	std::string ints, floats;
+	Xorshift64 rng;
+	for (unsigned int i = 0; i < 2000; ++i)
+	{
+		const uint64_t r = rng.Next();
+		ints += std::to_string((int32_t)(r >> 32) >> (r & 31)) + ", ";
+		char coordinate[16];					// like a G-code coordinate, up to 1000mm with 3 decimals
+		snprintf(coordinate, sizeof(coordinate), "%.3f", (double)((int32_t)(r >> 32) % 1000000) / 1000.0);
+		floats += std::string(coordinate) + ", ";
+	}
+	constexpr size_t Passes = 200;
+
+	printf("ns per number\n");
+	UartLikeStream intStream(ints), floatStream(floats);
+	printf("%-34s %8.1f\n", "parseIntAvailable", TimeNanoseconds(Passes, [&](size_t) {
+				intStream.Rewind();
+				while (intStream.parseIntAvailable().error != ParseError::incomplete) { }
+			}) / 2000);
+	printf("%-34s %8.1f\n", "old parseInt", TimeNanoseconds(Passes, [&](size_t) {
+				intStream.Rewind();
+				while (intStream.available() > 2) { KeepResult(OldParseInt(intStream)); }
+			}) / 2000);
+	printf("%-34s %8.1f\n", "parseFloatAvailable", TimeNanoseconds(Passes, [&](size_t) {
+				floatStream.Rewind();
+				while (floatStream.parseFloatAvailable().error != ParseError::incomplete) { }
+			}) / 2000);
+	printf("%-34s %8.1f\n", "old parseFloat", TimeNanoseconds(Passes, [&](size_t) {
+				floatStream.Rewind();
+				while (floatStream.available() > 2) { KeepResult(OldParseFloat(floatStream)); }
+			}) / 2000);
+	printf("%-34s %8.1f\n", "ParseFloat on a span", TimeNanoseconds(Passes, [&](size_t) {
+				for (size_t pos = 0; pos < floats.size(); )
+				{
+					const ParseResult<float> r = ParseFloat(floats.data() + pos, floats.size() - pos);
+					KeepResult(r.value);
+					pos += r.consumed + 2;
+				}
+			}) / 2000);
+	printf("%-34s %8.1f\n", "strtof", TimeNanoseconds(Passes, [&](size_t) {
+				const char *p = floats.c_str();
+				while (*p != 0)
+				{
+					char *end;
+					KeepResult(strtof(p, &end));
+					p = end + 2;
+				}
+			}) / 2000);
+
+	// Search for a response that is near the end of a long block of text
+	std::string text;
+	for (unsigned int i = 0; i < 1000; ++i)
+	{
+		text += "ok T:210.3 /210.0 B:60.1 /60.0\n";
+	}
+	text += "Done printing file\n";
+	UartLikeStream textStream(text);
+	char target[] = "Done printing";
+	char terminator[] = "Error:";
+	printf("\nns per character searched\n");
+	printf("%-34s %8.2f\n", "findUntil", TimeNanoseconds(Passes, [&](size_t) {
+				textStream.Rewind();
+				KeepResult(textStream.findUntil(target, terminator));
+			}) / (double)text.size());
+	printf("%-34s %8.2f\n", "old findUntil", TimeNanoseconds(Passes, [&](size_t) {
+				textStream.Rewind();
+				KeepResult(OldFindUntil(textStream, target, strlen(target), terminator, strlen(terminator)));
+			}) / (double)text.size());
+	printf("%-34s %8.2f\n", "find", TimeNanoseconds(Passes, [&](size_t) {
+				textStream.Rewind();
+				KeepResult(textStream.find(target));
+			}) / (double)text.size());
+	const SpanSearcher searcher(target, strlen(target));
+	printf("%-34s %8.2f\n", "SpanSearcher on a span", TimeNanoseconds(Passes * 10, [&](size_t) {
+				KeepResult(searcher.Find(text.data(), text.size()));
+			}) / (double)text.size());
+	return 0;
+}
@@ -0,0 +1,418 @@
+/*
+  SpanParserTest.cpp - Fuzz the span parsers against the C library, and check the non-blocking Stream functions that use them
+
+  Random spans are made of a number followed by junk, or a number that runs to the end of the span.
+  Integers are checked against strtoll/strtoull and floats against strtof, which is correctly rounded in glibc.
+  The searchers are checked against a naive search.
+*/
+
+#include "HostTest.h"
+#include "SpanParser.h"
+#include "Stream.h"
+#include <cerrno>
+#include <cinttypes>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static std::string RandomDigits(Xorshift64& rng, size_t maxLength)
+{
+	const size_t len = (size_t)(rng.Next() % (maxLength + 1));
+	std::string s;
+	// Sometimes use leading zeros or runs of nines, which exercise the carries and the digit limits
+	const uint64_t style = rng.Next() % 8;
+	for (size_t i = 0; i < len; ++i)
+	{
+		s += (style == 0 && i < len/2) ? '0' : (style == 1) ? '9' : (char)('0' + rng.Next() % 10);
+	}
+	return s;
+}
+
+static std::string RandomSign(Xorshift64& rng)
+{
+	const uint64_t r = rng.Next() % 4;
+	return (r == 0) ? "-" : (r == 1) ? "+" : "";
+}
+
+// Either nothing, so that the number runs to the end of the span, or a character that ends the number
+static std::string RandomEnd(Xorshift64& rng)
+{
+	static const char terminators[] = " ,;x*\r\n-+.eE";
+	const uint64_t r = rng.Next() % 16;
+	return (r < 4) ? "" : std::string(1, terminators[r % (sizeof(terminators) - 1)]);
+}
+
+static const char *ErrorName(ParseError e)
+{
+	switch (e)
+	{
+	case ParseError::ok:			return "ok";
+	case ParseError::noDigits:		return "noDigits";
+	case ParseError::overflow:		return "overflow";
+	case ParseError::incomplete:	return "incomplete";
+	case ParseError::tooLong:		return "tooLong";
+	}
+	return "?";
+}
+
+// The result that the integer parsers should give, worked out from the magnitude that strtoull finds and the sign
+struct IntReference
+{
+	bool negative;
+	bool hasDigits;
+	bool magnitudeOverflowed;
+	unsigned long long magnitude;
+	size_t consumed;
+	bool atEnd;
+};
+
+static IntReference ReferenceInt(const std::string& s)
+{
+	IntReference ref = { false, false, false, 0, 0, false };
+	size_t pos = 0;
+	if (pos < s.size() && (s[pos] == '-' || s[pos] == '+'))
+	{
+		ref.negative = (s[pos] == '-');
+		++pos;
+	}
+	const size_t firstDigit = pos;
+	while (pos < s.size() && s[pos] >= '0' && s[pos] <= '9')
+	{
+		++pos;
+	}
+	ref.hasDigits = (pos != firstDigit);
+	ref.consumed = (ref.hasDigits) ? pos : 0;
+	ref.atEnd = (pos == s.size());
+	if (ref.hasDigits)
+	{
+		errno = 0;
+		ref.magnitude = strtoull(s.substr(firstDigit, pos - firstDigit).c_str(), nullptr, 10);
+		ref.magnitudeOverflowed = (errno == ERANGE);
+	}
+	return ref;
+}
+
+template<class T> static void CheckIntResult(const std::string& s, const char *name, const ParseResult<T>& r, T expected, bool overflow)
+{
+	const IntReference ref = ReferenceInt(s);
+	ParseError expectedError;
+	if (!ref.hasDigits)
+	{
+		// A sign on its own at the end may be followed by digits later
+		expectedError = (ref.atEnd && !s.empty()) ? ParseError::incomplete : ParseError::noDigits;
+		expected = 0;
+	}
+	else
+	{
+		expectedError = (overflow) ? ParseError::overflow : (ref.atEnd) ? ParseError::incomplete : ParseError::ok;
+	}
+	CHECK(r.value == expected && r.consumed == ref.consumed && r.error == expectedError,
+			"%s(\"%s\") gave %s consumed %zu %s", name, s.c_str(), std::to_string(r.value).c_str(), r.consumed, ErrorName(r.error));
+}
+
+static void CheckIntegers()
+{
+	Xorshift64 rng(1);
+	for (unsigned int i = 0; i < 2000000; ++i)
+	{
+		const std::string s = RandomSign(rng) + RandomDigits(rng, (i & 1) ? 12 : 25) + RandomEnd(rng);
+		const IntReference ref = ReferenceInt(s);
+
+		// int32: the magnitude of a negative number may be one more than INT32_MAX
+		{
+			const unsigned long long limit = (ref.negative) ? (unsigned long long)INT32_MAX + 1 : INT32_MAX;
+			const bool overflow = ref.magnitudeOverflowed || ref.magnitude > limit;
+			const unsigned long long m = (overflow) ? limit : ref.magnitude;
+			const int32_t expected = (ref.negative) ? (int32_t)(0u - (uint32_t)m) : (int32_t)m;
+			CheckIntResult(s, "ParseInt32", ParseInt32(s.data(), s.size()), expected, overflow);
+		}
+
+		// uint32: negative numbers other than zero overflow to 0
+		{
+			const bool overflow = ref.magnitudeOverflowed || ref.magnitude > UINT32_MAX || (ref.negative && ref.magnitude != 0);
+			const uint32_t expected = (ref.negative && overflow) ? 0 : (overflow) ? UINT32_MAX : (uint32_t)ref.magnitude;
+			CheckIntResult(s, "ParseUint32", ParseUint32(s.data(), s.size()), expected, overflow);
+		}
+
+		// int64
+		{
+			const unsigned long long limit = (ref.negative) ? (unsigned long long)INT64_MAX + 1 : INT64_MAX;
+			const bool overflow = ref.magnitudeOverflowed || ref.magnitude > limit;
+			const unsigned long long m = (overflow) ? limit : ref.magnitude;
+			const int64_t expected = (ref.negative) ? (int64_t)(0u - m) : (int64_t)m;
+			CheckIntResult(s, "ParseInt64", ParseInt64(s.data(), s.size()), expected, overflow);
+		}
+	}
+}
+
+// Return true if s consists of nothing but the start of a number that needs more characters, such as "-" or "+."
+static bool IsIncompletePrefix(const std::string& s)
+{
+	size_t pos = 0;
+	if (pos < s.size() && (s[pos] == '-' || s[pos] == '+'))
+	{
+		++pos;
+	}
+	if (pos < s.size() && s[pos] == '.')
+	{
+		++pos;
+	}
+	return pos == s.size() && pos != 0;
+}
+
+static void CheckFloat(const std::string& s)
+{
+	const ParseResult<float> r = ParseFloat(s.data(), s.size());
+	char *end;
+	const float expected = strtof(s.c_str(), &end);
+	const size_t consumed = (size_t)(end - s.c_str());
+	if (consumed == 0)
+	{
+		const ParseError expectedError = (IsIncompletePrefix(s)) ? ParseError::incomplete : ParseError::noDigits;
+		CHECK(r.consumed == 0 && r.error == expectedError, "ParseFloat(\"%s\") gave consumed %zu %s", s.c_str(), r.consumed, ErrorName(r.error));
+		return;
+	}
+
+	// The number may continue if it runs to the end of the span, or if all that follows it is the start of an exponent that it doesn't already have
+	const std::string rest = s.substr(consumed);
+	const bool hasExponent = s.find_first_of("eE") < consumed;
+	const bool atEnd = rest.empty()
+						|| (!hasExponent && (rest == "e" || rest == "E" || rest == "e-" || rest == "e+" || rest == "E-" || rest == "E+"));
+	CHECK(r.consumed == consumed, "ParseFloat(\"%s\") consumed %zu, expected %zu", s.c_str(), r.consumed, consumed);
+	if (std::isinf(expected))
+	{
+		CHECK(std::isinf(r.value) && r.error == ParseError::overflow, "ParseFloat(\"%s\") gave %g %s", s.c_str(), (double)r.value, ErrorName(r.error));
+	}
+	else if (r.error == ParseError::tooLong)
+	{
+		// Digits were dropped, so the result may be one ulp out
+		CHECK(consumed >= 64 && (r.value == expected || r.value == nextafterf(expected, INFINITY) || r.value == nextafterf(expected, -INFINITY)),
+				"ParseFloat(\"%s\") gave %.9g tooLong, expected %.9g", s.c_str(), (double)r.value, (double)expected);
+	}
+	else
+	{
+		const ParseError expectedError = (atEnd) ? ParseError::incomplete : ParseError::ok;
+		CHECK(r.value == expected && r.error == expectedError, "ParseFloat(\"%s\") gave %.9g %s, expected %.9g", s.c_str(), (double)r.value, ErrorName(r.error), (double)expected);
+	}
+}
+
+static void CheckFloats()
+{
+	Xorshift64 rng(2);
+	for (unsigned int i = 0; i < 2000000; ++i)
+	{
+		std::string s = RandomSign(rng);
+		const uint64_t shape = rng.Next();
+		const size_t maxDigits = (shape & 0x300) ? 12 : 90;			// now and again make the span too long to copy
+		s += RandomDigits(rng, maxDigits);
+		if (shape & 1)
+		{
+			s += '.';
+			s += RandomDigits(rng, maxDigits);
+		}
+		if (shape & 2)
+		{
+			s += (shape & 4) ? 'e' : 'E';
+			s += RandomSign(rng);
+			s += std::to_string((shape >> 16) % ((shape & 8) ? 60 : 400));
+		}
+		s += RandomEnd(rng);
+		CheckFloat(s);
+	}
+
+	// Cases that are hard to round, where the digits are close to halfway between two floats
+	for (const char *s : { "16777217", "16777217.000000000000000000000000001;", "1.00000005960464477539062499", "1.00000005960464477539062501 ",
+						   "3.4028235677973366e38", "3.4028236e38", "1.4e-45", "7.0064923216240861e-46", "7.0064923216240862e-46;",
+						   "0.000000000000000000000000000000000000000000000000000000000000000000000000000000000000001e80" })
+	{
+		CheckFloat(s);
+	}
+
+	// Numbers at, just above and just below the midpoint between two adjacent floats. The nearest double to the ones that aren't exactly
+	// at the midpoint is the midpoint itself, so converting to double and then to float rounds them the wrong way half of the time.
+	for (unsigned int i = 0; i < 100000; ++i)
+	{
+		const uint64_t r = rng.Next();
+		const float f = std::ldexp((float)((r & 0x7FFFFF) | 0x800000), (int)((r >> 32) % 40) - 40);
+		const double midpoint = ((double)f + (double)nextafterf(f, INFINITY)) / 2.0;
+		char exact[120];
+		snprintf(exact, sizeof(exact), "%.70e", midpoint);			// glibc prints the exact value, padded with zeros
+		std::string mantissa(exact, strchr(exact, 'e'));
+		const std::string exponent(strchr(exact, 'e'));
+		mantissa.erase(mantissa.find_last_not_of('0') + 1);
+		if (mantissa.size() + exponent.size() + 2 >= 64)
+		{
+			continue;
+		}
+		const std::string sign = (r & (1ull << 63)) ? "-" : "";
+		std::string below = mantissa;
+		--below.back();
+		CheckFloat(sign + mantissa + exponent);
+		CheckFloat(sign + mantissa + "1" + exponent);
+		CheckFloat(sign + below + "9" + exponent);
+	}
+}
+
+static std::string RandomText(Xorshift64& rng, size_t maxLength, unsigned int alphabet)
+{
+	const size_t len = (size_t)(rng.Next() % (maxLength + 1));
+	std::string s;
+	for (size_t i = 0; i < len; ++i)
+	{
+		s += (char)('a' + rng.Next() % alphabet);
+	}
+	return s;
+}
+
+static void CheckSearchers()
+{
+	Xorshift64 rng(3);
+	for (unsigned int i = 0; i < 200000; ++i)
+	{
+		// A small alphabet gives lots of partial matches. Some patterns are longer than the KMP failure table.
+		const unsigned int alphabet = 2 + (unsigned int)(rng.Next() % 3);
+		const std::string pattern = RandomText(rng, (i % 16 == 0) ? 300 : 8, alphabet);
+		const std::string text = (i % 16 == 0) ? RandomText(rng, 20, alphabet) + pattern + RandomText(rng, 20, alphabet) : RandomText(rng, 60, alphabet);
+
+		const SpanSearcher searcher(pattern.data(), pattern.size());
+		const size_t found = searcher.Find(text.data(), text.size());
+		const size_t expected = text.find(pattern);
+		CHECK(found == ((expected == std::string::npos) ? SpanSearcher::NotFound : expected),
+				"SpanSearcher(\"%s\").Find(\"%s\") gave %zu", pattern.c_str(), text.c_str(), found);
+
+		// The matcher reports the end of every match, including overlapping ones
+		if (!pattern.empty())
+		{
+			StreamMatcher matcher(pattern.data(), pattern.size());
+			for (size_t j = 0; j < text.size(); ++j)
+			{
+				const bool matched = matcher.Feed(text[j]);
+				const bool expectedMatch = j + 1 >= pattern.size() && text.compare(j + 1 - pattern.size(), pattern.size(), pattern) == 0;
+				CHECK(matched == expectedMatch, "StreamMatcher(\"%s\") on \"%s\" at %zu gave %d", pattern.c_str(), text.c_str(), j, (int)matched);
+			}
+		}
+	}
+}
+
+// A stream over a string. If lookAhead is false it uses the default peekAvailable, which can only see one character.
+// Characters added with Arrive() are counted by available() but can't be read yet, like ones that a UART receives between two calls.
+class StringStream : public Stream
+{
+public:
+	StringStream(const std::string& p_text, bool p_lookAhead) : text(p_text), pos(0), arriving(0), lookAhead(p_lookAhead) { setTimeout(0); }
+
+	int available() override { return (int)(text.size() - pos); }
+	int read() override { return (pos < Received()) ? (uint8_t)text[pos++] : -1; }
+	int peek() override { return (pos < Received()) ? (uint8_t)text[pos] : -1; }
+	void flush() override { }
+	size_t write(uint8_t) override { return 1; }
+
+	size_t peekAvailable(uint8_t *buffer, size_t length) override
+	{
+		if (!lookAhead)
+		{
+			return Stream::peekAvailable(buffer, length);
+		}
+		const size_t n = std::min(length, Received() - pos);
+		memcpy(buffer, text.data() + pos, n);
+		return n;
+	}
+	bool canPeekAhead() const override { return lookAhead; }
+
+	void Append(const std::string& s) { text += s; arriving = 0; }
+	void Arrive(const std::string& s) { text += s; arriving = s.size(); }
+	std::string Rest() const { return text.substr(pos); }
+
+private:
+	size_t Received() const { return text.size() - arriving; }
+
+	std::string text;
+	size_t pos;
+	size_t arriving;
+	bool lookAhead;
+};
+
+static void CheckStreams()
+{
+	for (bool lookAhead : { true, false })
+	{
+		StringStream s("  1234,-56 x-7.25e2;+x 99", lookAhead);
+		ParseResult<int32_t> i = s.parseIntAvailable();
+		CHECK(i.value == 1234 && i.error == ParseError::ok, "lookAhead %d: parseIntAvailable gave %d %s", (int)lookAhead, (int)i.value, ErrorName(i.error));
+		i = s.parseIntAvailable();
+		CHECK(i.value == -56 && i.error == ParseError::ok, "lookAhead %d: parseIntAvailable gave %d %s", (int)lookAhead, (int)i.value, ErrorName(i.error));
+		const ParseResult<float> f = s.parseFloatAvailable();
+		CHECK(f.value == -725.0f && f.error == ParseError::ok && s.Rest() == ";+x 99", "lookAhead %d: parseFloatAvailable gave %g %s", (int)lookAhead, (double)f.value, ErrorName(f.error));
+
+		// The number at the end may continue, so with look-ahead it is left in the stream until it ends
+		i = s.parseIntAvailable();
+		if (lookAhead)
+		{
+			CHECK(i.error == ParseError::incomplete && s.Rest() == "99", "lookAhead: parseIntAvailable gave %s, rest %s", ErrorName(i.error), s.Rest().c_str());
+			s.Append("87 ");
+			i = s.parseIntAvailable();
+			CHECK(i.value == 9987 && i.error == ParseError::ok, "lookAhead: parseIntAvailable gave %d %s", (int)i.value, ErrorName(i.error));
+		}
+		else
+		{
+			// Without look-ahead the number ends at the last character received, but it must not get stuck
+			CHECK(i.value == 99 && i.error == ParseError::ok && s.Rest().empty(), "no lookAhead: parseIntAvailable gave %d %s", (int)i.value, ErrorName(i.error));
+		}
+
+		StringStream single("7", lookAhead);
+		i = single.parseIntAvailable();
+		if (lookAhead)
+		{
+			CHECK(i.error == ParseError::incomplete && single.Rest() == "7", "lookAhead: single digit gave %s", ErrorName(i.error));
+
+			// Characters that arrive while the number is being parsed must not make it end early
+			StringStream late("12", true);
+			late.Arrive("34");
+			i = late.parseIntAvailable();
+			CHECK(i.error == ParseError::incomplete && late.Rest() == "1234", "lookAhead: number with more arriving gave %d %s", (int)i.value, ErrorName(i.error));
+			late.Append(",");
+			i = late.parseIntAvailable();
+			CHECK(i.value == 1234 && i.error == ParseError::ok, "lookAhead: number after more arrived gave %d %s", (int)i.value, ErrorName(i.error));
+		}
+		else
+		{
+			CHECK(i.value == 7 && i.error == ParseError::ok && single.Rest().empty(), "no lookAhead: single digit gave %d %s", (int)i.value, ErrorName(i.error));
+		}
+
+		// findUntil must handle a partial match followed by a real one, and patterns longer than the matcher's table
+		char target[] = "aab";
+		char terminator[] = "END";
+		StringStream t("xaaab rest", lookAhead);
+		CHECK(t.findUntil(target, terminator) && t.Rest() == " rest", "lookAhead %d: findUntil aab gave rest %s", (int)lookAhead, t.Rest().c_str());
+		StringStream u("xaaEND aab", lookAhead);
+		CHECK(!u.findUntil(target, terminator) && u.Rest() == " aab", "lookAhead %d: findUntil stopped at %s", (int)lookAhead, u.Rest().c_str());
+		std::string longTarget = std::string(70, 'a') + "b";
+		StringStream v(std::string(100, 'a') + "b!", lookAhead);
+		CHECK(v.find(&longTarget[0], longTarget.size()) && v.Rest() == "!", "lookAhead %d: find long target gave rest %s", (int)lookAhead, v.Rest().c_str());
+		StringStream w(std::string(69, 'a') + "b!", lookAhead);
+		CHECK(!w.find(&longTarget[0], longTarget.size()), "lookAhead %d: find long target matched a prefix", (int)lookAhead);
+
+		// find without a terminator uses the skip table on streams that can peek ahead. Matches may span the blocks it searches,
+		// and a partial match at the end of what has arrived must not match, and is discarded when find times out.
+		char ok[] = "ok T:";
+		for (size_t offset = 50; offset < 80; ++offset)
+		{
+			StringStream x(std::string(offset, 'o') + "ok T:210 ok T:", lookAhead);
+			CHECK(x.find(ok) && x.Rest() == "210 ok T:", "lookAhead %d: find at offset %zu gave rest %s", (int)lookAhead, offset, x.Rest().c_str());
+		}
+		StringStream y("junk ok", lookAhead);
+		y.Arrive(" T:1");
+		CHECK(!y.find(ok) && y.Rest() == " T:1", "lookAhead %d: find of a partial target gave rest %s", (int)lookAhead, y.Rest().c_str());
+	}
+}
+
+int main()
+{
+	CheckIntegers();
+	CheckFloats();
+	CheckSearchers();
+	CheckStreams();
+	return HostTestResult("SpanParserTest");
+}
@@ -0,0 +1,101 @@
+/*
+  StreamReadBench.cpp - Compare the bulk read functions of a UART-like stream with the per-character Stream defaults
+
+  Each default is called on the same stream, so the only difference is whether the characters are copied out of the
+  ring buffer in blocks or fetched one at a time with the virtual read() or peek().
+*/
+
+#include "HostTest.h"
+#include "UartLikeStream.h"
+#include <cstdio>
+#include <string>
+
+constexpr size_t Passes = 200;
+
+// Time reading the whole text and check that every character was read
+template<class F> static bool Report(const char *name, UartLikeStream& stream, size_t textLength, size_t expected, F readAll)
+{
+	size_t count = 0;
+	const double ns = TimeNanoseconds(Passes, [&](size_t) { stream.Rewind(); count = readAll(); });
+	printf("%-42s %8.2f\n", name, ns / textLength);
+	if (count != expected)
+	{
+		printf("  read %zu characters, expected %zu\n", count, expected);
+		return false;
+	}
+	return true;
+}
+
+int main()
+{
+	// G-code as it arrives from a host
+	std::string text;
+	Xorshift64 rng;
+	size_t lines = 0;
+	while (text.size() < 60000)
+	{
+		const uint64_t r = rng.Next();
+		char line[64];
+		snprintf(line, sizeof(line), "G1 X%.3f Y%.3f E%.4f F%u\n",
+					(double)(r & 0xFFFFF) / 1000.0, (double)((r >> 20) & 0xFFFFF) / 1000.0, (double)((r >> 40) & 0xFFFF) / 10000.0,
+					(unsigned int)(600 + (r >> 56) * 60));
+		text += line;
+		++lines;
+	}
+
+	UartLikeStream stream(text);
+	char buf[128];
+	bool ok = true;
+
+	printf("ns per character\n");
+	ok &= Report("readAvailable, 64 at a time", stream, text.size(), text.size(), [&]() {
+				size_t count = 0, n;
+				while ((n = stream.readAvailable((uint8_t *)buf, 64)) != 0) { count += n; }
+				return count;
+			});
+	ok &= Report("Stream::readAvailable, 64 at a time", stream, text.size(), text.size(), [&]() {
+				size_t count = 0, n;
+				while ((n = stream.Stream::readAvailable((uint8_t *)buf, 64)) != 0) { count += n; }
+				return count;
+			});
+	ok &= Report("readBytes, 64 at a time", stream, text.size(), text.size(), [&]() {
+				size_t count = 0, n;
+				while ((n = stream.readBytes(buf, 64)) != 0) { count += n; }
+				return count;
+			});
+	ok &= Report("Stream::readBytes, 64 at a time", stream, text.size(), text.size(), [&]() {
+				size_t count = 0, n;
+				while ((n = stream.Stream::readBytes(buf, 64)) != 0) { count += n; }
+				return count;
+			});
+	ok &= Report("readBytesUntil, a line at a time", stream, text.size(), text.size() - lines, [&]() {
+				size_t count = 0;
+				while (stream.available() != 0) { count += stream.readBytesUntil('\n', buf, sizeof(buf)); }
+				return count;
+			});
+	ok &= Report("Stream::readBytesUntil, a line at a time", stream, text.size(), text.size() - lines, [&]() {
+				size_t count = 0;
+				while (stream.available() != 0) { count += stream.Stream::readBytesUntil('\n', buf, sizeof(buf)); }
+				return count;
+			});
+
+	// A consumer that looks at what has arrived before deciding how much of it to take
+	ok &= Report("peekAvailable and readAvailable", stream, text.size(), text.size(), [&]() {
+				size_t count = 0, n;
+				while ((n = stream.peekAvailable((uint8_t *)buf, 64)) != 0)
+				{
+					count += stream.readAvailable((uint8_t *)buf, n);
+				}
+				return count;
+			});
+	ok &= Report("peek and read", stream, text.size(), text.size(), [&]() {
+				size_t count = 0;
+				while (stream.peek() >= 0)
+				{
+					KeepResult(stream.read());
+					++count;
+				}
+				return count;
+			});
+	return (ok) ? 0 : 1;
+}
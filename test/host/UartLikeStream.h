@@ -0,0 +1,113 @@
+/*
+  UartLikeStream.h - A stream with the same structure as UARTClass, for the host benchmarks
+
+  Every call first polls the receive DMA, then uses the ring buffer, and readBytes() and readBytesUntil() are copies of
+  the UARTClass versions. On the host the poll is just a volatile read and compiler barriers. On the target it also
+  reads a peripheral register and masks interrupts, so the per-call cost is higher there, and code that makes a call
+  per character compares worse than it does here.
+*/
+
+#ifndef UARTLIKESTREAM_H_
+#define UARTLIKESTREAM_H_
+
+#include "HostTest.h"
+#include "Stream.h"
+#include "RingBuffer.h"
+#include <cstring>
+#include <string>
+
+class UartLikeStream : public Stream
+{
+public:
+	explicit UartLikeStream(const std::string& p_text) : text(p_text) { setTimeout(0); Rewind(); }
+
+	int available() override { PollRxDma(); return (int)rxBuffer.available(); }
+	int read() override { PollRxDma(); return rxBuffer.read(); }
+	int peek() override { PollRxDma(); return rxBuffer.peek(); }
+	void flush() override { }
+	size_t write(uint8_t) override { return 1; }
+	size_t readAvailable(uint8_t *buffer, size_t length) override { PollRxDma(); return rxBuffer.readBlock(buffer, length); }
+	size_t peekAvailable(uint8_t *buffer, size_t length) override { PollRxDma(); return rxBuffer.peekBlock(buffer, length); }
+	bool canPeekAhead() const override { return true; }
+	size_t readBytes(char *buffer, size_t length) override;
+	size_t readBytesUntil(char terminator, char *buffer, size_t length) override;
+	using Stream::readBytes;
+	using Stream::readBytesUntil;
+
+	// Put all the text back in the receive buffer
+	void Rewind()
+	{
+		rxBuffer.clear();
+		rxBuffer.storeBlock((const uint8_t *)text.data(), text.size());
+	}
+
+private:
+	__attribute__((noinline)) void PollRxDma()
+	{
+		asm volatile("" : : : "memory");		// cpu_irq_save()
+		KeepResult(dmaAddress);					// read the DMA transfer address and compare it with what we have stored
+		asm volatile("" : : : "memory");		// cpu_irq_restore()
+	}
+
+	std::string text;
+	volatile uint32_t dmaAddress = 0;
+	RingBuffer<65536> rxBuffer;
+};
+
+inline size_t UartLikeStream::readBytes(char *buffer, size_t length)
+{
+	size_t count = 0;
+	_startMillis = millis();
+	while (count < length)
+	{
+		const size_t n = readAvailable(reinterpret_cast<uint8_t*>(buffer) + count, length - count);
+		if (n != 0)
+		{
+			count += n;
+			_startMillis = millis();
+		}
+		else if (millis() - _startMillis >= _timeout)
+		{
+			break;
+		}
+	}
+	return count;
+}
+
+inline size_t UartLikeStream::readBytesUntil(char terminator, char *buffer, size_t length)
+{
+	size_t count = 0;
+	_startMillis = millis();
+	while (count < length)
+	{
+		PollRxDma();
+		size_t avail;
+		const uint8_t * const data = rxBuffer.peekContiguous(avail);
+		if (avail != 0)
+		{
+			if (avail > length - count)
+			{
+				avail = length - count;
+			}
+			const uint8_t * const term = static_cast<const uint8_t*>(memchr(data, terminator, avail));
+			if (term != nullptr)
+			{
+				const size_t n = term - data;
+				memcpy(buffer + count, data, n);
+				rxBuffer.consume(n + 1);
+				return count + n;
+			}
+			memcpy(buffer + count, data, avail);
+			rxBuffer.consume(avail);
+			count += avail;
+			_startMillis = millis();
+		}
+		else if (millis() - _startMillis >= _timeout)
+		{
+			break;
+		}
+	}
+	return count;
+}
+
+#endif
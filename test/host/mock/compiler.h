@@ -0,0 +1,39 @@
+/*
+  compiler.h - Stand-in for the ASF compiler header when building the SD card driver for the host tests
+
+  It provides just the macros and types that sd_mmc_spi.c, ctrl_access.c and the headers they include use.
+*/
+
+#ifndef COMPILER_H_INCLUDED
+#define COMPILER_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef uint8_t U8;
+typedef uint16_t U16;
+typedef uint32_t U32;
+
+#define PASS					0
+#define FAIL					1
+#define ENABLE					1
+#define DISABLE					0
+
+#define Assert(expr)
+#define UNUSED(v)				(void)(v)
+#define Min(a, b)				(((a) < (b)) ? (a) : (b))
+#define Max(a, b)				(((a) > (b)) ? (a) : (b))
+#define COMPILER_WORD_ALIGNED	__attribute__((__aligned__(4)))
+
+#define le32_to_cpu(x)			(x)
+#define cpu_to_le32(x)			(x)
+#define be32_to_cpu(x)			__builtin_bswap32(x)
+
+typedef uint32_t irqflags_t;
+static inline irqflags_t cpu_irq_save(void) { return 0; }
+static inline void cpu_irq_restore(irqflags_t flags) { (void)flags; }
+
+typedef uint8_t Pin;
+
+#endif
@@ -0,0 +1,61 @@
+/*
+  conf_access.h - Memory access configuration for the host tests
+
+  Two LUNs are backed by RAM disks in CtrlAccessCacheTest.cpp, which can also simulate changing the card in either of them.
+  The sector cache is configured as in asf/conf_access.h, except that written sectors are kept in the cache.
+  SdMmcUsbPipelineTest.cpp builds sd_mmc_mem.c with ACCESS_USB and SD_MMC_0_MEM defined on the command line.
+*/
+
+#ifndef CONF_ACCESS_H_INCLUDED
+#define CONF_ACCESS_H_INCLUDED
+
+#include "compiler.h"
+
+#define LUN_0						DISABLE
+#define LUN_1						DISABLE
+#define LUN_2						ENABLE
+#define LUN_3						ENABLE
+#define LUN_4						DISABLE
+#define LUN_5						DISABLE
+#define LUN_6						DISABLE
+#define LUN_7						DISABLE
+#define LUN_USB						DISABLE
+
+#define LUN_2_INCLUDE				"test_luns.h"
+#define Lun_2_test_unit_ready		test_lun_test_unit_ready_0
+#define Lun_2_read_capacity			test_lun_read_capacity_0
+#define Lun_2_wr_protect			test_lun_wr_protect_0
+#define Lun_2_removal				test_lun_removal_0
+#define Lun_2_mem_2_ram				test_lun_mem_2_ram_0
+#define Lun_2_ram_2_mem				test_lun_ram_2_mem_0
+#define Lun_2_generation			test_lun_generation_0
+#define LUN_2_NAME					"\"Test LUN 0\""
+
+#define LUN_3_INCLUDE				"test_luns.h"
+#define Lun_3_test_unit_ready		test_lun_test_unit_ready_1
+#define Lun_3_read_capacity			test_lun_read_capacity_1
+#define Lun_3_wr_protect			test_lun_wr_protect_1
+#define Lun_3_removal				test_lun_removal_1
+#define Lun_3_mem_2_ram				test_lun_mem_2_ram_1
+#define Lun_3_ram_2_mem				test_lun_ram_2_mem_1
+#define Lun_3_generation			test_lun_generation_1
+#define LUN_3_NAME					"\"Test LUN 1\""
+
+#define memory_start_read_action(nb_sectors)
+#define memory_stop_read_action()
+#define memory_start_write_action(nb_sectors)
+#define memory_stop_write_action()
+
+#ifndef ACCESS_USB
+# define ACCESS_USB					false
+#endif
+#define ACCESS_MEM_TO_RAM			true
+#define ACCESS_STREAM				false
+#define ACCESS_MEM_TO_MEM			false
+#define GLOBAL_WR_PROTECT			false
+
+#define ACCESS_CACHE_SECTORS		4
+#define ACCESS_CACHE_READ_AHEAD		4
+#define ACCESS_CACHE_WRITE_BACK		true
+
+#endif
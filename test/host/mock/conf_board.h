@@ -0,0 +1,3 @@
+/*
+  conf_board.h - Empty stand-in for the ASF header of the same name when building the SD card driver for the host tests
+*/
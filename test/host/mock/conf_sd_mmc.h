@@ -0,0 +1,11 @@
+/*
+  conf_sd_mmc.h - SD card configuration for the host tests
+*/
+
+#ifndef CONF_SD_MMC_H_INCLUDED
+#define CONF_SD_MMC_H_INCLUDED
+
+#define SD_MMC_SPI_MEM_CNT		1
+#define SD_MMC_SPI_MAX_CLOCK	25000000
+
+#endif
@@ -0,0 +1,10 @@
+/*
+  preprocessor.h - Stand-in for the ASF preprocessor header when building ctrl_access.c for the host tests
+*/
+
+#ifndef PREPROCESSOR_H_INCLUDED
+#define PREPROCESSOR_H_INCLUDED
+
+#define TPASTE3(a, b, c)		a##b##c
+
+#endif
@@ -0,0 +1,10 @@
+/*
+  spi.h - Stand-in for the ASF SPI header when building the SD card driver for the host tests
+*/
+
+#ifndef SPI_H_INCLUDED
+#define SPI_H_INCLUDED
+
+typedef int spi_status_t;
+
+#endif
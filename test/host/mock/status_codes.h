@@ -0,0 +1,3 @@
+/*
+  status_codes.h - Empty stand-in for the ASF header of the same name when building the SD card driver for the host tests
+*/
@@ -0,0 +1,20 @@
+/*
+  test_luns.h - The RAM disk LUNs of CtrlAccessCacheTest.cpp
+*/
+
+#ifndef TEST_LUNS_H_INCLUDED
+#define TEST_LUNS_H_INCLUDED
+
+#define TEST_LUN_FUNCTIONS(n) \
+	Ctrl_status test_lun_test_unit_ready_##n(void); \
+	Ctrl_status test_lun_read_capacity_##n(U32 *last_sector); \
+	bool test_lun_wr_protect_##n(void); \
+	bool test_lun_removal_##n(void); \
+	Ctrl_status test_lun_mem_2_ram_##n(U32 addr, void *ram, U32 numBlocks); \
+	Ctrl_status test_lun_ram_2_mem_##n(U32 addr, const void *ram, U32 numBlocks); \
+	U32 test_lun_generation_##n(void);
+
+TEST_LUN_FUNCTIONS(0)
+TEST_LUN_FUNCTIONS(1)
+
+#endif
@@ -0,0 +1,25 @@
+/*
+  udi_msc.h - Stand-in for the ASF USB mass storage interface header when building sd_mmc_mem.c for the host tests
+
+  It declares only the two functions that the card to USB pipeline uses. SdMmcUsbPipelineTest.cpp provides them.
+*/
+
+#ifndef UDI_MSC_H_INCLUDED
+#define UDI_MSC_H_INCLUDED
+
+#include "compiler.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint32_t iram_size_t;
+
+bool udi_msc_start_trans_block(bool b_read, uint8_t *block, iram_size_t block_size);
+bool udi_msc_is_trans_block_done(bool *b_aborted);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
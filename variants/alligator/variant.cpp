@@ -332,8 +332,9 @@ extern const PinDescription g_APinDescription[]=
 /*
  * UART objects
  */
-RingBuffer rx_buffer1;
-RingBuffer tx_buffer1;
+// The UART is used for PanelDue, so it gets the large receive buffer
+RingBuffer<1024> rx_buffer1;
+RingBuffer<SERIAL_BUFFER_SIZE> tx_buffer1;
 
 UARTClass Serial(UART, UART_IRQn, ID_UART, &rx_buffer1, &tx_buffer1);
 
@@ -346,10 +347,11 @@ void UART_Handler(void)
 /*
  * USART objects
  */
-RingBuffer rx_buffer2;
-RingBuffer rx_buffer3;
-RingBuffer tx_buffer2;
-RingBuffer tx_buffer3;
+// The USARTs are rarely used, so keep their buffers small
+RingBuffer<128> rx_buffer2;
+RingBuffer<128> rx_buffer3;
+RingBuffer<64> tx_buffer2;
+RingBuffer<64> tx_buffer3;
 
 USARTClass Serial1(USART0, USART0_IRQn, ID_USART0, &rx_buffer2, &tx_buffer2);
 
@@ -226,10 +226,12 @@ extern const PinDescription g_APinDescription[]=
 /*
  * UART objects
  */
-RingBuffer rx_buffer1;
-RingBuffer tx_buffer1;
-RingBuffer rx_buffer2;
-RingBuffer tx_buffer2;
+// UART0 is used for PanelDue, so it gets the large receive buffer.
+// UART1 is only used to receive debug output from the WiFi module, so keep its buffers small.
+RingBuffer<1024> rx_buffer1;
+RingBuffer<SERIAL_BUFFER_SIZE> tx_buffer1;
+RingBuffer<256> rx_buffer2;
+RingBuffer<64> tx_buffer2;
 
 UARTClass Serial(UART0, UART0_IRQn, ID_UART0, &rx_buffer1, &tx_buffer1);
 
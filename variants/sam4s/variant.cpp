@@ -187,8 +187,8 @@ extern const PinDescription g_APinDescription[]=
 // UART0 is used to control the stepper drivers. We don't use the core support for this.
 // UART1 is used to interface with PanelDue.
 
-RingBuffer rx_buffer1;
-RingBuffer tx_buffer1;
+RingBuffer<1024> rx_buffer1;
+RingBuffer<SERIAL_BUFFER_SIZE> tx_buffer1;
 
 UARTClass Serial(UART1, UART1_IRQn, ID_UART1, &rx_buffer1, &tx_buffer1);
 
@@ -354,10 +354,12 @@ static_assert(ARRAY_SIZE(g_APinDescription) == 139, "incorrect pin count");		//
 /*
  * UART objects
  */
-RingBuffer rx_buffer1;
-RingBuffer tx_buffer1;
-RingBuffer rx_buffer2;
-RingBuffer tx_buffer2;
+// Serial is used for PanelDue or the SBC link, so it gets the large receive buffer.
+// Serial1 is rarely used, so keep its buffers small.
+RingBuffer<1024> rx_buffer1;
+RingBuffer<SERIAL_BUFFER_SIZE> tx_buffer1;
+RingBuffer<128> rx_buffer2;
+RingBuffer<64> tx_buffer2;
 
 #ifdef SAME70XPLD
 